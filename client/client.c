@@ -16,13 +16,18 @@
 #include <time.h>
 #include "../support/log.h"
 #include "../support/message.h"
+#include "../support/delta.h"
+#include "../support/fragment.h"
+#include "../support/batch.h"
 
 /************* function declarations **********/
 static bool handleMessage(void* arg, const addr_t from, const char* message);
 static void handleOK(const char* message);
-static void handleGrid(const char* message);
+static void handleGrid(const char* message, const addr_t from);
 static void handleGold(const char* message);
 static void handleDisplay(const char* message);
+static void handleFrame(const char* message, const addr_t from);
+static void drawGrid(const char* rows);
 static bool handleQuit(const char* message);
 static void handleError(const char* message);
 static void handleDisplay(const char* message);
@@ -35,6 +40,8 @@ char character_letter;
 int current_gold;
 int unclaimed_gold;
 bool isPlayer;
+delta_t* frames;  // frames for KEYFRAME/DELTA messages, made on GRID
+fragment_t* fragments;  // pieces of a message too long for one datagram
 
 
 /***************** main *******************************/
@@ -87,6 +94,8 @@ main(const int argc, char* argv[])
     isPlayer = true;
   }
   
+  fragments = fragment_new();
+
  // if all arguments are good: initialize the window for ncurses:
   initscr();
 
@@ -100,11 +109,13 @@ main(const int argc, char* argv[])
 
   // Loop, waiting for input or for messages; provide callback functions.
   // We use the 'arg' parameter to carry a pointer to 'server'.
-  bool ok = message_loop(&server, 0, NULL, handleInput, handleMessage);
+  bool ok = message_loopEvents(&server, 0, NULL, handleInput, handleMessage, NULL);
   
 
   // shut down the message module
   message_done();
+  delta_delete(frames);
+  fragment_delete(fragments);
 
   
   return ok? 0 : 1; // status code depends on result of message_loop
@@ -168,7 +179,20 @@ handleMessage(void* arg, const addr_t from, const char* message)
     // we will not return true here because even if the server sends an invalid message, the client ignores it
   }
   
-  if (strncmp(message, "GOLD ", strlen("GOLD ")) == 0) { // if GOLD
+  if (strncmp(message, "FRAGMENT ", strlen("FRAGMENT ")) == 0) { // if piece of a long message
+    // once every piece is in, handle the whole message as if it came in one go
+    const char* whole = fragment_add(fragments, message);
+    if (whole != NULL) {
+      return handleMessage(arg, from, whole);
+    }
+  }
+
+  else if (strncmp(message, "BATCH ", strlen("BATCH ")) == 0) { // if several messages in one
+    // handle each in turn, stopping early if one of them is a QUIT
+    return batch_split(message, handleMessage, arg, from);
+  }
+
+  else if (strncmp(message, "GOLD ", strlen("GOLD ")) == 0) { // if GOLD
     handleGold(message);
   }
 
@@ -177,13 +201,18 @@ handleMessage(void* arg, const addr_t from, const char* message)
   }
 
   else if (strncmp(message, "GRID ", strlen("GRID ")) == 0) { // if grid
-    handleGrid(message);
+    handleGrid(message, from);
   }
 
   else if (strncmp(message, "DISPLAY", strlen("DISPLAY")) == 0) { // if display
     handleDisplay(message);
   }
 
+  else if (strncmp(message, "KEYFRAME ", strlen("KEYFRAME ")) == 0
+           || strncmp(message, "DELTA ", strlen("DELTA ")) == 0) { // if delta-encoded display
+    handleFrame(message, from);
+  }
+
   else if (strncmp(message, "QUIT ", strlen("QUIT ")) == 0) { // if quit
     return handleQuit(message);
   }
@@ -230,6 +259,12 @@ static void handleOK(const char* message){
 /*************** handleGrid function ***********
  * takes in a message with visible part of the grid to be displayed to the client
  *
+ * also sets up the frame history and sends "ACK 0 RLE BATCH" to tell the server we can take
+ * KEYFRAME and DELTA messages instead of a full DISPLAY every time, that keyframes
+ * may come run-length encoded (delta_decode expands them before we print anything),
+ * and that it may send everything it has for us at once in a BATCH (see batch.h).
+ * servers that don't know about ACK answer with an ERROR and keep sending DISPLAY
+ *
  * scans and parses the message, then checks if the terminal is an appropriate size
  * if the terminal is not an appropriate size it prints a message to the client asking the client to resize the window or press y
  * if the client presses y, we will resize the window for them.
@@ -238,11 +273,17 @@ static void handleOK(const char* message){
  * send logs to stderr if the client presses a non-y key
  * does not return NULL if anything is invalid and simply sends logs if it encounters an error.
 */
-static void handleGrid(const char* message){
+static void handleGrid(const char* message, const addr_t from){
 int nrows, ncols;
     // Parse the GRID message
     if (sscanf(message, "GRID %d %d", &nrows, &ncols) != 2) {
         log_s("%s", "Message format is incorrect for GRID.");
+    } else {
+        delta_delete(frames);
+        frames = delta_new(nrows, ncols);
+        if (frames != NULL) {
+            message_send(from, "ACK 0 RLE BATCH");
+        }
     }
 
     // Get the current terminal dimensions
@@ -353,10 +394,39 @@ static void handleDisplay(const char* message){
   if (newline_pos == NULL) {
     // If no newline found
     log_s("%s", "NULL display message sent.\n");
+    return;
   }
 
   // Move past the newline character to get the string that follows
-  const char* string_to_display = newline_pos + 1;
+  drawGrid(newline_pos + 1);
+}
+
+/*********************** handleFrame function ************
+ * 
+ * takes in a KEYFRAME or DELTA message, rebuilds the grid it describes from the frame history
+ * and prints it out like a DISPLAY message
+ * 
+ * acknowledges the frame so the server can send the next one as a delta against it;
+ * if the message could not be applied (it was built on a frame we never got) we send "ACK 0",
+ * which asks the server for a keyframe
+*/
+static void handleFrame(const char* message, const addr_t from){
+  int seq = delta_decode(frames, message);
+  char ack[20];
+  snprintf(ack, sizeof(ack), "ACK %d", seq);
+  message_send(from, ack);
+  if (seq == 0) {
+    log_s("%s", "Could not apply frame, asking for a keyframe.");
+    return;
+  }
+  drawGrid(delta_frame(frames));
+}
+
+/*********************** drawGrid function ************
+ * 
+ * prints the rows of the grid starting right below the header
+*/
+static void drawGrid(const char* rows){
 
   // Move the cursor to the second row (skipping the top line)
   move(1, 0);  // Row 1, Column 0 (first column of the second row)
@@ -365,7 +435,7 @@ static void handleDisplay(const char* message){
   clrtobot();
 
   // Add the string to the screen
-  printw("%s", string_to_display);
+  printw("%s", rows);
 
   // refresh the screen with new content:
   constantHeader(isPlayer);
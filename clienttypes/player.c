@@ -9,19 +9,35 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <strings.h>
 #include <time.h>
 #include "../support/log.h" 
 #include "../grid/grid.h" 
 #include "../support/message.h"
+#include "../support/delta.h"
+#include "../support/arena.h"
 #include "player.h"
 
+/************* local constants ********/
+static const size_t NameBlock = 64; // names shorter than this share one arena block size
+
+/************* local functions ********/
+static int randomStart(grid_t* grid);
+static size_t nameSize(const char* name);
+static size_t visibleSize(grid_t* grid);
+
 /************* global functions ********/
 
 /******** player_new 
  * see player.h for documentation
 */
 player_t* player_new(const addr_t address, char* name, int ID, grid_t* grid){
+    int position = randomStart(grid);
+    if (position < 0){
+        flog_s(stderr, "%s", "No free floor cell for a new player.");
+        return NULL;
+    }
     player_t* player = malloc(sizeof(player_t));
     
     if (player == NULL){
@@ -29,30 +45,71 @@ player_t* player_new(const addr_t address, char* name, int ID, grid_t* grid){
         return NULL;
     }
     
-    int r;
-    int c;
-    int ncol;
-    int nrow;
-    bool valposition = false;
-    while (!valposition){ // find a valid postion:
-        nrow = grid_getRows(grid);
-        ncol = grid_getCols(grid);
-        r = rand() % nrow;  // Random row choice
-        c = rand() % ncol;  // Random column choice
-        valposition = grid_validStart(grid, r, c);
-    }
+    player->position = position;
     player->grid = grid_playerLoad(grid);
     player->name = name;
     player->IPaddress = address;
     player->ID = ID;
-    player->position = r * (ncol+1) + c;
     player->score = 0;
     player->isPlaying = true;
+    player->visible = NULL;
+    player->visDirty = true;
+    player->gridDirty = true;
+    player->frames = NULL;
+    player->batched = false;
+    player->goldSeen = -1;
+    memset(player->letters, 0, sizeof(player->letters));
+    player->arena = NULL;
 
     return player;
     
 }
 
+/******** player_newArena
+ * see player.h for documentation
+*/
+player_t* player_newArena(arena_t* arena, const addr_t address, const char* name, int ID, grid_t* grid){
+    if (arena == NULL || name == NULL || grid == NULL){
+        return NULL;
+    }
+    int position = randomStart(grid);
+    if (position < 0){
+        flog_s(stderr, "%s", "No free floor cell for a new player.");
+        return NULL;
+    }
+    player_t* player = arena_alloc(arena, sizeof(player_t));
+    char* nameCopy = arena_alloc(arena, nameSize(name));
+    uint64_t* visible = arena_calloc(arena, visibleSize(grid));
+    grid_t* playerGrid = grid_playerLoadArena(grid, arena);
+    if (player == NULL || nameCopy == NULL || visible == NULL || playerGrid == NULL){
+        flog_s(stderr, "%s", "Failed to allocate memory for new player.");
+        arena_recycle(arena, player, sizeof(player_t));
+        arena_recycle(arena, nameCopy, nameSize(name));
+        arena_recycle(arena, visible, visibleSize(grid));
+        grid_recycle(playerGrid, arena);
+        return NULL;
+    }
+    strcpy(nameCopy, name);
+
+    player->position = position;
+    player->grid = playerGrid;
+    player->name = nameCopy;
+    player->IPaddress = address;
+    player->ID = ID;
+    player->score = 0;
+    player->isPlaying = true;
+    player->visible = visible;
+    player->visDirty = true;
+    player->gridDirty = true;
+    player->frames = NULL;
+    player->batched = false;
+    player->goldSeen = -1;
+    memset(player->letters, 0, sizeof(player->letters));
+    player->arena = arena;
+
+    return player;
+}
+
 /******** player_setLocation
  * see player.h for documentation
 */
@@ -138,9 +195,45 @@ void player_delete(player_t* player){
     if (player == NULL){
         return;
     }
+    delta_delete(player->frames);
+    if (player->arena != NULL){
+        // everything else goes back to the game's arena for the next player
+        arena_t* arena = player->arena;
+        arena_recycle(arena, player->name, nameSize(player->name));
+        arena_recycle(arena, player->visible, visibleSize(player->grid));
+        grid_recycle(player->grid, arena);
+        arena_recycle(arena, player, sizeof(player_t));
+    }
     else{
         free(player->name);
+        free(player->visible);
         free(player);
     }
 }
 
+/************* local functions ********/
+
+/******** randomStart
+ * picks a random free floor cell of the grid, as a gridArray index,
+ * or -1 if every floor cell is taken
+ */
+static int randomStart(grid_t* grid){
+    return grid_randomFloor(grid);
+}
+
+/******** nameSize
+ * the arena block for a name: NameBlock unless the name is longer,
+ * so players joining and leaving reuse each other's name blocks
+ */
+static size_t nameSize(const char* name){
+    size_t length = strlen(name) + 1;
+    return length < NameBlock ? NameBlock : length;
+}
+
+/******** visibleSize
+ * bytes in a visible set for the grid, one bit per cell
+ */
+static size_t visibleSize(grid_t* grid){
+    return ((grid_getRows(grid) * grid_getCols(grid) + 63) / 64) * sizeof(uint64_t);
+}
+
@@ -8,9 +8,15 @@
 #define PLAYER_H
 
 #include <stdbool.h>
+#include <stdint.h>
 #include "../support/log.h" 
 #include "../grid/grid.h" 
 #include "../support/message.h"
+#include "../support/delta.h"
+#include "../support/arena.h"
+
+/************* constants ***********/
+#define PlayerLetters 26 // a player's display names the others it sees 'A' to 'Z'
 
 /************* structs ***********/
 typedef struct player {
@@ -21,6 +27,14 @@ typedef struct player {
     bool isPlaying;
     addr_t IPaddress;
     grid_t* grid;
+    uint64_t* visible; // cells in sight at the last full visibility update
+    bool visDirty; // true if visible is stale because the player moved
+    bool gridDirty; // true if grid was redrawn since the player's last frame
+    delta_t* frames; // DISPLAY frames for delta encoding, NULL for plain DISPLAY
+    bool batched; // true if the client takes several messages in one BATCH
+    int goldSeen; // gold left in the game as of the last GOLD sent, -1 before any
+    int32_t letters[PlayerLetters]; // 1 + ID of the player each letter names in this player's display, or 0
+    arena_t* arena; // the arena the player came from, NULL if malloc'd
 } player_t;
 
 /*************** functions *******/
@@ -28,15 +42,28 @@ typedef struct player {
 /************ player_new ********
  * 
  * function to create a new player struct and initialize it to a new location on the grid
- * initializes player score to 0, and player position to a random location
+ * initializes player score to 0, and player position to a random free floor cell
  * initializes the the parameters to player attributes
  * 
  * takes a valid addr_t struct, a player name, an intID, and a valid grid_t struct
  * 
- * returns a player struct or NULL if it cannot create a new player 
+ * returns a player struct or NULL if it cannot create a new player,
+ * including when no floor cell is free
 */
 player_t* player_new(const addr_t address, char* name, int ID, grid_t* grid); // grid used to set location randomly
 
+/************ player_newArena ********
+ * 
+ * like player_new, but the player, a copy of its name, its grid and its
+ * visible set all come from a game's arena
+ * 
+ * player_delete gives them back to the arena for the next player to reuse;
+ * the caller must not grid_delete the player's grid
+ * 
+ * returns a player struct or NULL if it cannot create a new player 
+*/
+player_t* player_newArena(arena_t* arena, const addr_t address, const char* name, int ID, grid_t* grid);
+
 void player_setLocation(player_t* player, int position); // update location
 int player_getLocation(player_t* player); //return location
 void player_setGrid(player_t* player, grid_t* newgrid); 
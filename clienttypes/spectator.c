@@ -13,6 +13,8 @@
 #include <time.h>
 #include "log.h" 
 #include "message.h"
+#include "delta.h"
+#include "arena.h"
 #include "spectator.h"
 
 
@@ -29,10 +31,29 @@ spectator_t* spectator_new(const addr_t address){
     }
     else{
         spectator->IPaddress = address;
+        spectator->frames = NULL;
+        spectator->batched = false;
+        spectator->arena = NULL;
     }
     return spectator;
 }
 
+/******** spectator_newArena 
+ * see spectator.h for documentation
+*/
+spectator_t* spectator_newArena(arena_t* arena, const addr_t address){
+    spectator_t* spectator = arena_alloc(arena, sizeof(spectator_t));
+    if (spectator == NULL){
+        flog_s(stderr, "%s", "Failed to allocate memory for new spectator.");
+        return NULL;
+    }
+    spectator->IPaddress = address;
+    spectator->frames = NULL;
+    spectator->batched = false;
+    spectator->arena = arena;
+    return spectator;
+}
+
 /************* spectator_getAddress
  * see spectator.h for documentation
  */
@@ -52,5 +73,12 @@ bool spectator_sendMessage(spectator_t* player, const char* message){
 }
 
 void spectator_delete(spectator_t* spectator){
+    if (spectator != NULL){
+        delta_delete(spectator->frames);
+        if (spectator->arena != NULL){
+            arena_recycle(spectator->arena, spectator, sizeof(spectator_t));
+            return;
+        }
+    }
     free(spectator);
 }
\ No newline at end of file
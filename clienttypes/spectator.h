@@ -11,10 +11,15 @@
 
 #include "log.h" 
 #include "message.h"
+#include "delta.h"
+#include "arena.h"
 
 /***************** structs **********/
 typedef struct spectator {
     addr_t IPaddress;
+    delta_t* frames; // DISPLAY frames for delta encoding, NULL for plain DISPLAY
+    bool batched; // true if the client takes several messages in one BATCH
+    arena_t* arena; // the arena the spectator came from, NULL if malloc'd
 } spectator_t;
 
 /****************** functions  ********/
@@ -29,6 +34,13 @@ typedef struct spectator {
  * assumes that the 
 */
 spectator_t* spectator_new(const addr_t address);
+
+/**************** spectator_newArena *******
+ * 
+ * like spectator_new, but the struct comes from a game's arena;
+ * spectator_delete gives it back for the next spectator to reuse
+*/
+spectator_t* spectator_newArena(arena_t* arena, const addr_t address);
 const addr_t spectator_getAddress(spectator_t* spectator);
 bool spectator_sendMessage(spectator_t* player, const char* message);
 void spectator_delete(spectator_t* spectator);
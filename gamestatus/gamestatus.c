@@ -0,0 +1,566 @@
+/*************
+ * gamestatus.c
+ * see gamestatus.h for more explanation
+ *
+ * Kellen Seeley
+ * Group Big D Nuggets
+ * Nuggets final project gamestatus module
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "gamestatus.h"
+
+/************ constants *************/
+static const int GoldTotal = 250;        // amount of gold in the game
+static const int GoldMinNumPiles = 10;   // minimum number of gold piles
+static const int GoldMaxNumPiles = 30;   // maximum number of gold piles
+static const int SessionMinSlots = 64;   // starting size of the sessions array
+static const int PlayerMinSlots = 32;    // starting size of the players array
+
+/********** function prototypes **************/
+gamestatus_t* gamestatus_new(const char* mapFile);
+gamestatus_t* gamestatus_newShared(const char* mapFile, grid_t* originalGrid);
+bool gamestatus_setMaxPlayers(gamestatus_t* game, int maxPlayers);
+player_t* gamestatus_addPlayer(gamestatus_t* game, const char* playerName, const addr_t address);
+bool gamestatus_addSpectator(gamestatus_t* game, const addr_t address);
+void gamestatus_distributeGold(gamestatus_t* game, int minPiles, int maxPiles);
+player_t* gamestatus_getPlayerByAddress(gamestatus_t* game, const addr_t address);
+session_t* gamestatus_getSession(gamestatus_t* game, const addr_t address);
+player_t* gamestatus_playerAt(gamestatus_t* game, int position);
+void gamestatus_setOccupant(gamestatus_t* game, int position, player_t* player);
+int gamestatus_freeFloor(gamestatus_t* game);
+bool gamestatus_checkOccupancy(gamestatus_t* game);
+void gamestatus_removePlayer(gamestatus_t* game, const addr_t address);
+void gamestatus_removeSpectator(gamestatus_t* game);
+bool gamestatus_checkGameOver(gamestatus_t* game);
+void gamestatus_endGame(gamestatus_t* game);
+void gamestatus_delete(gamestatus_t* game);
+
+static session_t* sessionInsert(gamestatus_t* game, const addr_t address);
+static void sessionRelease(gamestatus_t* game, session_t* session);
+static bool playersGrow(gamestatus_t* game);
+static gamestatus_t* newGame(const char* mapFile, grid_t* originalGrid);
+
+/************ global functions *************/
+
+/**************** gamestatus_new *****************/
+/**
+ * loads the grid twice (one copy stays untouched), then scatters the gold
+ */
+gamestatus_t* gamestatus_new(const char* mapFile) {
+    return newGame(mapFile, NULL);
+}
+
+/**************** gamestatus_newShared *****************/
+/**
+ * loads only the grid the game changes; gamestatus_delete leaves originalGrid
+ */
+gamestatus_t* gamestatus_newShared(const char* mapFile, grid_t* originalGrid) {
+    if (originalGrid == NULL) return NULL;
+    return newGame(mapFile, originalGrid);
+}
+
+/**************** gamestatus_setMaxPlayers *****************/
+/**
+ * only the limit changes; playersGrow does the allocating when players come.
+ * Every player's ID must stay below the limit, and the limit stays within
+ * the floor cells the gold was not put on, one for each player to start on,
+ * so a map whose gold covers all its floor takes no limit at all
+ */
+bool gamestatus_setMaxPlayers(gamestatus_t* game, int maxPlayers) {
+
+    if (game == NULL || maxPlayers < 1 || maxPlayers > MaxPlayersLimit) return false;
+
+    int room = game->numFloor - (game->goldPool == NULL ? 0 : game->goldPool->numPiles);
+    if (room < 1) return false;
+    if (maxPlayers > room) {
+        maxPlayers = room;
+    }
+
+    for (int i = maxPlayers; i < game->playerSlots; i++) {
+        if (game->players[i] != NULL) return false;
+    }
+    game->maxPlayers = maxPlayers;
+    return true;
+}
+
+/**************** gamestatus_addPlayer *****************/
+/**
+ * puts the new player in the first empty slot, whose index becomes its ID,
+ * and records it in the session table for its address; the player comes
+ * from the game's arena, reusing the memory of one who left if it can.
+ * freeSlot saves searching the slots every earlier player holds
+ */
+player_t* gamestatus_addPlayer(gamestatus_t* game, const char* playerName, const addr_t address) {
+
+    // with no free floor cell there is nowhere to put the player
+    if (game->numPlayers >= game->maxPlayers || gamestatus_freeFloor(game) <= 0) return NULL;
+
+    int i = game->freeSlot;
+    while (i < game->playerSlots && game->players[i] != NULL) {
+        i++;
+    }
+    if (i == game->playerSlots && !playersGrow(game)) {
+        return NULL;
+    }
+
+    game->players[i] = player_newArena(game->arena, address, playerName, i, game->grid);
+    if (game->players[i] == NULL) {
+        log_v("Failed to add new player");
+        return NULL;
+    }
+
+    session_t* session = sessionInsert(game, address);
+    if (session == NULL) {
+        log_v("Failed to add new player's session");
+        player_delete(game->players[i]);
+        game->players[i] = NULL;
+        return NULL;
+    }
+    // a second PLAY from the same address still finds the first player
+    if (session->player == NULL) {
+        session->player = game->players[i];
+    }
+
+    game->freeSlot = i + 1;
+    game->numPlayers++;
+    return game->players[i];
+}
+
+/**************** gamestatus_addSpectator *****************/
+/**
+ * creates the spectator if there is none yet; the address may already
+ * have a session as a player, which a failure here must leave alone
+ */
+bool gamestatus_addSpectator(gamestatus_t* game, const addr_t address) {
+
+    if (game->spectator != NULL) return false;
+
+    session_t* session = sessionInsert(game, address);
+    if (session == NULL) {
+        log_v("Failed to add new spectator's session");
+        return false;
+    }
+    bool created = (session->player == NULL);
+
+    game->spectator = spectator_newArena(game->arena, address);
+    if (game->spectator == NULL) {
+        log_v("Failed to create new spectator");
+        if (created) sessionRelease(game, session);
+        return false;
+    }
+    session->isSpectator = true;
+    return true;
+}
+
+/**************** gamestatus_distributeGold *****************/
+/**
+ * picks a number of piles, drops each on a random valid floor cell, and
+ * splits GoldTotal between them, each pile getting at least one nugget
+ */
+void gamestatus_distributeGold(gamestatus_t* game, int minPiles, int maxPiles) {
+
+    if (game == NULL || game->grid == NULL) {
+        log_e("gamestatus or grid is NULL");
+        return;
+    }
+
+    // the pool is freed with the game's arena; a pool this replaces stays
+    // there until then, since each game only distributes its gold once.
+    // A pile needs a floor cell of its own
+    int numPiles = grid_random() % (maxPiles - minPiles + 1) + minPiles;
+    if (numPiles > game->numFloor) numPiles = game->numFloor;
+    int nrow = game->grid->nrow;
+    int ncol = game->grid->ncol;
+    game->goldPool = gold_poolInit(arena_alloc(game->arena, gold_poolSize(numPiles, nrow, ncol)),
+                                   numPiles, nrow, ncol);
+    if (game->goldPool == NULL) {
+        log_e("Failed to allocate memory for goldPool");
+        return;
+    }
+
+    int distributed = 0;
+    for (int i = 0; i < numPiles; i++) {
+        int position = grid_randomFloor(game->grid);
+        if (position < 0) {
+            log_e("No floor cell left for a gold pile");
+            break;
+        }
+        int x = position % (ncol + 1);
+        int y = position / (ncol + 1);
+
+        // leave at least one nugget for each pile still to come
+        int remaining = GoldTotal - distributed;
+        int value = (i == numPiles - 1) ? remaining
+                                        : grid_random() % (remaining - (numPiles - i - 1)) + 1;
+        distributed += value;
+
+        gold_poolAdd(game->goldPool, value, x, y);
+        grid_addGoldPile(game->grid, y, x);
+    }
+    // on a map with too little floor, the game is for the gold that fit
+    game->totalGold = distributed;
+}
+
+/**************** gamestatus_getPlayerByAddress *****************/
+/**
+ * looks the address up in the session table
+ */
+player_t* gamestatus_getPlayerByAddress(gamestatus_t* game, const addr_t address) {
+
+    session_t* session = gamestatus_getSession(game, address);
+    return session == NULL ? NULL : session->player;
+}
+
+/**************** gamestatus_getSession *****************/
+/**
+ * finds the session for an address, or NULL if nobody is there
+ */
+session_t* gamestatus_getSession(gamestatus_t* game, const addr_t address) {
+
+    if (game == NULL || address.sin_family != AF_INET) return NULL;
+
+    int index = addrmap_get(game->sessionIndex, address);
+    return index < 0 ? NULL : &game->sessions[index];
+}
+
+/**************** gamestatus_playerAt *****************/
+/**
+ * the occupancy map holds 1 + ID, and a player's ID is its slot in players
+ */
+player_t* gamestatus_playerAt(gamestatus_t* game, int position) {
+
+    int occupant = game->occupancy[position];
+    return occupant == 0 ? NULL : game->players[occupant - 1];
+}
+
+/**************** gamestatus_setOccupant *****************/
+/**
+ * stores 1 + the player's ID, or 0 for nobody, and counts a player arriving
+ * on or leaving a floor cell of the map; a swap changes neither count
+ */
+void gamestatus_setOccupant(gamestatus_t* game, int position, player_t* player) {
+
+    if (game->originalGrid->gridArray[position] == '.') {
+        bool wasEmpty = (game->occupancy[position] == 0);
+        if (wasEmpty && player != NULL) game->playersOnFloor++;
+        if (!wasEmpty && player == NULL) game->playersOnFloor--;
+    }
+    game->occupancy[position] = (player == NULL) ? 0 : player->ID + 1;
+}
+
+/**************** gamestatus_freeFloor *****************/
+/**
+ * a player who steps on gold collects it at once, so players and piles
+ * never share a cell for long enough to be counted twice
+ */
+int gamestatus_freeFloor(gamestatus_t* game) {
+
+    int piles = (game->goldPool == NULL) ? 0 : game->goldPool->numPiles - game->goldPool->numFound;
+    return game->numFloor - piles - game->playersOnFloor;
+}
+
+/**************** gamestatus_checkOccupancy *****************/
+/**
+ * walks the whole map once, counting players on floor cells as it goes,
+ * then every player
+ */
+bool gamestatus_checkOccupancy(gamestatus_t* game) {
+
+    bool consistent = true;
+    int onFloor = 0;
+    int cells = game->grid->nrow * (game->grid->ncol + 1);
+    for (int position = 0; position < cells; position++) {
+        int occupant = game->occupancy[position];
+        if (occupant == 0) continue;
+        onFloor += (game->originalGrid->gridArray[position] == '.');
+
+        player_t* player = (occupant <= game->playerSlots) ? game->players[occupant - 1] : NULL;
+        if (player == NULL || !player->isPlaying || player->position != position) {
+            log_d("Occupancy map has a player who is not there at %d", position);
+            consistent = false;
+        }
+    }
+    for (int i = 0; i < game->playerSlots; i++) {
+        player_t* player = game->players[i];
+        if (player != NULL && player->isPlaying
+            && game->occupancy[player->position] != player->ID + 1) {
+            log_d("Occupancy map is missing the player at %d", player->position);
+            consistent = false;
+        }
+    }
+    if (onFloor != game->playersOnFloor) {
+        log_d("Occupancy map counts %d players on floor cells", game->playersOnFloor);
+        consistent = false;
+    }
+    return consistent;
+}
+
+/**************** gamestatus_removePlayer *****************/
+/**
+ * deletes the player at the address, and its grid, and empties its slot
+ */
+void gamestatus_removePlayer(gamestatus_t* game, const addr_t address) {
+
+    session_t* session = gamestatus_getSession(game, address);
+    if (session == NULL || session->player == NULL) return;
+
+    player_t* player = session->player;
+    session->player = NULL;
+    if (gamestatus_playerAt(game, player->position) == player) {
+        gamestatus_setOccupant(game, player->position, NULL);
+    }
+    game->players[player->ID] = NULL;
+    game->numPlayers--;
+    if (player->ID < game->freeSlot) {
+        game->freeSlot = player->ID;
+    }
+    for (int i = 0; i < game->playerSlots && session->player == NULL; i++) {
+        if (game->players[i] != NULL && message_eqAddr(game->players[i]->IPaddress, address)) {
+            // another player joined from the same address; it takes over
+            session->player = game->players[i];
+        }
+    }
+    player_delete(player);
+
+    if (session->player == NULL && !session->isSpectator) {
+        sessionRelease(game, session);
+    }
+}
+
+/**************** gamestatus_removeSpectator *****************/
+/**
+ * deletes the spectator if there is one
+ */
+void gamestatus_removeSpectator(gamestatus_t* game) {
+
+    if (game->spectator == NULL) return;
+
+    session_t* session = gamestatus_getSession(game, game->spectator->IPaddress);
+    if (session != NULL) {
+        session->isSpectator = false;
+        if (session->player == NULL) {
+            sessionRelease(game, session);
+        }
+    }
+    spectator_delete(game->spectator);
+    game->spectator = NULL;
+}
+
+/**************** gamestatus_checkGameOver *****************/
+/**
+ * the game is over once every nugget has been collected
+ */
+bool gamestatus_checkGameOver(gamestatus_t* game) {
+
+    if (game->totalGold == 0) {
+        game->gameOver = true;
+        gamestatus_endGame(game);
+        return true;
+    }
+    return false;
+}
+
+/**************** gamestatus_endGame *****************/
+/**
+ * says QUIT to every client, then deletes them all
+ */
+void gamestatus_endGame(gamestatus_t* game) {
+
+    for (int i = 0; i < game->playerSlots; i++) {
+        if (game->players[i] != NULL) {
+            message_send(game->players[i]->IPaddress, "QUIT");
+            player_delete(game->players[i]);
+            game->players[i] = NULL;
+        }
+    }
+    game->numPlayers = 0;
+    game->freeSlot = 0;
+    if (game->spectator != NULL) {
+        message_send(game->spectator->IPaddress, "QUIT");
+        spectator_delete(game->spectator);
+        game->spectator = NULL;
+    }
+
+    addrmap_clear(game->sessionIndex);
+    game->numSessions = 0;
+    memset(game->occupancy, 0, game->grid->nrow * (game->grid->ncol + 1) * sizeof(int32_t));
+    game->playersOnFloor = 0;
+}
+
+/**************** gamestatus_delete *****************/
+/**
+ * deletes both grids (but not a shared original), the players array and
+ * the session table, then frees the arena, and with it the game, its players and their grids,
+ * the gold and the spectator; only the players' and spectator's frame
+ * histories need deleting one by one first
+ */
+void gamestatus_delete(gamestatus_t* game) {
+
+    if (game == NULL) return;
+
+    grid_delete(game->grid);
+    if (!game->sharedOriginal) {
+        grid_delete(game->originalGrid);
+    }
+
+    for (int i = 0; i < game->playerSlots; i++) {
+        if (game->players[i] != NULL) {
+            delta_delete(game->players[i]->frames);
+        }
+    }
+    if (game->spectator != NULL) {
+        delta_delete(game->spectator->frames);
+    }
+    free(game->players);
+    free(game->sessions);
+    addrmap_delete(game->sessionIndex);
+    arena_delete(game->arena);
+}
+
+/************ local functions *************/
+
+/**************** newGame *****************/
+/**
+ * the work of gamestatus_new; originalGrid is NULL to load our own copy.
+ * The game itself is the first thing in its arena
+ */
+static gamestatus_t* newGame(const char* mapFile, grid_t* originalGrid) {
+
+    arena_t* arena = arena_new(0);
+    gamestatus_t* game = arena_alloc(arena, sizeof(gamestatus_t));
+    if (game == NULL) {
+        log_e("Failed to allocate memory for gamestatus game");
+        arena_delete(arena);
+        return NULL;
+    }
+    game->arena = arena;
+
+    game->sharedOriginal = (originalGrid != NULL);
+    // a shared original is the map as the server first read it, and the
+    // game is played on a copy of that, without reading the file again
+    game->grid = game->sharedOriginal ? grid_copy(originalGrid) : grid_load(mapFile);
+    game->originalGrid = game->sharedOriginal ? originalGrid : grid_loadCopied(mapFile);
+    if (game->grid == NULL || game->originalGrid == NULL) {
+        log_e("Failed to load grid");
+        grid_delete(game->grid);
+        if (!game->sharedOriginal) grid_delete(game->originalGrid);
+        arena_delete(arena);
+        return NULL;
+    }
+    if (!grid_loadChunks(game->grid)) {
+        log_v("No chunk index for the map, every cell is looked at");
+    }
+
+    // the sessions and players arrays grow as clients arrive, so they
+    // are malloc'd on their own
+    game->sessions = malloc(SessionMinSlots * sizeof(session_t));
+    game->sessionIndex = addrmap_new();
+    game->players = calloc(PlayerMinSlots, sizeof(player_t*));
+    game->occupancy = arena_calloc(arena, game->grid->nrow * (game->grid->ncol + 1) * sizeof(int32_t));
+    if (game->sessions == NULL || game->sessionIndex == NULL
+        || game->players == NULL || game->occupancy == NULL) {
+        log_e("Failed to allocate memory for sessions, players or occupancy");
+        free(game->sessions);
+        addrmap_delete(game->sessionIndex);
+        free(game->players);
+        grid_delete(game->grid);
+        if (!game->sharedOriginal) grid_delete(game->originalGrid);
+        arena_delete(arena);
+        return NULL;
+    }
+    game->sessionSlots = SessionMinSlots;
+    game->numSessions = 0;
+    game->playerSlots = PlayerMinSlots;
+    game->maxPlayers = MaxPlayers;
+    game->freeSlot = 0;
+
+    game->totalGold = GoldTotal;
+    game->numPlayers = 0;
+    game->spectator = NULL;
+    game->gameOver = false;
+    game->goldPool = NULL;
+
+    game->numFloor = 0;
+    game->playersOnFloor = 0;
+    for (int r = 0; r < game->grid->nrow; r++) {
+        for (int c = 0; c < game->grid->ncol; c++) {
+            game->numFloor += grid_validStart(game->grid, r, c);
+        }
+    }
+    gamestatus_distributeGold(game, GoldMinNumPiles, GoldMaxNumPiles);
+    gamestatus_setMaxPlayers(game, MaxPlayers);
+    return game;
+}
+
+/**************** sessionInsert *****************/
+/**
+ * returns the session for the address, adding an empty one at the end of
+ * the array if there is none; the array doubles when it is full. NULL if
+ * out of memory
+ */
+static session_t* sessionInsert(gamestatus_t* game, const addr_t address) {
+
+    session_t* session = gamestatus_getSession(game, address);
+    if (session != NULL) return session;
+
+    if (game->numSessions == game->sessionSlots) {
+        session_t* sessions = realloc(game->sessions, 2 * game->sessionSlots * sizeof(session_t));
+        if (sessions == NULL) {
+            log_e("Failed to grow the sessions array");
+            return NULL;
+        }
+        game->sessions = sessions;
+        game->sessionSlots *= 2;
+    }
+    if (!addrmap_put(game->sessionIndex, address, game->numSessions)) {
+        log_e("Failed to grow the session index");
+        return NULL;
+    }
+    session = &game->sessions[game->numSessions++];
+    session->address = address;
+    session->player = NULL;
+    session->isSpectator = false;
+    return session;
+}
+
+/**************** sessionRelease *****************/
+/**
+ * drops a session, moving the last one into its place so the sessions in
+ * use stay at the front of the array
+ */
+static void sessionRelease(gamestatus_t* game, session_t* session) {
+
+    int index = session - game->sessions;
+    int last = --game->numSessions;
+    addrmap_remove(game->sessionIndex, session->address);
+    if (index != last) {
+        *session = game->sessions[last];
+        // the address is already in the index, so this cannot fail
+        addrmap_put(game->sessionIndex, session->address, index);
+    }
+}
+
+/**************** playersGrow *****************/
+/**
+ * doubles the players array, but not past maxPlayers; false if it is
+ * already that long or out of memory
+ */
+static bool playersGrow(gamestatus_t* game) {
+
+    int slots = 2 * game->playerSlots;
+    if (slots > game->maxPlayers) slots = game->maxPlayers;
+    if (slots <= game->playerSlots) return false;
+
+    player_t** players = realloc(game->players, slots * sizeof(player_t*));
+    if (players == NULL) {
+        log_e("Failed to grow the players array");
+        return false;
+    }
+    memset(players + game->playerSlots, 0, (slots - game->playerSlots) * sizeof(player_t*));
+    game->players = players;
+    game->playerSlots = slots;
+    return true;
+}
@@ -8,6 +8,7 @@
 #ifndef GAMESTATUS_H
 #define GAMESTATUS_H
 
+#include <stdint.h>
 
 #include "../support/message.h"
 #include "../grid/grid.h"
@@ -15,50 +16,105 @@
 #include "../clienttypes/player.h"
 #include "../clienttypes/spectator.h"
 #include "../support/log.h"
+#include "../support/arena.h"
+#include "../support/addrmap.h"
 
 // static const int MaxPlayers = 26;      // maximum number of players
-#define MaxPlayers 26  
+#define MaxPlayers 26           // players a game takes unless gamestatus_setMaxPlayers says otherwise
+#define MaxPlayersLimit 65536   // the most gamestatus_setMaxPlayers allows
 
 
 /************* structs ************/
+/**
+ * Who is at one client address: the player there, the spectator, or both.
+ * Kept in an array indexed by an address map, so finding the sender of a
+ * message does not scan the players array.
+ */
+typedef struct session {
+    addr_t address;        // the client's address
+    player_t* player;      // the player at this address, or NULL
+    bool isSpectator;      // true if the spectator is at this address
+} session_t;
+
 /**
  * Represents the overall game state.
  */
 typedef struct gamestatus {
     grid_t* grid;           // pointer to the main game grid
     grid_t* originalGrid;   // pointer to the original grid layout
-    gold_t** goldPiles;     // array of pointers to gold piles
-    player_t* players[MaxPlayers];    // array of pointers to players in the game
+    goldPool_t* goldPool;   // the gold piles
+    player_t** players;     // indexed by ID; grows as players join, NULL where nobody is
+    int playerSlots;        // length of players, at most maxPlayers
+    int maxPlayers;         // most players the game takes, MaxPlayers by default
+    int freeSlot;           // no empty slot in players comes before this one
     spectator_t* spectator;   // pointer to the spectator
     int totalGold;   // total remaining gold in the game
     int numPlayers;  // current number of players in the game
-    int numGoldPiles;   // number of gold piles in the game
     bool gameOver;   // boolean to track if the game is over
+    session_t* sessions;   // one per client address, the first numSessions in use
+    int sessionSlots;      // length of sessions
+    int numSessions;       // addresses in sessions
+    addrmap_t* sessionIndex;   // client address to its index in sessions
+    int32_t* occupancy;    // per gridArray cell: 1 + ID of the player standing there, or 0
+    int numFloor;          // '.' cells of the map, where players start and gold lies
+    int playersOnFloor;    // players standing on one of those cells
+    bool sharedOriginal;   // originalGrid belongs to whoever called gamestatus_newShared
+    arena_t* arena;        // holds the game, its players, spectator, gold and occupancy
 } gamestatus_t;
 
 /************* functions ************/
 
 /**************** gamestatus_new *****************/
 /**
- * initializes a new gamestatus_t struct with a map file and seed
- * loads the grid, sets up gold piles, and initializes players and spectator pointers
+ * initializes a new gamestatus_t struct with a map file
+ * loads the grid, sets up gold piles, and initializes players and spectator pointers;
+ * gold is placed with grid_random, so the caller seeds its thread with grid_seedRandom
+ * (the server does so once per worker thread)
+ * 
+ * @param mapFile the pointer to the map to load.
+ * @return a pointer to the newly created gamestatus_t, or NULL on failure.
+ */
+ gamestatus_t* gamestatus_new(const char* mapFile);
+
+/**************** gamestatus_newShared *****************/
+/**
+ * like gamestatus_new, but uses an original grid the caller already loaded
+ * from the same map file instead of loading another, and plays on a copy of
+ * it, so the file is not read again; a server running many games of one map
+ * can then keep one original grid and visibility cache
  * 
  * @param mapFile the pointer to the map to load.
- * @param seed the seed for random number generation.
+ * @param originalGrid the map as loaded, which the caller keeps and deletes
+ *        after every game using it.
  * @return a pointer to the newly created gamestatus_t, or NULL on failure.
  */
- gamestatus_t* gamestatus_new(const char* mapFile, int seed);
+gamestatus_t* gamestatus_newShared(const char* mapFile, grid_t* originalGrid);
+
+/**************** gamestatus_setMaxPlayers *****************/
+/** sets how many players the game takes; the players array grows to it as
+* they join, so a high limit costs nothing until the players come. Each
+* player needs a floor cell to start on, so a limit above the map's floor
+* cells less its gold piles is lowered to that many
+*
+* @param game the current game state
+* @param maxPlayers the new limit, from 1 to MaxPlayersLimit, and above the
+*        ID of every player already in the game
+* @return true if the limit was changed, false if it was out of range or
+*         the gold left no floor cell for a player to start on
+*/
+bool gamestatus_setMaxPlayers(gamestatus_t* game, int maxPlayers);
 
 /**************** gamestatus_addPlayer *****************/
-/**  adds a player to the game, returning true if successful, false if player limit reached, assigns them a unique ID and position
+/**  adds a player to the game, returning true if successful, false if player limit reached
+* or no floor cell is free, assigns them a unique ID and position
 * 
  * @param game the current game state
- * @param playerName the name of the player to add
+ * @param playerName the name of the player to add, which the player keeps a copy of
  * @param address the network address of the player
  * @return a pointer to the new player_t if successful, NULL if the player could not be added
 */
 
-player_t* gamestatus_addPlayer(gamestatus_t* game, char* playerName, const addr_t address);
+player_t* gamestatus_addPlayer(gamestatus_t* game, const char* playerName, const addr_t address);
 
 /**************** gamestatus_addSpectator *****************/
 /**  adds a spectator to the game if no spectator is currently present
@@ -70,7 +126,8 @@ player_t* gamestatus_addPlayer(gamestatus_t* game, char* playerName, const addr_
 bool gamestatus_addSpectator(gamestatus_t* game, const addr_t address);
 
 /**************** gamestatus_distributeGold *****************/
-/**  distributes gold piles randomly across floor cells within the grid
+/**  distributes gold piles randomly across floor cells within the grid,
+* storing them in goldPool
 *
 * @param game the current game state.
 * @param minPiles the minimum number of gold piles to distribute.
@@ -87,6 +144,55 @@ void gamestatus_distributeGold(gamestatus_t* game, int minPiles, int maxPiles);
 */
 player_t* gamestatus_getPlayerByAddress(gamestatus_t* game, const addr_t address);
 
+/**************** gamestatus_getSession *****************/
+/** finds who is at a network address, in constant time
+*
+* @param game the current game state
+* @param address the network address being searched for
+* @return the session for that address, or NULL if no player or spectator is there;
+*         it is only good until the next player or spectator is added or removed
+*/
+session_t* gamestatus_getSession(gamestatus_t* game, const addr_t address);
+
+/**************** gamestatus_playerAt *****************/
+/** finds the player standing on a cell, with one lookup in the occupancy map
+*
+* @param game the current game state
+* @param position the cell, as an index into the grid's gridArray
+* @return the player on that cell, or NULL if nobody (still playing) is there
+*/
+player_t* gamestatus_playerAt(gamestatus_t* game, int position);
+
+/**************** gamestatus_setOccupant *****************/
+/** records who stands on a cell; the server calls this whenever a player
+* arrives on, leaves, or swaps onto a cell, to keep the occupancy map in sync
+*
+* @param game the current game state
+* @param position the cell, as an index into the grid's gridArray
+* @param player the player now on that cell, or NULL if it is now empty
+*/
+void gamestatus_setOccupant(gamestatus_t* game, int position, player_t* player);
+
+/**************** gamestatus_freeFloor *****************/
+/** counts the floor cells a new player could start on, with no player and
+* no uncollected gold on them, without looking at the grid
+*
+* @param game the current game state
+* @return the number of free floor cells
+*/
+int gamestatus_freeFloor(gamestatus_t* game);
+
+/**************** gamestatus_checkOccupancy *****************/
+/** debugging aid: checks the occupancy map against the players, logging each
+* cell where they disagree; every playing player must be on its own cell and
+* every occupied cell must hold a playing player standing there, and the
+* count of players on floor cells must match
+*
+* @param game the current game state
+* @return true if the occupancy map is consistent, false otherwise
+*/
+bool gamestatus_checkOccupancy(gamestatus_t* game);
+
 /**************** gamestatus_removePlayer *****************/
 /**  removes a player by their network address from the game
 *
@@ -17,6 +17,14 @@ gold_t* gold_new(int value, int x, int y, int ncols);
 void gold_view(gold_t* gold);
 int gold_collect(gold_t* gold);
 void gold_delete(gold_t* gold);
+goldPool_t* gold_poolNew(int maxPiles, int nrows, int ncols);
+size_t gold_poolSize(int maxPiles, int nrows, int ncols);
+goldPool_t* gold_poolInit(void* block, int maxPiles, int nrows, int ncols);
+int gold_poolAdd(goldPool_t* pool, int value, int x, int y);
+int gold_poolFind(goldPool_t* pool, int placement);
+bool gold_poolIsFound(goldPool_t* pool, int pile);
+int gold_poolCollect(goldPool_t* pool, int pile);
+void gold_poolDelete(goldPool_t* pool);
 
 /************ global functions *************/
 
@@ -69,4 +77,126 @@ void gold_delete(gold_t* gold) {
     if (gold != NULL) {
         free(gold);
     }
-}
\ No newline at end of file
+}
+
+/**************** gold_poolNew *****************/
+/**
+ * mallocs one block and sets the pool up in it
+ */
+goldPool_t* gold_poolNew(int maxPiles, int nrows, int ncols) {
+
+    size_t bytes = gold_poolSize(maxPiles, nrows, ncols);
+    if (bytes == 0) return NULL;
+    return gold_poolInit(malloc(bytes), maxPiles, nrows, ncols);
+}
+
+/**************** gold_poolSize *****************/
+/**
+ * the struct, then the found bitset, then the int arrays
+ */
+size_t gold_poolSize(int maxPiles, int nrows, int ncols) {
+
+    if (maxPiles < 0 || nrows <= 0 || ncols <= 0) return 0;
+
+    int foundWords = (maxPiles + 63) / 64;
+    return sizeof(goldPool_t)
+           + foundWords * sizeof(uint64_t)
+           + (2 * maxPiles + nrows * (ncols + 1)) * sizeof(int);
+}
+
+/**************** gold_poolInit *****************/
+/**
+ * lays the struct and its arrays out back to back in the block; the
+ * pileAt array is aligned with the grid's gridArray. A game already keeps
+ * the grid, its original and the occupancy map, all a char or int per
+ * cell, so one more int per cell grows memory in step with them, and
+ * buys a lookup with no hashing on every step a player takes
+ */
+goldPool_t* gold_poolInit(void* block, int maxPiles, int nrows, int ncols) {
+
+    if (block == NULL || gold_poolSize(maxPiles, nrows, ncols) == 0) return NULL;
+
+    int size = nrows * (ncols + 1);
+    int foundWords = (maxPiles + 63) / 64;
+    goldPool_t* pool = block;
+    pool->found = (uint64_t*) (pool + 1);
+    pool->placements = (int*) (pool->found + foundWords);
+    pool->values = pool->placements + maxPiles;
+    pool->pileAt = pool->values + maxPiles;
+    pool->numPiles = 0;
+    pool->numFound = 0;
+    pool->maxPiles = maxPiles;
+    pool->size = size;
+    pool->ncols = ncols;
+
+    for (int i = 0; i < foundWords; i++) {
+        pool->found[i] = 0;
+    }
+    for (int i = 0; i < size; i++) {
+        pool->pileAt[i] = -1;
+    }
+    return pool;
+}
+
+/**************** gold_poolAdd *****************/
+/**
+ * appends the pile and indexes it by position
+ */
+int gold_poolAdd(goldPool_t* pool, int value, int x, int y) {
+
+    if (pool == NULL || pool->numPiles == pool->maxPiles) return -1;
+
+    int placement = y * (pool->ncols + 1) + x;  // convert (x, y) to a single placement index
+    if (x < 0 || x >= pool->ncols || placement < 0 || placement >= pool->size) return -1;
+
+    int pile = pool->numPiles++;
+    pool->placements[pile] = placement;
+    pool->values[pile] = value;
+    pool->pileAt[placement] = pile;
+    return pile;
+}
+
+/**************** gold_poolFind *****************/
+/**
+ * returns the pile stored for the position, or -1
+ */
+int gold_poolFind(goldPool_t* pool, int placement) {
+    if (pool == NULL || placement < 0 || placement >= pool->size) {
+        return -1;
+    }
+    return pool->pileAt[placement];
+}
+
+/**************** gold_poolIsFound *****************/
+/**
+ * tests the pile's bit in the found bitset
+ */
+bool gold_poolIsFound(goldPool_t* pool, int pile) {
+    return (pool->found[pile / 64] >> (pile % 64)) & 1;
+}
+
+/**************** gold_poolCollect *****************/
+/**
+ * sets the pile's found bit and takes it out of the position index
+ */
+int gold_poolCollect(goldPool_t* pool, int pile) {
+    if (pool == NULL || pile < 0 || pile >= pool->numPiles || gold_poolIsFound(pool, pile)) {
+        return 0;
+    }
+    pool->found[pile / 64] |= (uint64_t) 1 << (pile % 64);
+    pool->numFound++;
+    if (pool->pileAt[pool->placements[pile]] == pile) {
+        pool->pileAt[pool->placements[pile]] = -1;
+    }
+    return pool->values[pile];
+}
+
+/**************** gold_poolDelete *****************/
+/**
+ * the arrays share the pool's allocation, so one free does it
+ */
+void gold_poolDelete(goldPool_t* pool) {
+    if (pool != NULL) {
+        free(pool);
+    }
+}
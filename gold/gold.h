@@ -10,6 +10,8 @@
 #define GOLD_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 
 /************ global structure **************/
@@ -21,6 +23,21 @@ typedef struct gold {
     int value;       // value of the gold pile
 } gold_t;
 
+/* all the gold piles in a game, stored as parallel arrays in one allocation
+ * so scanning them does not chase a pointer per pile; piles are numbered
+ * 0 to numPiles - 1 in the order they were added */
+typedef struct goldPool {
+    int numPiles;      // piles added so far
+    int numFound;      // piles collected so far
+    int maxPiles;      // room for this many piles
+    int* placements;   // location of each pile on the grid
+    int* values;       // value of each pile
+    uint64_t* found;   // bit i is set once pile i has been collected
+    int* pileAt;       // per gridArray cell: the uncollected pile there, or -1
+    int size;          // number of cells, nrows * (ncols + 1)
+    int ncols;         // number of columns in the grid
+} goldPool_t;
+
 /**************** gold_new *****************/
 /**
  * creates a new gold object with specified value and placement
@@ -60,4 +77,84 @@ int gold_collect(gold_t* gold);
  */
 void gold_delete(gold_t* gold);
 
-#endif 
+/**************** gold_poolNew *****************/
+/**
+ * creates an empty gold pool for a grid, with a single allocation
+ *
+ * @param maxPiles the number of piles it must have room for
+ * @param nrows the number of rows in the grid
+ * @param ncols the number of columns in the grid
+ * @return a pointer to the new goldPool_t, or NULL on failure
+ */
+goldPool_t* gold_poolNew(int maxPiles, int nrows, int ncols);
+
+/**************** gold_poolSize *****************/
+/**
+ * the bytes gold_poolNew allocates for a pool, for callers that
+ * provide the memory themselves (see gold_poolInit)
+ *
+ * @return the size, or 0 if the arguments are invalid
+ */
+size_t gold_poolSize(int maxPiles, int nrows, int ncols);
+
+/**************** gold_poolInit *****************/
+/**
+ * sets up an empty gold pool in a block of gold_poolSize bytes the caller
+ * provides, such as one from a game's arena; the pool is then freed with
+ * the block, so do not call gold_poolDelete on it
+ *
+ * @param block the memory for the pool, aligned for any type
+ * @return the pool, at the start of block, or NULL if block is NULL
+ *         or the arguments are invalid
+ */
+goldPool_t* gold_poolInit(void* block, int maxPiles, int nrows, int ncols);
+
+/**************** gold_poolAdd *****************/
+/**
+ * adds a pile with specified value at the (x, y) position
+ *
+ * @param pool the gold pool
+ * @param value the value of the gold pile
+ * @param x the x-coordinate on the grid
+ * @param y the y-coordinate on the grid
+ * @return the new pile's number, or -1 if the pool is full or (x, y) is off the grid
+ */
+int gold_poolAdd(goldPool_t* pool, int value, int x, int y);
+
+/**************** gold_poolFind *****************/
+/**
+ * finds the uncollected pile at a grid position in constant time
+ *
+ * @param pool the gold pool
+ * @param placement the grid position, an index into the grid's gridArray
+ * @return the pile's number, or -1 if no uncollected pile is there
+ */
+int gold_poolFind(goldPool_t* pool, int placement);
+
+/**************** gold_poolIsFound *****************/
+/**
+ * @param pool the gold pool
+ * @param pile the pile's number
+ * @return true if the pile has been collected
+ */
+bool gold_poolIsFound(goldPool_t* pool, int pile);
+
+/**************** gold_poolCollect *****************/
+/**
+ * marks a pile as found, so gold_poolFind no longer finds it, and returns its value
+ *
+ * @param pool the gold pool
+ * @param pile the pile's number
+ * @return the value of the gold collected, or 0 if already collected
+ */
+int gold_poolCollect(goldPool_t* pool, int pile);
+
+/**************** gold_poolDelete *****************/
+/**
+ * frees the memory allocated for the gold pool
+ *
+ * @param pool the gold pool to delete
+ */
+void gold_poolDelete(goldPool_t* pool);
+
+#endif
@@ -15,7 +15,7 @@ int main() {
         printf("FAILED: gold_new did not set value correctly\n");
         return 1;
     }
-    if (gold->placement != 32) { // placement = y * ncols + x = 3 * 10 + 2 = 32
+    if (gold->placement != 35) { // placement = y * (ncols + 1) + x = 3 * 11 + 2 = 35
         printf("FAILED: gold_new did not calculate placement correctly\n");
         return 1;
     }
@@ -59,6 +59,72 @@ int main() {
     gold_delete(gold);
     printf("PASSED: gold_delete test\n");
 
+    // test the gold pool on a 4x10 grid
+    goldPool_t* pool = gold_poolNew(3, 4, 10);
+    if (pool == NULL) {
+        printf("FAILED: gold_poolNew returned NULL\n");
+        return 1;
+    }
+    if (gold_poolAdd(pool, 10, 2, 3) != 0 || gold_poolAdd(pool, 20, 9, 0) != 1) {
+        printf("FAILED: gold_poolAdd did not number the piles in order\n");
+        return 1;
+    }
+    if (gold_poolAdd(pool, 5, 10, 0) != -1 || gold_poolAdd(pool, 5, 0, 4) != -1) {
+        printf("FAILED: gold_poolAdd added a pile off the grid\n");
+        return 1;
+    }
+    if (gold_poolAdd(pool, 30, 0, 1) != 2 || gold_poolAdd(pool, 40, 1, 1) != -1) {
+        printf("FAILED: gold_poolAdd did not stop when the pool was full\n");
+        return 1;
+    }
+    if (pool->placements[0] != 35 || pool->values[1] != 20 || pool->numPiles != 3) {
+        printf("FAILED: gold_poolAdd did not store placement and value correctly\n");
+        return 1;
+    }
+    printf("PASSED: gold_poolAdd test\n");
+
+    if (gold_poolFind(pool, 35) != 0 || gold_poolFind(pool, 9) != 1 || gold_poolFind(pool, 11) != 2) {
+        printf("FAILED: gold_poolFind did not find the piles\n");
+        return 1;
+    }
+    if (gold_poolFind(pool, 0) != -1 || gold_poolFind(pool, -1) != -1 || gold_poolFind(pool, 44) != -1) {
+        printf("FAILED: gold_poolFind found a pile where there is none\n");
+        return 1;
+    }
+    printf("PASSED: gold_poolFind test\n");
+
+    if (gold_poolCollect(pool, 0) != 10 || !gold_poolIsFound(pool, 0) || gold_poolIsFound(pool, 1)) {
+        printf("FAILED: gold_poolCollect did not collect the pile\n");
+        return 1;
+    }
+    if (gold_poolCollect(pool, 0) != 0) {
+        printf("FAILED: gold_poolCollect did not return 0 for already collected gold\n");
+        return 1;
+    }
+    if (gold_poolFind(pool, 35) != -1 || gold_poolFind(pool, 9) != 1) {
+        printf("FAILED: gold_poolCollect did not remove just that pile from the index\n");
+        return 1;
+    }
+    printf("PASSED: gold_poolCollect test\n");
+
+    gold_poolDelete(pool);
+    printf("PASSED: gold_poolDelete test\n");
+
+    // test a pool set up in memory the caller provides
+    void* block = malloc(gold_poolSize(2, 4, 10));
+    pool = gold_poolInit(block, 2, 4, 10);
+    if (pool != block || gold_poolInit(NULL, 2, 4, 10) != NULL || gold_poolSize(-1, 4, 10) != 0) {
+        printf("FAILED: gold_poolInit did not set up the pool in the block\n");
+        return 1;
+    }
+    if (gold_poolAdd(pool, 7, 3, 2) != 0 || gold_poolFind(pool, 25) != 0
+        || gold_poolFind(pool, 24) != -1 || gold_poolCollect(pool, 0) != 7) {
+        printf("FAILED: gold_poolInit pool did not hold its piles\n");
+        return 1;
+    }
+    free(block);
+    printf("PASSED: gold_poolInit test\n");
+
     printf("All tests PASSED for gold module!\n");
     return 0;
 }
\ No newline at end of file
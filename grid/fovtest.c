@@ -0,0 +1,93 @@
+/*
+ * fovtest.c - equivalence test for the shadowcasting engine
+ *
+ * For every map given on the command line, and for every cell of that
+ * map as origin, check that shadowcast_fov lights exactly the cells for
+ * which line_of_sight returns true. Each map is checked as loaded and
+ * again with players and gold scattered over its floor and passages.
+ *
+ * usage: ./fovtest map.txt...
+ * exits 0 if every map matches, 1 otherwise
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "shadowcast.h"
+#include "../support/log.h"
+
+static int compareAll(grid_t* grid);
+
+int main(const int argc, char* argv[])
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s map.txt...\n", argv[0]);
+        return 1;
+    }
+    srand(50);
+
+    int failures = 0;
+    for (int i = 1; i < argc; i++) {
+        grid_t* grid = grid_load(argv[i]);
+        if (grid == NULL) {
+            printf("FAILED: could not load %s\n", argv[i]);
+            failures++;
+            continue;
+        }
+        int mismatches = compareAll(grid);
+
+        // scatter players and gold, which let light through
+        for (int r = 0; r < grid->nrow; r++) {
+            for (int c = 0; c < grid->ncol; c++) {
+                char* cell = &grid->gridArray[r * (grid->ncol + 1) + c];
+                if ((*cell == '.' || *cell == '#') && rand() % 8 == 0) {
+                    *cell = (rand() % 2 == 0) ? '*' : 'A' + rand() % 26;
+                }
+            }
+        }
+        mismatches += compareAll(grid);
+
+        printf("%s %s: %d mismatches\n", mismatches == 0 ? "PASSED" : "FAILED",
+               argv[i], mismatches);
+        if (mismatches != 0) {
+            failures++;
+        }
+        grid_delete(grid);
+    }
+    return failures == 0 ? 0 : 1;
+}
+
+/*
+ * compare shadowcasting with line_of_sight from every cell to every cell
+ */
+static int compareAll(grid_t* grid)
+{
+    int ncells = grid->nrow * grid->ncol;
+    uint64_t* visible = malloc(((ncells + 63) / 64) * sizeof(uint64_t));
+    if (visible == NULL) {
+        return 1;
+    }
+    int mismatches = 0;
+    for (int origin = 0; origin < ncells; origin++) {
+        int r0 = origin / grid->ncol;
+        int c0 = origin % grid->ncol;
+        shadowcast_fov(grid, r0, c0, visible);
+        for (int i = 0; i < ncells; i++) {
+            bool lit = (visible[i / 64] >> (i % 64)) & 1;
+            if (lit != line_of_sight(grid, r0, c0, i / grid->ncol, i % grid->ncol)) {
+                if (mismatches < 10) {
+                    printf("  from (%d,%d) to (%d,%d): shadowcast says %d\n",
+                           r0, c0, i / grid->ncol, i % grid->ncol, lit);
+                }
+                mismatches++;
+            }
+        }
+    }
+    free(visible);
+    return mismatches;
+}
@@ -7,16 +7,25 @@
 
 
 
+#define _POSIX_C_SOURCE 200809L     // for mmap
+#define _DEFAULT_SOURCE             // for MAP_ANONYMOUS
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdbool.h>
 #include <ctype.h>
-#include <math.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../support/file.h"
 #include "../support/log.h"
 #include "../support/message.h"
 #include "grid.h"
+#include "viscache.h"
+#include "shadowcast.h"
+#include "mapfile.h"
 
 /*
  * CELL macros accesses cell position
@@ -29,6 +38,66 @@
  */
 #define CELL(grid,r,c) ((grid)->gridArray[(r)*((grid)->ncol + 1) + (c)])
 
+/*
+ * grid_transparent table says which cell characters let light through:
+ * floor, gold, and players (uppercase letters); see grid.h
+ */
+const bool grid_transparent[256] = {
+    ['.'] = true, ['*'] = true,
+    ['A'] = true, ['B'] = true, ['C'] = true, ['D'] = true, ['E'] = true,
+    ['F'] = true, ['G'] = true, ['H'] = true, ['I'] = true, ['J'] = true,
+    ['K'] = true, ['L'] = true, ['M'] = true, ['N'] = true, ['O'] = true,
+    ['P'] = true, ['Q'] = true, ['R'] = true, ['S'] = true, ['T'] = true,
+    ['U'] = true, ['V'] = true, ['W'] = true, ['X'] = true, ['Y'] = true,
+    ['Z'] = true,
+};
+
+/*
+ * seeThrough - true if light passes the cell at (r, c); cells off
+ * the grid never block, which only matters when checked is true
+ */
+static inline bool
+seeThrough(grid_t* grid, int r, int c, bool checked)
+{
+    if (checked && !is_within_bounds(grid, r, c)) {
+        return true;
+    }
+    return grid_transparent[(unsigned char)CELL(grid, r, c)];
+}
+
+/************ file-local constants *************/
+static const uint8_t ChunkOpen = 0x1;    // the chunk holds something other than solid rock
+static const uint8_t ChunkDirty = 0x2;   // a cell of the chunk changed since grid_clearDirty
+static const int FloorTries = 64;        // random picks grid_randomFloor makes before scanning
+
+/************ file-local global variables *************/
+/* engine used by grid_fieldOfView; chosen once at server start */
+static gridVisEngine_t visEngine = GRID_VIS_RAYS;
+/* this thread's rand_r state, for grid_randomFloor and grid_random */
+static _Thread_local unsigned int randomState = 1;
+
+/************ local functions *************/
+static bool applyCell(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+                      int r, int c, const uint64_t* visible);
+static void fillVisible(grid_t* mainGrid, grid_t* originalGrid, int r, int c, uint64_t* visible);
+static void hideAll(grid_t* grid);
+static char* mapBytes(const char* mapFile, size_t* length);
+static char* privateCopy(char* bytes, size_t length);
+static grid_t* loadReadOnly(const char* mapFile, char* bytes, size_t length);
+static bool checkLayout(const char* bytes, size_t length, int* rows, int* cols);
+static grid_t* newGrid(int rows, int cols);
+static grid_t* loadCompiled(const char* mapFile, char* bytes, size_t length, bool inPlace);
+static const int32_t* section(grid_t* grid, uint64_t at);
+static void refreshVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+                       int player_r, int player_c, uint64_t* visible, bool sinceLast);
+static bool* newTouched(grid_t* grid);
+static void touchChunks(grid_t* grid, const uint64_t* bits, bool* touched);
+static void applyChunks(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+                        const uint64_t* visible, const uint64_t* seen, const bool* touched);
+static void applyRange(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+                       const uint64_t* visible, const uint64_t* seen,
+                       int r0, int r1, int c0, int c1);
+
 /************ global functions *************/
 
 /**************** grid_load *****************/
@@ -36,65 +105,211 @@
 grid_t*
 grid_load(const char* mapFile) 
 {
-    FILE* file = fopen(mapFile, "r");
-    if (file == NULL) {
-        log_e("Error: Could not open map file");
+    size_t length = 0;
+    char* bytes = mapBytes(mapFile, &length);
+    if (bytes == NULL) {
+        return NULL;
+    }
+    if (mapfile_isCompiled(bytes, length)) {
+        // the rest of the map stays with the grid, so it must not be the file
+        bytes = privateCopy(bytes, length);
+        return bytes == NULL ? NULL : loadCompiled(mapFile, bytes, length, false);
+    }
+    int rows = 0, cols = 0;
+    if (!checkLayout(bytes, length, &rows, &cols)) {
+        munmap(bytes, length);
+        return NULL;
+    }
+    grid_t* grid = newGrid(rows, cols);
+    if (grid == NULL) {
+        munmap(bytes, length);
+        return NULL;
+    }
+    grid->gridArray = malloc(rows * (cols + 1) * sizeof(char));
+    if (grid->gridArray == NULL) {
+        log_e("Error: Could not allocate grid array");
+        free(grid);
+        munmap(bytes, length);
         return NULL;
     }
+    // the file already has the layout CELL expects, bar perhaps the last '\n'
+    memcpy(grid->gridArray, bytes, length);
+    grid->gridArray[rows * (cols + 1) - 1] = '\n';
+    munmap(bytes, length);
+    log_s("Grid loaded from file: %s", mapFile);
+    return grid;
+}
 
-    // get number of rows and check it isn't empty
-    int rows = file_numLines(file);
-    if (rows <= 0) {
-        log_e("Error: Map file is empty or unreadable");
-        fclose(file);
+/**************** grid_loadMapped *****************/
+/* see grid.h for more detailed description */
+grid_t*
+grid_loadMapped(const char* mapFile)
+{
+    size_t length = 0;
+    char* bytes = mapBytes(mapFile, &length);
+    if (bytes == NULL) {
         return NULL;
     }
+    return loadReadOnly(mapFile, bytes, length);
+}
 
-    // determine columns by reading first line and check it worked
-    char* firstLine = file_readLine(file);
-    if (firstLine == NULL) {
-        log_e("Error: Could not read the first line of map file");
-        fclose(file);
+/**************** grid_loadCopied *****************/
+/* see grid.h for more detailed description */
+grid_t*
+grid_loadCopied(const char* mapFile)
+{
+    size_t length = 0;
+    char* bytes = mapBytes(mapFile, &length);
+    if (bytes == NULL || (bytes = privateCopy(bytes, length)) == NULL) {
         return NULL;
     }
-    int cols = strlen(firstLine);
-    free(firstLine);
+    return loadReadOnly(mapFile, bytes, length);
+}
 
-    // create grid structure
-    grid_t* grid = malloc(sizeof(grid_t));
+/**************** loadReadOnly *****************/
+/*
+ * The rest of grid_loadMapped and grid_loadCopied, given the file's
+ * bytes: a grid that uses them in place, read-only
+ */
+static grid_t*
+loadReadOnly(const char* mapFile, char* bytes, size_t length)
+{
+    if (mapfile_isCompiled(bytes, length)) {
+        return loadCompiled(mapFile, bytes, length, true);
+    }
+    int rows = 0, cols = 0;
+    if (!checkLayout(bytes, length, &rows, &cols)) {
+        munmap(bytes, length);
+        return NULL;
+    }
+    if (length != (size_t)rows * (cols + 1)) {
+        // no '\n' after the last row, so the bytes cannot be used as they are
+        munmap(bytes, length);
+        return grid_load(mapFile);
+    }
+    grid_t* grid = newGrid(rows, cols);
     if (grid == NULL) {
-        log_e("Error: Could not allocate grid structure");
-        fclose(file);
+        munmap(bytes, length);
         return NULL;
     }
-    // add data
-    grid->nrow = rows;
-    grid->ncol = cols;
-    grid->gridArray = malloc(rows * (cols + 1) * sizeof(char));
+    grid->gridArray = bytes;
+    grid->mapping = bytes;
+    grid->mapped = length;
+    grid->readOnly = true;
+    log_s("Grid loaded read-only from file: %s", mapFile);
+    return grid;
+}
+
+/**************** grid_copy *****************/
+/* see grid.h for more detailed description */
+grid_t*
+grid_copy(grid_t* original)
+{
+    if (original == NULL) {
+        log_e("Error: provided grid is NULL");
+        return NULL;
+    }
+    grid_t* grid = newGrid(original->nrow, original->ncol);
+    if (grid == NULL) {
+        return NULL;
+    }
+    size_t size = (size_t)original->nrow * (original->ncol + 1);
+    grid->gridArray = malloc(size);
     if (grid->gridArray == NULL) {
         log_e("Error: Could not allocate grid array");
         free(grid);
-        fclose(file);
         return NULL;
     }
+    memcpy(grid->gridArray, original->gridArray, size);
+    // borrowed, not owned: grid_delete only unmaps a grid's own mapping
+    grid->compiled = original->compiled;
+    return grid;
+}
 
-    // load grid layout into 1D array
-    rewind(file); // reset file pointer
-    for (int r = 0; r < rows; r++) {
-        char* line = file_readLine(file);
-        if (line == NULL || strlen(line) != cols) {
-            log_d("Error reading line %d or inconsistent column count", r);
-            free(line);
-            break;
+/**************** grid_randomFloor *****************/
+/* see grid.h for more detailed description */
+int
+grid_randomFloor(grid_t* grid)
+{
+    if (grid == NULL) {
+        return -1;
+    }
+    if (grid->compiled != NULL) {
+        int numFloor = grid->compiled->numFloor;
+        const int32_t* floor = section(grid, grid->compiled->floorAt);
+        for (int i = 0; i < FloorTries && numFloor > 0; i++) {
+            int position = floor[rand_r(&randomState) % numFloor];
+            if (grid->gridArray[position] == '.') {
+                return position;
+            }
         }
-        for (int c = 0; c < cols; c++) {
-            CELL(grid, r, c) = line[c];
+        // nearly all taken: walk the list from a random place instead
+        int start = numFloor > 0 ? rand_r(&randomState) % numFloor : 0;
+        for (int i = 0; i < numFloor; i++) {
+            int position = floor[(start + i) % numFloor];
+            if (grid->gridArray[position] == '.') {
+                return position;
+            }
         }
-        free(line);
+        return -1;
     }
-    fclose(file);
-    log_s("Grid loaded from file: %s", mapFile);
-    return grid;
+
+    // a text map has no floor list, so pick from every cell
+    for (int i = 0; i < FloorTries; i++) {
+        int r = rand_r(&randomState) % grid->nrow;
+        int c = rand_r(&randomState) % grid->ncol;
+        if (CELL(grid, r, c) == '.') {
+            return r * (grid->ncol + 1) + c;
+        }
+    }
+    int cells = grid->nrow * grid->ncol;
+    int start = rand_r(&randomState) % cells;
+    for (int i = 0; i < cells; i++) {
+        int r = (start + i) % cells / grid->ncol;
+        int c = (start + i) % cells % grid->ncol;
+        if (CELL(grid, r, c) == '.') {
+            return r * (grid->ncol + 1) + c;
+        }
+    }
+    return -1;
+}
+
+/**************** grid_seedRandom *****************/
+/* see grid.h for more detailed description */
+void
+grid_seedRandom(unsigned int seed)
+{
+    randomState = seed;
+}
+
+/**************** grid_random *****************/
+/* see grid.h for more detailed description */
+int
+grid_random(void)
+{
+    return rand_r(&randomState);
+}
+
+/**************** grid_roomOf *****************/
+/* see grid.h for more detailed description */
+int
+grid_roomOf(grid_t* grid, int r, int c)
+{
+    if (grid == NULL || grid->compiled == NULL || !is_within_bounds(grid, r, c)) {
+        return -1;
+    }
+    return section(grid, grid->compiled->roomsAt)[r * grid->ncol + c];
+}
+
+/**************** grid_componentOf *****************/
+/* see grid.h for more detailed description */
+int
+grid_componentOf(grid_t* grid, int r, int c)
+{
+    if (grid == NULL || grid->compiled == NULL || !is_within_bounds(grid, r, c)) {
+        return -1;
+    }
+    return section(grid, grid->compiled->componentsAt)[r * grid->ncol + c];
 }
 
 /**************** grid_playerLoad ****************/
@@ -114,6 +329,14 @@ grid_playerLoad(grid_t* mainGrid) {
     // initialize dimensions
     player_grid->nrow = mainGrid->nrow;
     player_grid->ncol = mainGrid->ncol;
+    player_grid->vis = NULL;
+    player_grid->chunks = NULL;
+    player_grid->chunkCols = 0;
+    player_grid->anyDirty = false;
+    player_grid->mapping = NULL;
+    player_grid->mapped = 0;
+    player_grid->readOnly = false;
+    player_grid->compiled = NULL;
 
     // allocate memory for gridArray
     player_grid->gridArray = malloc((player_grid->ncol + 1) * player_grid->nrow * sizeof(char));
@@ -122,15 +345,52 @@ grid_playerLoad(grid_t* mainGrid) {
         free(player_grid);
         return NULL;
     } 
-    // initialize all cells to hidden
-    for (int r = 0; r < player_grid->nrow; r++) {
-        for (int c = 0; c < player_grid->ncol; c++) {
-            CELL(player_grid, r, c) = ' ';
-        }
+    hideAll(player_grid);
+    return player_grid;
+}
+
+/**************** grid_playerLoadArena ****************/
+/* see grid.h for more detailed description */
+grid_t*
+grid_playerLoadArena(grid_t* mainGrid, arena_t* arena) {
+    if (mainGrid == NULL || arena == NULL) {
+        log_e("Error: provided mainGrid or arena is NULL");
+        return NULL;
     }
+    grid_t* player_grid = arena_alloc(arena, sizeof(grid_t));
+    char* gridArray = arena_alloc(arena, (mainGrid->ncol + 1) * mainGrid->nrow * sizeof(char));
+    if (player_grid == NULL || gridArray == NULL) {
+        log_e("Error: could not allocate memory for grid");
+        arena_recycle(arena, player_grid, sizeof(grid_t));
+        arena_recycle(arena, gridArray, (mainGrid->ncol + 1) * mainGrid->nrow * sizeof(char));
+        return NULL;
+    }
+    player_grid->nrow = mainGrid->nrow;
+    player_grid->ncol = mainGrid->ncol;
+    player_grid->vis = NULL;
+    player_grid->chunks = NULL;
+    player_grid->chunkCols = 0;
+    player_grid->anyDirty = false;
+    player_grid->mapping = NULL;
+    player_grid->mapped = 0;
+    player_grid->readOnly = false;
+    player_grid->compiled = NULL;
+    player_grid->gridArray = gridArray;
+    hideAll(player_grid);
     return player_grid;
 }
 
+/**************** grid_recycle ****************/
+/* see grid.h for more detailed description */
+void
+grid_recycle(grid_t* grid, arena_t* arena)
+{
+    if (grid != NULL) {
+        arena_recycle(arena, grid->gridArray, (grid->ncol + 1) * grid->nrow * sizeof(char));
+        arena_recycle(arena, grid, sizeof(grid_t));
+    }
+}
+
 void
 grid_addGoldPile(grid_t* grid, int r, int c)
 {
@@ -151,13 +411,102 @@ grid_removeGoldPile(grid_t* grid, int r, int c)
     CELL(grid, r, c) = ' ';
 }
 
+/**************** grid_loadVisibility ****************/
+/* see grid.h for more detailed description */
+bool
+grid_loadVisibility(grid_t* grid, size_t budget)
+{
+    if (grid == NULL) {
+        log_e("Error: grid is NULL");
+        return false;
+    }
+    viscache_delete(grid->vis);
+    grid->vis = NULL;
+    if (grid->compiled != NULL && grid->compiled->visWords > 0) {
+        grid->vis = viscache_adopt(grid, (const uint64_t*)section(grid, grid->compiled->visAt),
+                                   grid->compiled->numOrigins);
+    }
+    if (grid->vis == NULL) {
+        grid->vis = viscache_new(grid, budget);
+    }
+    return grid->vis != NULL;
+}
+
+/**************** grid_loadChunks ****************/
+/* see grid.h for more detailed description */
+bool
+grid_loadChunks(grid_t* grid)
+{
+    if (grid == NULL) {
+        log_e("Error: grid is NULL");
+        return false;
+    }
+    int chunkRows = (grid->nrow + grid_ChunkSize - 1) / grid_ChunkSize;
+    int chunkCols = (grid->ncol + grid_ChunkSize - 1) / grid_ChunkSize;
+    uint8_t* chunks = calloc(chunkRows * chunkCols > 0 ? chunkRows * chunkCols : 1, sizeof(uint8_t));
+    if (chunks == NULL) {
+        log_e("Error: could not allocate chunk index");
+        return false;
+    }
+    for (int r = 0; r < grid->nrow; r++) {
+        for (int c = 0; c < grid->ncol; c++) {
+            if (CELL(grid, r, c) != ' ') {
+                chunks[(r / grid_ChunkSize) * chunkCols + c / grid_ChunkSize] |= ChunkOpen;
+            }
+        }
+    }
+    free(grid->chunks);
+    grid->chunks = chunks;
+    grid->chunkCols = chunkCols;
+    grid->anyDirty = false;
+    return true;
+}
+
+/**************** grid_markDirty ****************/
+/* see grid.h for more detailed description */
+void
+grid_markDirty(grid_t* grid, int position)
+{
+    if (grid == NULL || grid->chunks == NULL) {
+        return;
+    }
+    int r = position / (grid->ncol + 1);
+    int c = position % (grid->ncol + 1);
+    if (is_within_bounds(grid, r, c)) {
+        grid->chunks[(r / grid_ChunkSize) * grid->chunkCols + c / grid_ChunkSize] |= ChunkDirty;
+        grid->anyDirty = true;
+    }
+}
+
+/**************** grid_clearDirty ****************/
+/* see grid.h for more detailed description */
+void
+grid_clearDirty(grid_t* grid)
+{
+    if (grid == NULL || grid->chunks == NULL || !grid->anyDirty) {
+        return;
+    }
+    int numChunks = ((grid->nrow + grid_ChunkSize - 1) / grid_ChunkSize) * grid->chunkCols;
+    for (int i = 0; i < numChunks; i++) {
+        grid->chunks[i] &= ~ChunkDirty;
+    }
+    grid->anyDirty = false;
+}
+
 /**************** grid_delete ****************/
 /* see grid.h for more detailed description */
 void
 grid_delete(grid_t* grid)
 {
     if (grid != NULL) {
-        free(grid->gridArray);
+        viscache_delete(grid->vis);
+        free(grid->chunks);
+        if (!grid->readOnly) {
+            free(grid->gridArray);
+        }
+        if (grid->mapping != NULL) {
+            munmap(grid->mapping, grid->mapped);
+        }
         free(grid);
         log_v("Grid memory freed.");
     }
@@ -249,20 +598,126 @@ is_within_bounds(grid_t* grid, int row, int col)
 void
 grid_calculateVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, int player_r, int player_c)
 {
-    for (int r = 0; r < mainGrid->nrow; r++) {
-        for (int c = 0; c < mainGrid->ncol; c++) {
-            // check line of sight
-            if (line_of_sight(mainGrid, player_r, player_c, r, c)) {
-                // update playerGrid
-                CELL(playerGrid, r, c) = CELL(mainGrid, r, c);
-            }
-            // if not in current LOS but gold is here we have to hide from player  
-            else if (CELL(mainGrid, r, c) == '*' && CELL(playerGrid, r, c) != ' ') {
-                CELL(playerGrid, r, c) = '.';
+    // walls never move, so the original grid may already know the answer
+    const uint64_t* visible = NULL;
+    if (originalGrid != NULL) {
+        visible = viscache_get(originalGrid->vis, player_r, player_c);
+    }
+    if (visible != NULL) {
+        // no earlier set to go by, so every chunk that is not solid rock
+        applyChunks(mainGrid, playerGrid, originalGrid, visible, NULL, NULL);
+        return;
+    }
+
+    uint64_t* swept = malloc(((mainGrid->nrow * mainGrid->ncol + 63) / 64) * sizeof(uint64_t));
+    if (swept == NULL) {
+        log_e("Error: could not allocate visibility bitset");
+        return;
+    }
+    refreshVis(mainGrid, playerGrid, originalGrid, player_r, player_c, swept, false);
+    free(swept);
+}
+
+/************** grid_updateVis ***************/
+/* see grid.h for more detailed description */
+void
+grid_updateVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, int player_r, int player_c, uint64_t* visible)
+{
+    if (mainGrid == NULL || playerGrid == NULL || visible == NULL) {
+        log_e("Error: grid or bitset is NULL");
+        return;
+    }
+    refreshVis(mainGrid, playerGrid, originalGrid, player_r, player_c, visible, true);
+}
+
+/************** grid_sprintVis ***************/
+/* see grid.h for more detailed description */
+void
+grid_sprintVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, const int* path, int pathLength, int player_r, int player_c, uint64_t* visible)
+{
+    if (mainGrid == NULL || playerGrid == NULL || visible == NULL || (path == NULL && pathLength > 0)) {
+        log_e("Error: grid, path or bitset is NULL");
+        return;
+    }
+    int words = (mainGrid->nrow * mainGrid->ncol + 63) / 64;
+    uint64_t* seen = calloc(words, sizeof(uint64_t));
+    uint64_t* step = malloc(words * sizeof(uint64_t));
+    if (seen == NULL || step == NULL) {
+        // still correct, just without the glimpses
+        free(seen);
+        free(step);
+        grid_updateVis(mainGrid, playerGrid, originalGrid, player_r, player_c, visible);
+        return;
+    }
+    for (int i = 0; i < pathLength; i++) {
+        int r = path[i] / (mainGrid->ncol + 1);
+        int c = path[i] % (mainGrid->ncol + 1);
+        if (is_within_bounds(mainGrid, r, c)) {
+            fillVisible(mainGrid, originalGrid, r, c, step);
+            for (int w = 0; w < words; w++) {
+                seen[w] |= step[w];
             }
-            // if not in current LOS but other player is here we have to hide from player
-            else if (isupper(CELL(mainGrid, r, c)) && CELL(playerGrid, r, c) != ' ') {
-                CELL(playerGrid, r, c) = CELL(originalGrid, r, c);
+        }
+    }
+    bool* touched = newTouched(mainGrid);
+    touchChunks(mainGrid, visible, touched);      // still the old set
+    fillVisible(mainGrid, originalGrid, player_r, player_c, visible);
+    touchChunks(mainGrid, visible, touched);
+    touchChunks(mainGrid, seen, touched);
+
+    applyChunks(mainGrid, playerGrid, originalGrid, visible, seen, touched);
+    free(touched);
+    free(seen);
+    free(step);
+}
+
+/************** grid_patchVis ***************/
+/* see grid.h for more detailed description */
+int
+grid_patchVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, const uint64_t* visible, const int* positions, int numPositions)
+{
+    if (mainGrid == NULL || playerGrid == NULL || visible == NULL || positions == NULL) {
+        return 0;
+    }
+    int changed = 0;
+    for (int i = 0; i < numPositions; i++) {
+        int r = positions[i] / (mainGrid->ncol + 1);
+        int c = positions[i] % (mainGrid->ncol + 1);
+        if (is_within_bounds(mainGrid, r, c)
+            && applyCell(mainGrid, playerGrid, originalGrid, r, c, visible)) {
+            changed++;
+        }
+    }
+    return changed;
+}
+
+/************** grid_setVisEngine ***************/
+/* see grid.h for more detailed description */
+void
+grid_setVisEngine(gridVisEngine_t engine)
+{
+    visEngine = engine;
+}
+
+/************** grid_fieldOfView ***************/
+/* see grid.h for more detailed description */
+void
+grid_fieldOfView(grid_t* grid, int r, int c, uint64_t* visible)
+{
+    if (grid == NULL || visible == NULL) {
+        log_e("Error: grid or bitset is NULL");
+        return;
+    }
+    if (visEngine == GRID_VIS_SHADOW) {
+        shadowcast_fov(grid, r, c, visible);
+        return;
+    }
+    memset(visible, 0, ((grid->nrow * grid->ncol + 63) / 64) * sizeof(uint64_t));
+    for (int tr = 0; tr < grid->nrow; tr++) {
+        for (int tc = 0; tc < grid->ncol; tc++) {
+            if (line_of_sight(grid, r, c, tr, tc)) {
+                int i = tr * grid->ncol + tc;
+                visible[i / 64] |= (uint64_t)1 << (i % 64);
             }
         }
     }
@@ -281,119 +736,50 @@ line_of_sight(grid_t* mainGrid, int startRow, int startCol, int endRow, int endC
     int stepx = (startCol < endCol) ? 1 : -1;
     int stepy = (startRow < endRow) ? 1 : -1;
 
-    // initialize current positions
-    int x = startCol;
-    int y = startRow;
+    // rays between two cells on the grid never leave it, so only
+    // check bounds on every probe when an endpoint is outside
+    bool checked = !is_within_bounds(mainGrid, startRow, startCol)
+                || !is_within_bounds(mainGrid, endRow, endCol);
 
-    // handle same position
-    if (dx == 0 && dy == 0) {
-        return true;
-    }
-
-    // handle horizontal line
-    if (dy == 0) {
-        int x = startCol;
-        while ((x + stepx) != endCol) {
-            x += stepx;
-            if (is_within_bounds(mainGrid, y, x)) {
-                char cell = CELL(mainGrid, y, x);
-                // only pass through gold, floor, or player
-                if (!(cell == '.' || cell == '*' || isupper(cell))) {
-                    return false;
-                }
-            } 
-        }
-        return true;
-    }
-
-    // handle vertical line
-    if (dx == 0) {
-        int y = startRow;
-        while ((y + stepy) != endRow) {
-            y += stepy;
-            if (is_within_bounds(mainGrid, y, x)) {
-                char cell = CELL(mainGrid, y, x);
-                // only pass through gold, floor, or player
-                if (!(cell == '.' || cell == '*' || isupper(cell))) {
-                    return false;
-                }
-            }  
-        }
-        return true;
-    }
-
-    // continue until reaching the end position
-    while ((x + stepx) != endCol || (y + stepy) != endRow) {
-        // check row intersections
-        if (y + stepy != endRow) {
-            // increment
-            y += stepy;
-
-            // intersect calculation with slope
-            double intersection_x;
-            if (stepx == 1) {
-                intersection_x = startCol + (double)abs(y - startRow) * dx / dy;
+    // check each row strictly between start and end; the line crosses
+    // row startRow + k*stepy at column startCol + stepx * (k*dx/dy),
+    // which we track as whole part q and remainder rem of k*dx/dy
+    if (dy > 0) {
+        int qStep = dx / dy, remStep = dx % dy;
+        int q = 0, rem = 0;
+        for (int k = 1; k < dy; k++) {
+            q += qStep;
+            rem += remStep;
+            if (rem >= dy) {
+                rem -= dy;
+                q++;
             }
-            else {
-                intersection_x = startCol + (double)abs(y - startRow) * -dx / dy;
-            }
-
-            // look to left and right of intersection
-            int left_col = (int)floor(intersection_x);
-            int right_col = (int)ceil(intersection_x);
-
-            // direct grid hit
-            if (left_col == right_col && is_within_bounds(mainGrid, y, left_col)) {
-                char cell = CELL(mainGrid, y, left_col);
-                // only pass through floor, gold, or corner
-                if (!(cell == '.' || cell == '*' || isupper(cell))) {
-                    return false;
-                }
-            } 
-            else if (is_within_bounds(mainGrid, y, left_col) && is_within_bounds(mainGrid, y, right_col)) {
-                char left_cell = CELL(mainGrid, y, left_col);
-                char right_cell = CELL(mainGrid, y, right_col);
-                // only pass if there is a floor or gold on either side
-                if (!(left_cell == '.' || right_cell == '.' || left_cell == '*' || right_cell == '*' 
-                        || isupper(left_cell) || isupper(right_cell))) {
-                    return false;
-                }
+            int y = startRow + k * stepy;
+            int x = startCol + q * stepx;
+            // direct grid hit must see through; otherwise either side may
+            if (!seeThrough(mainGrid, y, x, checked)
+                    && (rem == 0 || !seeThrough(mainGrid, y, x + stepx, checked))) {
+                return false;
             }
         }
-        // Check column intersections
-        if (x + stepx != endCol) {
-            // increment
-            x += stepx;
-
-            // calculate intersection with slope
-            double intersection_y;
-            if (stepy == 1) {
-                intersection_y = startRow + (double)abs(x - startCol) * dy / dx;
-            }
-            else {
-                intersection_y = startRow + (double)abs(x - startCol) * -dy / dx;
+    }
+
+    // same for each column strictly between start and end
+    if (dx > 0) {
+        int qStep = dy / dx, remStep = dy % dx;
+        int q = 0, rem = 0;
+        for (int k = 1; k < dx; k++) {
+            q += qStep;
+            rem += remStep;
+            if (rem >= dx) {
+                rem -= dx;
+                q++;
             }
-            
-            // look to top and bottom of intersect
-            int top_row = (int)floor(intersection_y);
-            int bottom_row = (int)ceil(intersection_y);
-
-            // direct hit
-            if (top_row == bottom_row && is_within_bounds(mainGrid, top_row, x)) {
-                char cell = CELL(mainGrid, top_row, x);
-                // only pass through floor, gold, or corner
-                if (!(cell == '.' || cell == '*' || isupper(cell))) {
-                    return false;
-                }
-            } 
-            else if (is_within_bounds(mainGrid, top_row, x) && is_within_bounds(mainGrid, bottom_row, x)) {
-                char top_cell = CELL(mainGrid, top_row, x);
-                char bottom_cell = CELL(mainGrid, bottom_row, x);
-                // only pass if floor or gold is on either side
-                if (!(top_cell == '.' || bottom_cell == '.' || top_cell == '*' || bottom_cell == '*'
-                        || isupper(top_cell) || isupper(bottom_cell))) {
-                    return false;
-                }
+            int x = startCol + k * stepx;
+            int y = startRow + q * stepy;
+            if (!seeThrough(mainGrid, y, x, checked)
+                    && (rem == 0 || !seeThrough(mainGrid, y + stepy, x, checked))) {
+                return false;
             }
         }
     }
@@ -418,29 +804,397 @@ grid_print(grid_t* grid)
     }
 }
 
-void grid_toString(grid_t* grid, char* message) {
+/************** grid_toString ***************/
+/* see grid.h for more detailed description */
+void
+grid_toString(grid_t* grid, char* message)
+{
     if (grid == NULL || message == NULL) {
         log_e("Error: grid or message is NULL");
         return;
     }
+    grid_serialize(grid, message, grid_displaySize(grid));
+}
 
-    int maxSize = 10000;
+/************** grid_displaySize ***************/
+/* see grid.h for more detailed description */
+size_t
+grid_displaySize(grid_t* grid)
+{
+    if (grid == NULL) {
+        return 0;
+    }
+    return strlen("DISPLAY\n") + (size_t)grid->nrow * (grid->ncol + 1) + 1;
+}
+
+/************** grid_serialize ***************/
+/* see grid.h for more detailed description */
+size_t
+grid_serialize(grid_t* grid, char* buffer, size_t size)
+{
+    if (grid == NULL || buffer == NULL) {
+        log_e("Error: grid or buffer is NULL");
+        return 0;
+    }
+    if (size < grid_displaySize(grid)) {
+        log_e("Error: buffer too small for DISPLAY message");
+        return 0;
+    }
 
     // Start with the intro
-    snprintf(message, maxSize, "DISPLAY\n");
-    int len = strlen(message);
+    size_t len = strlen("DISPLAY\n");
+    memcpy(buffer, "DISPLAY\n", len);
+
+    // Append rows of the grid, each followed by a newline
+    for (int r = 0; r < grid->nrow; r++) {
+        memcpy(buffer + len, &CELL(grid, r, 0), grid->ncol);
+        len += grid->ncol;
+        buffer[len++] = '\n';
+    }
+
+    // Null-terminate the string
+    buffer[len] = '\0';
+    return len;
+}
+
+/************** mapBytes ***************/
+/*
+ * Map a whole map file into memory, read-only; NULL (after logging)
+ * if it cannot be opened, is empty or is not a regular file. The
+ * caller munmaps length bytes later
+ */
+static char*
+mapBytes(const char* mapFile, size_t* length)
+{
+    int fd = open(mapFile, O_RDONLY);
+    if (fd < 0) {
+        log_e("Error: Could not open map file");
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        log_e("Error: Map file is empty or unreadable");
+        close(fd);
+        return NULL;
+    }
+    void* bytes = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);             // the mapping keeps the file open
+    if (bytes == MAP_FAILED) {
+        log_e("Error: Could not map map file");
+        return NULL;
+    }
+    *length = st.st_size;
+    return bytes;
+}
+
+/************** privateCopy ***************/
+/*
+ * Move a mapped map file's bytes into memory of the grid's own, as
+ * read-only as the mapping, and unmap the file, so the file can later
+ * be rewritten or truncated without touching a grid that outlives the
+ * load (reading a page cut off a mapped file raises SIGBUS). NULL
+ * (after logging, and unmapping) if there is no memory. The caller
+ * munmaps length bytes later, as for mapBytes
+ */
+static char*
+privateCopy(char* bytes, size_t length)
+{
+    void* copy = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) {
+        log_e("Error: Could not allocate memory for the map");
+        munmap(bytes, length);
+        return NULL;
+    }
+    memcpy(copy, bytes, length);
+    munmap(bytes, length);
+    mprotect(copy, length, PROT_READ);
+    return copy;
+}
+
+/************** checkLayout ***************/
+/*
+ * Check that a map file's bytes are rows of one non-zero length, each
+ * ended by '\n' (the last may lack it), and fill in rows and cols;
+ * false (after logging) otherwise. memchr does the scanning, so this
+ * is one quick pass over the file
+ */
+static bool
+checkLayout(const char* bytes, size_t length, int* rows, int* cols)
+{
+    const char* eol = memchr(bytes, '\n', length);
+    size_t width = eol != NULL ? (size_t)(eol - bytes) : length;
+    if (width == 0 || length / (width + 1) >= INT32_MAX / (width + 1)) {
+        log_e("Error: Map file has an empty first line or is too big");
+        return false;
+    }
+    int numRows = 0;
+    for (size_t start = 0; start < length; start += width + 1) {
+        eol = memchr(bytes + start, '\n', length - start);
+        size_t lineLength = eol != NULL ? (size_t)(eol - bytes) - start : length - start;
+        if (lineLength != width) {
+            log_d("Error: line %d of the map file is not as long as the first", numRows + 1);
+            return false;
+        }
+        numRows++;
+    }
+    *rows = numRows;
+    *cols = width;
+    return true;
+}
+
+/************** newGrid ***************/
+/*
+ * Malloc a grid struct of the given size, with no gridArray yet;
+ * NULL (after logging) on error
+ */
+static grid_t*
+newGrid(int rows, int cols)
+{
+    grid_t* grid = malloc(sizeof(grid_t));
+    if (grid == NULL) {
+        log_e("Error: Could not allocate grid structure");
+        return NULL;
+    }
+    grid->gridArray = NULL;
+    grid->nrow = rows;
+    grid->ncol = cols;
+    grid->vis = NULL;
+    grid->chunks = NULL;
+    grid->chunkCols = 0;
+    grid->anyDirty = false;
+    grid->mapping = NULL;
+    grid->mapped = 0;
+    grid->readOnly = false;
+    grid->compiled = NULL;
+    return grid;
+}
 
-    // Append rows of the grid
-    for (int r = 0; r < grid->nrow && len < maxSize - 1; r++) {
-        for (int c = 0; c < grid->ncol && len < maxSize - 1; c++) {
-            message[len++] = CELL(grid, r, c);
+/************** loadCompiled ***************/
+/*
+ * Make a grid of a compiled map's bytes, from mapBytes or privateCopy,
+ * keeping them for the rest of the map's sections. With inPlace the grid is the mapped
+ * one, read-only; otherwise it is copied. NULL (after logging, and
+ * unmapping the file) if the map does not check out
+ */
+static grid_t*
+loadCompiled(const char* mapFile, char* bytes, size_t length, bool inPlace)
+{
+    const mapHeader_t* header = mapfile_check(bytes, length);
+    if (header == NULL) {
+        log_e("Error: Compiled map is damaged or from another kind of machine");
+        munmap(bytes, length);
+        return NULL;
+    }
+    grid_t* grid = newGrid(header->nrow, header->ncol);
+    if (grid == NULL) {
+        munmap(bytes, length);
+        return NULL;
+    }
+    size_t size = (size_t)header->nrow * (header->ncol + 1);
+    if (inPlace) {
+        grid->gridArray = bytes + header->gridAt;
+        grid->readOnly = true;
+    } else {
+        grid->gridArray = malloc(size);
+        if (grid->gridArray == NULL) {
+            log_e("Error: Could not allocate grid array");
+            free(grid);
+            munmap(bytes, length);
+            return NULL;
         }
-        // Add a newline character
-        if (len < maxSize - 1) {
-            message[len++] = '\n';
+        memcpy(grid->gridArray, bytes + header->gridAt, size);
+    }
+    grid->mapping = bytes;
+    grid->mapped = length;
+    grid->compiled = header;
+    log_s("Grid loaded from compiled map: %s", mapFile);
+    return grid;
+}
+
+/************** section ***************/
+/*
+ * A section of a grid's compiled map, at the given offset from its
+ * header, which starts the map's bytes (grid_copy borrows those)
+ */
+static const int32_t*
+section(grid_t* grid, uint64_t at)
+{
+    return (const int32_t*)((const char*)grid->compiled + at);
+}
+
+/************** hideAll ***************/
+/*
+ * Set every cell of a new player grid to hidden
+ */
+static void
+hideAll(grid_t* grid)
+{
+    for (int r = 0; r < grid->nrow; r++) {
+        for (int c = 0; c < grid->ncol; c++) {
+            CELL(grid, r, c) = ' ';
         }
     }
+}
 
-    // Null-terminate the string
-    message[len] = '\0';
+/************** fillVisible ***************/
+/*
+ * Fill visible with the cells in sight from (r, c): the cached row
+ * when the original grid has one, otherwise a sweep of the walls
+ */
+static void
+fillVisible(grid_t* mainGrid, grid_t* originalGrid, int r, int c, uint64_t* visible)
+{
+    int words = (mainGrid->nrow * mainGrid->ncol + 63) / 64;
+    const uint64_t* cached = NULL;
+    if (originalGrid != NULL) {
+        cached = viscache_get(originalGrid->vis, r, c);
+    }
+    if (cached != NULL) {
+        memcpy(visible, cached, words * sizeof(uint64_t));
+    } else {
+        // sweep the walls only, so the set depends on nothing but position
+        grid_fieldOfView(originalGrid != NULL ? originalGrid : mainGrid, r, c, visible);
+    }
+}
+
+/************** refreshVis ***************/
+/*
+ * Fill visible from (player_r, player_c) and bring the player grid up
+ * to date. With sinceLast, visible holds the set the grid was last
+ * brought up to date with, so chunks in neither set and unchanged
+ * since then are left alone; otherwise every chunk is looked at
+ */
+static void
+refreshVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+           int player_r, int player_c, uint64_t* visible, bool sinceLast)
+{
+    bool* touched = sinceLast ? newTouched(mainGrid) : NULL;
+    touchChunks(mainGrid, visible, touched);      // still the old set
+    fillVisible(mainGrid, originalGrid, player_r, player_c, visible);
+    touchChunks(mainGrid, visible, touched);
+
+    applyChunks(mainGrid, playerGrid, originalGrid, visible, NULL, touched);
+    free(touched);
+}
+
+/************** newTouched ***************/
+/*
+ * A cleared flag per chunk, for touchChunks; NULL if the grid has no
+ * chunk index (or on error), which applyChunks takes as every chunk
+ */
+static bool*
+newTouched(grid_t* grid)
+{
+    if (grid->chunks == NULL) {
+        return NULL;
+    }
+    int chunkRows = (grid->nrow + grid_ChunkSize - 1) / grid_ChunkSize;
+    return calloc(chunkRows * grid->chunkCols > 0 ? chunkRows * grid->chunkCols : 1, sizeof(bool));
+}
+
+/************** touchChunks ***************/
+/*
+ * Flag the chunk of every cell set in bits; does nothing if touched is NULL
+ */
+static void
+touchChunks(grid_t* grid, const uint64_t* bits, bool* touched)
+{
+    if (touched == NULL || bits == NULL) {
+        return;
+    }
+    int cells = grid->nrow * grid->ncol;
+    for (int w = 0; w < (cells + 63) / 64; w++) {
+        for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+            int i = w * 64 + __builtin_ctzll(word);
+            if (i < cells) {
+                int r = i / grid->ncol;
+                int c = i % grid->ncol;
+                touched[(r / grid_ChunkSize) * grid->chunkCols + c / grid_ChunkSize] = true;
+            }
+        }
+    }
+}
+
+/************** applyChunks ***************/
+/*
+ * Run applyRange over the chunks of the main grid that are not solid
+ * rock and are either flagged in touched or dirty; every chunk that is
+ * not solid rock if touched is NULL, and the whole grid if the main
+ * grid has no chunk index
+ */
+static void
+applyChunks(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+            const uint64_t* visible, const uint64_t* seen, const bool* touched)
+{
+    if (mainGrid->chunks == NULL) {
+        applyRange(mainGrid, playerGrid, originalGrid, visible, seen,
+                   0, mainGrid->nrow, 0, mainGrid->ncol);
+        return;
+    }
+    int chunkRows = (mainGrid->nrow + grid_ChunkSize - 1) / grid_ChunkSize;
+    for (int cr = 0; cr < chunkRows; cr++) {
+        for (int cc = 0; cc < mainGrid->chunkCols; cc++) {
+            int chunk = cr * mainGrid->chunkCols + cc;
+            uint8_t flags = mainGrid->chunks[chunk];
+            if (!(flags & ChunkOpen)) {
+                continue;
+            }
+            if (touched != NULL && !touched[chunk] && !(flags & ChunkDirty)) {
+                continue;
+            }
+            int r1 = (cr + 1) * grid_ChunkSize;
+            int c1 = (cc + 1) * grid_ChunkSize;
+            applyRange(mainGrid, playerGrid, originalGrid, visible, seen,
+                       cr * grid_ChunkSize, r1 < mainGrid->nrow ? r1 : mainGrid->nrow,
+                       cc * grid_ChunkSize, c1 < mainGrid->ncol ? c1 : mainGrid->ncol);
+        }
+    }
+}
+
+/************** applyRange ***************/
+/*
+ * applyCell over rows r0 to r1 and columns c0 to c1 (ends excluded),
+ * first copying any cell set in seen (if not NULL) from the main grid
+ */
+static void
+applyRange(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid,
+           const uint64_t* visible, const uint64_t* seen,
+           int r0, int r1, int c0, int c1)
+{
+    for (int r = r0; r < r1; r++) {
+        for (int c = c0; c < c1; c++) {
+            int i = r * mainGrid->ncol + c;
+            if (seen != NULL && ((seen[i / 64] >> (i % 64)) & 1)) {
+                CELL(playerGrid, r, c) = CELL(mainGrid, r, c);
+            }
+            applyCell(mainGrid, playerGrid, originalGrid, r, c, visible);
+        }
+    }
+}
+
+/************** applyCell ***************/
+/*
+ * Bring one cell of a player grid up to date: copy it from the main
+ * grid when it is in sight, otherwise hide gold and players the
+ * player remembers seeing there. True if the player's cell changed
+ */
+static bool
+applyCell(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, int r, int c, const uint64_t* visible)
+{
+    char before = CELL(playerGrid, r, c);
+    int i = r * mainGrid->ncol + c;
+    if ((visible[i / 64] >> (i % 64)) & 1) {
+        // update playerGrid
+        CELL(playerGrid, r, c) = CELL(mainGrid, r, c);
+    }
+    // if not in current LOS but gold is here we have to hide from player
+    else if (CELL(mainGrid, r, c) == '*' && CELL(playerGrid, r, c) != ' ') {
+        CELL(playerGrid, r, c) = '.';
+    }
+    // if not in current LOS, hide a player the player remembers here, even
+    // one who has since left, so letters are only ever in sight
+    else if (isupper(CELL(playerGrid, r, c))) {
+        CELL(playerGrid, r, c) = CELL(originalGrid != NULL ? originalGrid : mainGrid, r, c);
+    }
+    return CELL(playerGrid, r, c) != before;
 }
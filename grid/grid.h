@@ -13,14 +13,41 @@
 #ifndef GRID_H
 #define GRID_H
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../support/arena.h"
+
+/************ Global Constants **************/
+// rows and columns in each chunk of the chunk index (grid_loadChunks)
+static const int grid_ChunkSize = 32;
+// which cell characters let light through: floor, gold and players
+// (uppercase letters); index it with the cell as an unsigned char
+extern const bool grid_transparent[256];
 
 /************ Global Structures **************/
 typedef struct grid {
     char* gridArray;
     int ncol;
     int nrow;
+    struct viscache* vis;   // visibility cache, only on the original grid
+    uint8_t* chunks;        // flags per chunk, a row of chunks at a time;
+                            // NULL unless grid_loadChunks was called
+    int chunkCols;          // chunks across the grid
+    bool anyDirty;          // some chunk changed since grid_clearDirty
+    char* mapping;          // the map file's bytes, mapped or a private copy
+                            // of them, while the grid uses them; else NULL
+    size_t mapped;          // bytes at mapping
+    bool readOnly;          // gridArray is in the mapping (grid_loadMapped,
+                            // grid_loadCopied)
+    const struct mapHeader* compiled;  // header of a compiled map, else NULL
 } grid_t;
 
+/* ways of working out which cells a player can see */
+typedef enum gridVisEngine {
+    GRID_VIS_RAYS,      // line_of_sight to every cell
+    GRID_VIS_SHADOW,    // one shadowcasting sweep from the player
+} gridVisEngine_t;
+
 /************ Global Functions **************/
 
 /**************** grid_load *****************/
@@ -34,13 +61,135 @@ typedef struct grid {
  *   intialized grid_t struct for game
  *
  * We do:
- *   open and read file, adding number of 
- *   rows, columns, and an array to the struct 
+ *   map the file into memory, check every line is as long as the
+ *   first in one pass, and copy it into the array with one memcpy:
+ *   the file already has the ncol + 1 stride CELL expects. NULL if
+ *   the file is missing, empty, or its lines differ in length.
+ *   A compiled map (see mapfile.h) is taken as it is: its grid is
+ *   copied, and the rest is kept, copied out of the file, for
+ *   grid_randomFloor and friends
  * 
  * User is responsible for freeing later
  */
 grid_t* grid_load(const char* mapFile);
 
+/**************** grid_loadMapped *****************/
+/*
+ * Load a grid that is never written to without copying it, for a
+ * look at a map that is over before the file could change, such as
+ * mapcompile checking what it wrote
+ *
+ * Inputs:
+ *   mapFile - pathname to the map text file
+ * 
+ * Output:
+ *   grid_t struct whose gridArray is the map file itself, mapped
+ *   read-only, or NULL as for grid_load
+ *
+ * A map whose last line has no '\n' is copied by grid_load instead.
+ * A compiled map's grid is used in place too, and grid_loadVisibility
+ * takes its visibility table, if it has one, instead of computing it.
+ * Writing a cell of a mapped grid crashes, and the map file must
+ * not be rewritten in place while the grid is in use: reading a part
+ * of a mapped file that has been cut off raises SIGBUS.
+ * 
+ * User is responsible for freeing later with grid_delete
+ */
+grid_t* grid_loadMapped(const char* mapFile);
+
+/**************** grid_loadCopied *****************/
+/*
+ * Load a grid that is never written to, such as a game's original
+ * grid, as grid_loadMapped does but from a copy of the file
+ *
+ * Inputs:
+ *   mapFile - pathname to the map text file
+ * 
+ * Output:
+ *   grid_t struct whose gridArray is a read-only copy of the map
+ *   file, or NULL as for grid_load
+ *
+ * The file is mapped, copied in one memcpy and unmapped, so the grid
+ * lasts as long as the server likes while the file is edited or
+ * recompiled. A compiled map's visibility table is copied with it and
+ * adopted as for grid_loadMapped. Writing a cell crashes here too.
+ * 
+ * User is responsible for freeing later with grid_delete
+ */
+grid_t* grid_loadCopied(const char* mapFile);
+
+
+/**************** grid_copy *****************/
+/*
+ * Copy a grid in memory, such as a new game's main grid from the
+ * original every game on the map shares
+ *
+ * Inputs:
+ *   original - pointer to a grid from any of the loads
+ * 
+ * Output:
+ *   grid_t struct with its own, writable copy of the cells, or NULL
+ *   on error. The file is not read again, so a map edited since the
+ *   original was loaded changes nothing. A compiled map's floor list,
+ *   rooms and components are the original's, not copied, so the
+ *   original must outlive the copy
+ * 
+ * User is responsible for freeing later with grid_delete
+ */
+grid_t* grid_copy(grid_t* original);
+
+/**************** grid_randomFloor *****************/
+/*
+ * Pick a random floor ('.') cell that nobody and no gold is on
+ *
+ * Inputs:
+ *   grid - pointer to a grid from grid_load or grid_loadMapped
+ *
+ * Output:
+ *   the gridArray position of a cell that is '.' right now, or -1 if
+ *   there is none
+ *
+ * We do:
+ *   draw up to FloorTries random cells, from the map's list of floor
+ *   cells if it is a compiled map, else from the whole grid; if none
+ *   is free, scan from a random cell for one, so a map with nearly
+ *   every floor cell taken still costs at most one pass
+ */
+int grid_randomFloor(grid_t* grid);
+
+/**************** grid_seedRandom *****************/
+/*
+ * Seed the calling thread's random numbers, which grid_randomFloor
+ * and grid_random draw from
+ *
+ * Each thread has a generator of its own (rand_r's state), so threads
+ * hosting different games never share one; a thread that never seeds
+ * it starts as if seeded with 1, as rand() does
+ */
+void grid_seedRandom(unsigned int seed);
+
+/**************** grid_random *****************/
+/*
+ * A random number from 0 to RAND_MAX off the calling thread's
+ * generator, for whatever else goes on the grid (gold, say)
+ */
+int grid_random(void);
+
+/**************** grid_roomOf *****************/
+/*
+ * The room of a floor cell: floor cells with the same number are
+ * joined by moves over floor alone. -1 if (r, c) is not a floor
+ * cell of the original map or the grid did not come from a compiled map
+ */
+int grid_roomOf(grid_t* grid, int r, int c);
+
+/**************** grid_componentOf *****************/
+/*
+ * The connected component of a floor or passage cell: a player can
+ * walk between two cells with the same number. -1 if (r, c) is
+ * neither or the grid did not come from a compiled map
+ */
+int grid_componentOf(grid_t* grid, int r, int c);
 
 /**************** grid_playerLoad *****************/
 /* 
@@ -60,6 +209,95 @@ grid_t* grid_load(const char* mapFile);
  */
 grid_t* grid_playerLoad(grid_t* mainGrid);
 
+/**************** grid_playerLoadArena *****************/
+/* 
+ * Load a new grid struct for a player, from a game's arena
+ *
+ * Inputs:
+ *   mainGrid - pointer to main grid struct 
+ *   arena - the game's arena
+ * 
+ * Output:
+ *   intialized grid_t struct for player, like grid_playerLoad
+ * 
+ * The grid is freed with the arena, so do not call grid_delete;
+ * grid_recycle lets the next player's grid reuse it
+ */
+grid_t* grid_playerLoadArena(grid_t* mainGrid, arena_t* arena);
+
+/**************** grid_recycle *****************/
+/* 
+ * Give a grid from grid_playerLoadArena back to its arena, for the
+ * next grid_playerLoadArena to reuse; NULL is ignored
+ */
+void grid_recycle(grid_t* grid, arena_t* arena);
+
+
+/**************** grid_loadVisibility *****************/
+/*
+ * Build the visibility cache for a grid that never changes
+ *
+ * Inputs:
+ *   grid - pointer to the original map grid
+ *   budget - maximum bytes to spend on the cache
+ *
+ * Output:
+ *   true if the cache was built, false otherwise
+ *
+ * We do:
+ *   hand the grid to the viscache module, which precomputes
+ *   the bitset of visible cells for every floor and passage
+ *   cell (or lazily fills rows when over budget). Call right
+ *   after grid_load on the original grid; grid_calculateVis
+ *   uses the cache whenever its originalGrid has one. A grid from
+ *   a compiled map with a visibility table uses the table as it
+ *   is, whatever the budget
+ */
+bool grid_loadVisibility(grid_t* grid, size_t budget);
+
+
+/**************** grid_loadChunks *****************/
+/*
+ * Build the chunk index of a game's main grid
+ *
+ * Inputs:
+ *   grid - pointer to the main grid, as loaded
+ *
+ * Output:
+ *   true if the index was built, false otherwise
+ *
+ * We do:
+ *   split the grid into grid_ChunkSize square chunks and note which
+ *   hold anything but solid rock (' '), which never changes and
+ *   nobody can see into. grid_updateVis and grid_sprintVis then skip
+ *   the chunks that are all rock, and the chunks the player neither
+ *   saw before nor sees now unless grid_markDirty says they changed.
+ *   Without the index they look at every cell, as before
+ */
+bool grid_loadChunks(grid_t* grid);
+
+/**************** grid_markDirty *****************/
+/*
+ * Note that a cell of a grid with a chunk index changed
+ *
+ * Inputs:
+ *   grid - pointer to the main grid
+ *   position - the gridArray index (r * (ncol + 1) + c) of the cell
+ *
+ * Whoever writes to the main grid's gridArray must call this (the
+ * server does it wherever it records a changed cell), and call
+ * grid_clearDirty once every player grid has been brought up to
+ * date; otherwise grid_updateVis may miss a change. Ignored for a
+ * grid without a chunk index
+ */
+void grid_markDirty(grid_t* grid, int position);
+
+/**************** grid_clearDirty *****************/
+/*
+ * Forget which chunks of a grid changed, once every player grid has
+ * caught up with them; ignored for a grid without a chunk index
+ */
+void grid_clearDirty(grid_t* grid);
 
 /**************** grid_delete ****************/
 /* 
@@ -180,10 +418,115 @@ bool is_within_bounds(grid_t* grid, int row, int col);
  *   
  * We do:
  *   Calculate line of sight from player to every
- *   point on grid
+ *   point on grid, reading it from the visibility
+ *   cache of originalGrid when there is one
  */
 void grid_calculateVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, int player_r, int player_c);
 
+/************** grid_updateVis ***************/
+/* 
+ * Same as grid_calculateVis, but also hand back the visible set
+ *
+ * Inputs: 
+ *   mainGrid - pointer to grid struct
+ *   playerGrid - pointer to player grid struct
+ *   originalGrid - pointer to the original map grid
+ *   player_r - row position of player
+ *   player_c - column position of player
+ *   visible - bitset of (nrow * ncol + 63) / 64 words, holding
+ *             the set from the player's last update, or zeros for
+ *             a player grid fresh from grid_playerLoad
+ * 
+ * We do:
+ *   fill visible with the cells in sight of the player (from the
+ *   cache, or a sweep of the original walls) and update every cell
+ *   of playerGrid. The set only depends on the player's position,
+ *   so keep it around for grid_patchVis until the player moves.
+ *   With a chunk index on mainGrid only the chunks in the old or
+ *   new set, or marked dirty, are looked at: elsewhere nothing the
+ *   player could see has changed
+ */
+void grid_updateVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, int player_r, int player_c, uint64_t* visible);
+
+/************** grid_patchVis ***************/
+/* 
+ * Update only some cells of a player grid, and say whether the player
+ * could see any of it change
+ *
+ * Inputs: 
+ *   mainGrid - pointer to grid struct
+ *   playerGrid - pointer to player grid struct
+ *   originalGrid - pointer to the original map grid
+ *   visible - the set last filled in by grid_updateVis
+ *   positions - gridArray indexes (r * (ncol + 1) + c) that changed
+ *   numPositions - number of entries in positions
+ * 
+ * We do:
+ *   apply the grid_calculateVis rules to the listed cells only.
+ *   For a player who has not moved this gives the same playerGrid
+ *   as a full update, at a cost of numPositions cells
+ *
+ * Returns:
+ *   the number of cells of playerGrid that changed; 0 means the
+ *   player saw none of the changes, so needs no new frame
+ */
+int grid_patchVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, const uint64_t* visible, const int* positions, int numPositions);
+
+/************** grid_sprintVis ***************/
+/* 
+ * Same as grid_updateVis at the end of a run of moves, but the player
+ * also remembers what it glimpsed along the way
+ *
+ * Inputs: 
+ *   mainGrid - pointer to grid struct, after all of the moves
+ *   playerGrid - pointer to player grid struct
+ *   originalGrid - pointer to the original map grid
+ *   path - gridArray indexes the player stood on before the last
+ *          move, in any order
+ *   pathLength - number of entries in path
+ *   player_r - row position of player after the last move
+ *   player_c - column position of player after the last move
+ *   visible - bitset of (nrow * ncol + 63) / 64 words, holding
+ *             the set from before the run, as for grid_updateVis
+ * 
+ * We do:
+ *   fill visible for the final position, as grid_updateVis does,
+ *   and OR together what was in sight from each cell of the path.
+ *   Then update playerGrid in one pass: cells seen only on the way
+ *   are copied from mainGrid and then hidden like any remembered
+ *   cell (gold shows as floor, players as what is under them).
+ *   This costs one pass over the map for the whole run, rather
+ *   than one per move
+ */
+void grid_sprintVis(grid_t* mainGrid, grid_t* playerGrid, grid_t* originalGrid, const int* path, int pathLength, int player_r, int player_c, uint64_t* visible);
+
+/************** grid_setVisEngine ***************/
+/* 
+ * Choose how field of view is computed from now on
+ *
+ * Inputs:
+ *   engine - GRID_VIS_RAYS (the default) or GRID_VIS_SHADOW
+ * 
+ * Both engines produce exactly the same visible set
+ */
+void grid_setVisEngine(gridVisEngine_t engine);
+
+/************** grid_fieldOfView ***************/
+/* 
+ * Compute every cell in line of sight of one cell
+ *
+ * Inputs: 
+ *   grid - pointer to grid struct whose cells block light
+ *   r - row position of origin
+ *   c - column position of origin
+ *   visible - bitset of (nrow * ncol + 63) / 64 words
+ * 
+ * We do:
+ *   clear the bitset and set bit (r * ncol + c) for every
+ *   visible cell, using the engine picked by grid_setVisEngine
+ */
+void grid_fieldOfView(grid_t* grid, int r, int c, uint64_t* visible);
+
 /************** line_of_sight ***************/
 /*
  * Use Breshenham's line algorithm to calculate LOS
@@ -228,15 +571,47 @@ void grid_print(grid_t* grid);
  *
  * Inputs:
  *   grid - pointer to grid struct
+ *   message - buffer of at least grid_displaySize(grid) bytes
  * 
  * Output:
  *   String of entire grid
  * 
  * We do:
- *   Create a buffer of size message_MaxBytes
- *   and start the string with DISPLAY\n so 
- *   server can easily send it as message
+ *   Start the string with DISPLAY\n so 
+ *   server can easily send it as message,
+ *   same as grid_serialize with a big enough buffer
  */
 void grid_toString(grid_t* grid, char* message);
 
+/************** grid_displaySize ***************/
+/* 
+ * Exact number of bytes grid_serialize writes
+ *
+ * Inputs:
+ *   grid - pointer to grid struct
+ * 
+ * Output:
+ *   length of "DISPLAY\n", plus ncol chars and a newline
+ *   for every row, plus the terminating null
+ */
+size_t grid_displaySize(grid_t* grid);
+
+/************** grid_serialize ***************/
+/* 
+ * Write the DISPLAY message for a grid into a caller's buffer
+ *
+ * Inputs:
+ *   grid - pointer to grid struct
+ *   buffer - where to write the message; allocate it once with
+ *            grid_displaySize bytes and reuse it for every send
+ *   size - bytes available in buffer
+ * 
+ * Output:
+ *   length of the message (not counting the null), or 0 if it
+ *   does not fit, in which case nothing useful is written.
+ *   Messages longer than one datagram can be sent with
+ *   fragment_send from the support library
+ */
+size_t grid_serialize(grid_t* grid, char* buffer, size_t size);
+
 #endif
\ No newline at end of file
@@ -1,10 +1,215 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "grid.h"
+#include "viscache.h"
+#include "mapfile.h"
 #include "../support/log.h"
 #include "../support/file.h"
+#include "../support/unittest.h"
+
+/*
+ * Take free floor cells with grid_randomFloor, as players and gold
+ * do, until it says there are none; return how many it gave that were
+ * not free ('.') less how many free cells there were
+ */
+static int fillFloor(grid_t* grid) {
+    int numFloor = 0;
+    for (int r = 0; r < grid->nrow; r++) {
+        for (int c = 0; c < grid->ncol; c++) {
+            numFloor += grid_validStart(grid, r, c);
+        }
+    }
+    int taken = 0;
+    int wrong = 0;
+    for (int position; (position = grid_randomFloor(grid)) >= 0; taken++) {
+        wrong += grid->gridArray[position] != '.';
+        grid->gridArray[position] = '*';
+    }
+    return wrong + (taken - numFloor);
+}
+
+/*
+ * Play random rounds on a map: cells change, the viewer sometimes
+ * moves or sprints, and otherwise gets grid_patchVis, as on the
+ * server. One player grid follows the main grid with a chunk index,
+ * another follows the same cells without; return the number of rounds
+ * after which the two player grids differ.
+ */
+static int chunkRounds(const char* mapFile, int rounds) {
+    grid_t* mainGrid = grid_load(mapFile);
+    grid_t* originalGrid = grid_load(mapFile);
+    if (mainGrid == NULL || originalGrid == NULL || !grid_loadChunks(mainGrid)) {
+        return -1;
+    }
+    grid_t plain = *mainGrid;          // same cells, no chunk index
+    plain.chunks = NULL;
+    grid_t* chunked = grid_playerLoad(mainGrid);
+    grid_t* full = grid_playerLoad(mainGrid);
+    int words = (mainGrid->nrow * mainGrid->ncol + 63) / 64;
+    uint64_t* chunkedVis = calloc(words, sizeof(uint64_t));
+    uint64_t* fullVis = calloc(words, sizeof(uint64_t));
+
+    int size = mainGrid->nrow * (mainGrid->ncol + 1);
+    int* floor = malloc(size * sizeof(int));
+    int numFloor = 0;
+    for (int r = 0; r < mainGrid->nrow; r++) {
+        for (int c = 0; c < mainGrid->ncol; c++) {
+            if (grid_validStart(mainGrid, r, c) || grid_getCell(mainGrid, r, c) == '#') {
+                floor[numFloor++] = r * (mainGrid->ncol + 1) + c;
+            }
+        }
+    }
+
+    int changed[8];
+    int path[4];
+    int viewer = floor[0];
+    int mismatches = 0;
+    for (int round = 0; round < rounds; round++) {
+        int numChanged = 1 + rand() % 8;
+        for (int k = 0; k < numChanged; k++) {
+            changed[k] = floor[rand() % numFloor];
+            char kinds[] = { '*', 'B', mainGrid->gridArray[changed[k]], originalGrid->gridArray[changed[k]] };
+            mainGrid->gridArray[changed[k]] = kinds[rand() % 4];
+            grid_markDirty(mainGrid, changed[k]);
+        }
+        int r = viewer / (mainGrid->ncol + 1);
+        int c = viewer % (mainGrid->ncol + 1);
+        if (rand() % 4 == 0) {
+            viewer = floor[rand() % numFloor];
+            r = viewer / (mainGrid->ncol + 1);
+            c = viewer % (mainGrid->ncol + 1);
+            grid_updateVis(mainGrid, chunked, originalGrid, r, c, chunkedVis);
+            grid_updateVis(&plain, full, originalGrid, r, c, fullVis);
+        } else if (rand() % 8 == 0) {
+            for (int k = 0; k < 4; k++) {
+                path[k] = floor[rand() % numFloor];
+            }
+            grid_sprintVis(mainGrid, chunked, originalGrid, path, 4, r, c, chunkedVis);
+            grid_sprintVis(&plain, full, originalGrid, path, 4, r, c, fullVis);
+        } else {
+            grid_patchVis(mainGrid, chunked, originalGrid, chunkedVis, changed, numChanged);
+            grid_patchVis(&plain, full, originalGrid, fullVis, changed, numChanged);
+        }
+        grid_clearDirty(mainGrid);
+        bool same = true;
+        for (int row = 0; row < mainGrid->nrow; row++) {
+            same = same && memcmp(&chunked->gridArray[row * (mainGrid->ncol + 1)],
+                                  &full->gridArray[row * (mainGrid->ncol + 1)], mainGrid->ncol) == 0;
+        }
+        if (!same) {
+            mismatches++;
+        }
+    }
+
+    free(floor);
+    free(chunkedVis);
+    free(fullVis);
+    grid_delete(chunked);
+    grid_delete(full);
+    grid_delete(mainGrid);
+    grid_delete(originalGrid);
+    return mismatches;
+}
+
+/*
+ * Play random rounds on a map: players walk from cell to cell, picking
+ * up gold where they land and now and then dropping more, while a few
+ * observers stand still. Each observer has one grid kept up to date by
+ * grid_patchVis with the cells each round changed, as on the server,
+ * and one redrawn by grid_updateVis; return the number of observer
+ * rounds after which the two differ.
+ */
+static int patchRounds(const char* mapFile, int rounds) {
+    enum { NumPlayers = 8, NumObservers = 4 };
+    grid_t* mainGrid = grid_load(mapFile);
+    grid_t* originalGrid = grid_load(mapFile);
+    if (mainGrid == NULL || originalGrid == NULL) {
+        return -1;
+    }
+    int words = (mainGrid->nrow * mainGrid->ncol + 63) / 64;
+    int size = mainGrid->nrow * (mainGrid->ncol + 1);
+    grid_t* patched[NumObservers];
+    grid_t* redrawn[NumObservers];
+    uint64_t* patchedVis[NumObservers];
+    uint64_t* redrawnVis[NumObservers];
+    int observers[NumObservers];
+    for (int o = 0; o < NumObservers; o++) {
+        observers[o] = grid_randomFloor(mainGrid);
+        patched[o] = grid_playerLoad(mainGrid);
+        redrawn[o] = grid_playerLoad(mainGrid);
+        patchedVis[o] = calloc(words, sizeof(uint64_t));
+        redrawnVis[o] = calloc(words, sizeof(uint64_t));
+    }
+    int players[NumPlayers];
+    for (int k = 0; k < NumPlayers; k++) {
+        players[k] = grid_randomFloor(mainGrid);
+        mainGrid->gridArray[players[k]] = 'A' + k;
+    }
+    for (int o = 0; o < NumObservers; o++) {
+        int r = observers[o] / (mainGrid->ncol + 1);
+        int c = observers[o] % (mainGrid->ncol + 1);
+        grid_updateVis(mainGrid, patched[o], originalGrid, r, c, patchedVis[o]);
+    }
+
+    int changed[3];
+    int mismatches = 0;
+    for (int round = 0; round < rounds; round++) {
+        int numChanged = 0;
+        int k = rand() % NumPlayers;
+        int to = grid_randomFloor(mainGrid);
+        // every other round the player heads for gold, if there is any
+        int start = rand() % size;
+        for (int i = 0; round % 2 == 0 && i < size; i++) {
+            if (mainGrid->gridArray[(start + i) % size] == '*') {
+                to = (start + i) % size;
+                break;
+            }
+        }
+        if (to >= 0) {
+            mainGrid->gridArray[players[k]] = originalGrid->gridArray[players[k]];
+            mainGrid->gridArray[to] = 'A' + k;
+            changed[numChanged++] = players[k];
+            changed[numChanged++] = to;
+            players[k] = to;
+        }
+        int gold = grid_randomFloor(mainGrid);
+        if (gold >= 0 && rand() % 2 == 0) {
+            mainGrid->gridArray[gold] = '*';
+            changed[numChanged++] = gold;
+        }
+
+        for (int o = 0; o < NumObservers; o++) {
+            int r = observers[o] / (mainGrid->ncol + 1);
+            int c = observers[o] % (mainGrid->ncol + 1);
+            grid_patchVis(mainGrid, patched[o], originalGrid, patchedVis[o], changed, numChanged);
+            grid_updateVis(mainGrid, redrawn[o], originalGrid, r, c, redrawnVis[o]);
+            bool same = true;
+            for (int row = 0; row < mainGrid->nrow; row++) {
+                same = same && memcmp(&patched[o]->gridArray[row * (mainGrid->ncol + 1)],
+                                      &redrawn[o]->gridArray[row * (mainGrid->ncol + 1)],
+                                      mainGrid->ncol) == 0;
+            }
+            if (!same) {
+                mismatches++;
+            }
+        }
+    }
+
+    for (int o = 0; o < NumObservers; o++) {
+        grid_delete(patched[o]);
+        grid_delete(redrawn[o]);
+        free(patchedVis[o]);
+        free(redrawnVis[o]);
+    }
+    grid_delete(mainGrid);
+    grid_delete(originalGrid);
+    return mismatches;
+}
 
 int main() {
+    int failures = 0;
+
     // Initialize logging to stderr
     log_init(stderr);
 
@@ -65,16 +270,167 @@ int main() {
         printf("Position (%d, %d) is not a valid start.\n", player_r, player_c);
     }
 
+    // Test the visibility cache against plain line of sight, with a
+    // budget big enough for the whole table and one that forces LRU
+    printf("\nTesting grid_loadVisibility:\n");
+    size_t budgets[] = { viscache_DefaultBudget, 4096 };
+    for (int b = 0; b < 2; b++) {
+        if (!grid_loadVisibility(originalGrid, budgets[b])) {
+            printf("Failed to build visibility cache.\n");
+            return 1;
+        }
+        int mismatches = 0;
+        for (int r0 = 0; r0 < originalGrid->nrow; r0++) {
+            for (int c0 = 0; c0 < originalGrid->ncol; c0++) {
+                const uint64_t* row = viscache_get(originalGrid->vis, r0, c0);
+                if (row == NULL) {
+                    continue;
+                }
+                for (int i = 0; i < originalGrid->nrow * originalGrid->ncol; i++) {
+                    bool cached = (row[i / 64] >> (i % 64)) & 1;
+                    if (cached != line_of_sight(originalGrid, r0, c0,
+                                                i / originalGrid->ncol, i % originalGrid->ncol)) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+        printf("%s mode: %d mismatches\n",
+               viscache_isFull(originalGrid->vis) ? "Full" : "Budget", mismatches);
+        CHECK(mismatches == 0);
+    }
+
+    // grid_patchVis should count a change the player can see, and only that
+    printf("\nTesting grid_patchVis:\n");
+    uint64_t* visible = calloc((mainGrid->nrow * mainGrid->ncol + 63) / 64, sizeof(uint64_t));
+    grid_updateVis(mainGrid, playerGrid, originalGrid, player_r, player_c, visible);
+    int inSight = -1, outOfSight = -1;
+    for (int r = 0; r < mainGrid->nrow; r++) {
+        for (int c = 0; c < mainGrid->ncol; c++) {
+            int i = r * mainGrid->ncol + c;
+            bool seen = (visible[i / 64] >> (i % 64)) & 1;
+            if (grid_validStart(mainGrid, r, c) && (r != player_r || c != player_c)) {
+                if (seen && inSight < 0) {
+                    inSight = r * (mainGrid->ncol + 1) + c;
+                } else if (!seen && outOfSight < 0) {
+                    outOfSight = r * (mainGrid->ncol + 1) + c;
+                }
+            }
+        }
+    }
+    CHECK(inSight >= 0 && outOfSight >= 0);
+    mainGrid->gridArray[inSight] = '*';
+    mainGrid->gridArray[outOfSight] = '*';
+    int changedCells[] = { inSight, outOfSight };
+    int seenChange = grid_patchVis(mainGrid, playerGrid, originalGrid, visible, &changedCells[0], 1);
+    int unseenChange = grid_patchVis(mainGrid, playerGrid, originalGrid, visible, &changedCells[1], 1);
+    int noChange = grid_patchVis(mainGrid, playerGrid, originalGrid, visible, changedCells, 2);
+    printf("Gold in sight: %d changed, out of sight: %d changed, again: %d changed\n",
+           seenChange, unseenChange, noChange);
+    CHECK(seenChange == 1);
+    CHECK(unseenChange == 0);
+    CHECK(noChange == 0);
+    mainGrid->gridArray[inSight] = '.';
+    mainGrid->gridArray[outOfSight] = '.';
+    grid_patchVis(mainGrid, playerGrid, originalGrid, visible, changedCells, 2);
+    free(visible);
+
+    // patching the changed cells must leave an observer's grid as
+    // redrawing it from scratch would
+    printf("\nTesting grid_patchVis against grid_updateVis:\n");
+    int mainPatched = patchRounds("../maps/main.txt", 2000);
+    int bigPatched = patchRounds("../maps/big.txt", 500);
+    printf("main.txt: %d mismatched rounds, big.txt: %d mismatched rounds\n",
+           mainPatched, bigPatched);
+    CHECK(mainPatched == 0);
+    CHECK(bigPatched == 0);
+
+    // a chunk index must change nothing a player sees
+    printf("\nTesting grid_loadChunks:\n");
+    int mainRounds = chunkRounds("../maps/main.txt", 2000);
+    int bigRounds = chunkRounds("../maps/big.txt", 2000);
+    printf("main.txt: %d mismatched rounds, big.txt: %d mismatched rounds\n",
+           mainRounds, bigRounds);
+    CHECK(mainRounds == 0);
+    CHECK(bigRounds == 0);
+
+    // a compiled map must load as the text one, with its table and lists
+    printf("\nTesting mapfile_write:\n");
+    if (!mapfile_write(originalGrid, "gridtest.bin", true)) {
+        printf("Failed to compile the map.\n");
+        return 1;
+    }
+    grid_t* compiled = grid_loadMapped("gridtest.bin");
+    grid_t* copied = grid_load("gridtest.bin");
+    if (compiled == NULL || copied == NULL || !grid_loadVisibility(compiled, 0)) {
+        printf("Failed to load the compiled map.\n");
+        return 1;
+    }
+    int wrongCells = 0, wrongRows = 0, wrongLabels = 0, wrongPicks = 0;
+    uint64_t* row = calloc((originalGrid->nrow * originalGrid->ncol + 63) / 64, sizeof(uint64_t));
+    for (int r = 0; r < originalGrid->nrow; r++) {
+        for (int c = 0; c < originalGrid->ncol; c++) {
+            char cell = grid_getCell(originalGrid, r, c);
+            wrongCells += grid_getCell(compiled, r, c) != cell || grid_getCell(copied, r, c) != cell;
+            wrongLabels += (grid_roomOf(compiled, r, c) >= 0) != (cell == '.')
+                           || (grid_componentOf(copied, r, c) >= 0) != (cell == '.' || cell == '#');
+            const uint64_t* adopted = viscache_get(compiled->vis, r, c);
+            if (adopted != NULL) {
+                grid_fieldOfView(originalGrid, r, c, row);
+                wrongRows += memcmp(adopted, row, viscache_words(compiled->vis) * sizeof(uint64_t)) != 0;
+            }
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        int position = grid_randomFloor(copied);
+        wrongPicks += position < 0 || copied->gridArray[position] != '.';
+    }
+    printf("Compiled %s: %d wrong cells, %d wrong rows, %d wrong labels, %d wrong picks\n",
+           viscache_isFull(compiled->vis) ? "full" : "budget", wrongCells, wrongRows,
+           wrongLabels, wrongPicks);
+    CHECK(wrongCells == 0);
+    CHECK(wrongRows == 0);
+    CHECK(wrongLabels == 0);
+    CHECK(wrongPicks == 0);
+    // a copy made in memory has the cells and borrows the floor list
+    grid_t* copy = grid_copy(compiled);
+    CHECK(copy != NULL && copy->compiled == compiled->compiled);
+    CHECK(copy != NULL && memcmp(copy->gridArray, compiled->gridArray,
+                                 compiled->nrow * (compiled->ncol + 1)) == 0);
+    CHECK(copy != NULL && copy->gridArray[grid_randomFloor(copy)] == '.');
+    grid_delete(copy);
+    // every floor cell taken, from the compiled list and from a text map
+    grid_t* text = grid_load("../maps/main.txt");
+    int compiledFill = fillFloor(copied);
+    int textFill = fillFloor(text);
+    printf("Filling the floor: compiled %d wrong, text %d wrong\n",
+           compiledFill, textFill);
+    CHECK(compiledFill == 0);
+    CHECK(textFill == 0);
+    grid_delete(text);
+    free(row);
+    grid_delete(compiled);
+    grid_delete(copied);
+    remove("gridtest.bin");
+
     printf("Running grid_toString test...\n");
-    char gridAsString[1700];
+    char* gridAsString = malloc(grid_displaySize(playerGrid));
     grid_toString(playerGrid, gridAsString);
     printf("Testing grid_toString:\n%s\n", gridAsString);
 
+    // grid_serialize must refuse a buffer one byte short
+    size_t fits = grid_serialize(playerGrid, gridAsString, grid_displaySize(playerGrid));
+    size_t tooShort = grid_serialize(playerGrid, gridAsString, grid_displaySize(playerGrid) - 1);
+    printf("grid_serialize: %zu bytes, %zu with a short buffer\n", fits, tooShort);
+    CHECK(fits > 0);
+    CHECK(tooShort == 0);
+    free(gridAsString);
+
     // Clean up
     grid_delete(mainGrid);
     grid_delete(originalGrid);
     grid_delete(playerGrid);
     log_done();
 
-    return 0;
+    return unittest_report(failures);
 }
\ No newline at end of file
@@ -0,0 +1,230 @@
+/*
+ * losbench.c - microbenchmark for line_of_sight
+ *
+ * Times rays per second from every floor and passage cell of a map
+ * to every cell of it, first with the original floating-point
+ * floor/ceil version of line_of_sight and then with the integer
+ * kernel in grid.c, and checks that both give the same answers.
+ *
+ * usage: ./losbench map.txt [rounds]
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include "grid.h"
+#include "../support/log.h"
+
+#define CELL(grid,r,c) ((grid)->gridArray[(r)*((grid)->ncol + 1) + (c)])
+
+typedef bool (*losFunc_t)(grid_t* grid, int startRow, int startCol, int endRow, int endCol);
+
+static bool floatLineOfSight(grid_t* mainGrid, int startRow, int startCol, int endRow, int endCol);
+static double timeRays(grid_t* grid, losFunc_t los, int rounds, long* rays, long* seen);
+
+int main(const int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3) {
+        fprintf(stderr, "usage: %s map.txt [rounds]\n", argv[0]);
+        return 1;
+    }
+    int rounds = (argc == 3) ? atoi(argv[2]) : 3;
+    grid_t* grid = grid_load(argv[1]);
+    if (grid == NULL || rounds < 1) {
+        fprintf(stderr, "could not load %s\n", argv[1]);
+        return 1;
+    }
+
+    long rays, seenBefore, seenAfter;
+    double before = timeRays(grid, floatLineOfSight, rounds, &rays, &seenBefore);
+    double after = timeRays(grid, line_of_sight, rounds, &rays, &seenAfter);
+    printf("%s: %ld rays per round, %d rounds\n", argv[1], rays / rounds, rounds);
+    printf("before (double floor/ceil): %8.2f Mrays/s\n", rays / before / 1e6);
+    printf("after  (integer kernel):    %8.2f Mrays/s\n", rays / after / 1e6);
+    printf("speedup: %.2fx\n", before / after);
+
+    // the kernels must agree ray for ray, not just in total
+    long mismatches = 0;
+    for (int r0 = 0; r0 < grid->nrow; r0++) {
+        for (int c0 = 0; c0 < grid->ncol; c0++) {
+            for (int r = 0; r < grid->nrow; r++) {
+                for (int c = 0; c < grid->ncol; c++) {
+                    if (floatLineOfSight(grid, r0, c0, r, c) != line_of_sight(grid, r0, c0, r, c)) {
+                        mismatches++;
+                    }
+                }
+            }
+        }
+    }
+    printf("%s: %ld mismatches\n", mismatches == 0 ? "PASSED" : "FAILED", mismatches);
+
+    grid_delete(grid);
+    return mismatches == 0 && seenBefore == seenAfter ? 0 : 1;
+}
+
+/*
+ * cast rounds x (floor and passage cells) x (all cells) rays
+ */
+static double timeRays(grid_t* grid, losFunc_t los, int rounds, long* rays, long* seen)
+{
+    *rays = 0;
+    *seen = 0;
+    clock_t start = clock();
+    for (int round = 0; round < rounds; round++) {
+        for (int r0 = 0; r0 < grid->nrow; r0++) {
+            for (int c0 = 0; c0 < grid->ncol; c0++) {
+                char origin = CELL(grid, r0, c0);
+                if (origin != '.' && origin != '#') {
+                    continue;
+                }
+                for (int r = 0; r < grid->nrow; r++) {
+                    for (int c = 0; c < grid->ncol; c++) {
+                        *seen += los(grid, r0, c0, r, c);
+                        (*rays)++;
+                    }
+                }
+            }
+        }
+    }
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+/*
+ * floatLineOfSight - line_of_sight as it was before the integer
+ * kernel, kept here as the "before" of the benchmark
+ */
+static bool
+floatLineOfSight(grid_t* mainGrid, int startRow, int startCol, int endRow, int endCol)
+{
+    // change in x and y
+    int dx = abs(endCol - startCol);
+    int dy = abs(endRow - startRow);
+
+    // determine step directions
+    int stepx = (startCol < endCol) ? 1 : -1;
+    int stepy = (startRow < endRow) ? 1 : -1;
+
+    // initialize current positions
+    int x = startCol;
+    int y = startRow;
+
+    // handle same position
+    if (dx == 0 && dy == 0) {
+        return true;
+    }
+
+    // handle horizontal line
+    if (dy == 0) {
+        int x = startCol;
+        while ((x + stepx) != endCol) {
+            x += stepx;
+            if (is_within_bounds(mainGrid, y, x)) {
+                char cell = CELL(mainGrid, y, x);
+                // only pass through gold, floor, or player
+                if (!(cell == '.' || cell == '*' || isupper(cell))) {
+                    return false;
+                }
+            } 
+        }
+        return true;
+    }
+
+    // handle vertical line
+    if (dx == 0) {
+        int y = startRow;
+        while ((y + stepy) != endRow) {
+            y += stepy;
+            if (is_within_bounds(mainGrid, y, x)) {
+                char cell = CELL(mainGrid, y, x);
+                // only pass through gold, floor, or player
+                if (!(cell == '.' || cell == '*' || isupper(cell))) {
+                    return false;
+                }
+            }  
+        }
+        return true;
+    }
+
+    // continue until reaching the end position
+    while ((x + stepx) != endCol || (y + stepy) != endRow) {
+        // check row intersections
+        if (y + stepy != endRow) {
+            // increment
+            y += stepy;
+
+            // intersect calculation with slope
+            double intersection_x;
+            if (stepx == 1) {
+                intersection_x = startCol + (double)abs(y - startRow) * dx / dy;
+            }
+            else {
+                intersection_x = startCol + (double)abs(y - startRow) * -dx / dy;
+            }
+
+            // look to left and right of intersection
+            int left_col = (int)floor(intersection_x);
+            int right_col = (int)ceil(intersection_x);
+
+            // direct grid hit
+            if (left_col == right_col && is_within_bounds(mainGrid, y, left_col)) {
+                char cell = CELL(mainGrid, y, left_col);
+                // only pass through floor, gold, or corner
+                if (!(cell == '.' || cell == '*' || isupper(cell))) {
+                    return false;
+                }
+            } 
+            else if (is_within_bounds(mainGrid, y, left_col) && is_within_bounds(mainGrid, y, right_col)) {
+                char left_cell = CELL(mainGrid, y, left_col);
+                char right_cell = CELL(mainGrid, y, right_col);
+                // only pass if there is a floor or gold on either side
+                if (!(left_cell == '.' || right_cell == '.' || left_cell == '*' || right_cell == '*' 
+                        || isupper(left_cell) || isupper(right_cell))) {
+                    return false;
+                }
+            }
+        }
+        // Check column intersections
+        if (x + stepx != endCol) {
+            // increment
+            x += stepx;
+
+            // calculate intersection with slope
+            double intersection_y;
+            if (stepy == 1) {
+                intersection_y = startRow + (double)abs(x - startCol) * dy / dx;
+            }
+            else {
+                intersection_y = startRow + (double)abs(x - startCol) * -dy / dx;
+            }
+            
+            // look to top and bottom of intersect
+            int top_row = (int)floor(intersection_y);
+            int bottom_row = (int)ceil(intersection_y);
+
+            // direct hit
+            if (top_row == bottom_row && is_within_bounds(mainGrid, top_row, x)) {
+                char cell = CELL(mainGrid, top_row, x);
+                // only pass through floor, gold, or corner
+                if (!(cell == '.' || cell == '*' || isupper(cell))) {
+                    return false;
+                }
+            } 
+            else if (is_within_bounds(mainGrid, top_row, x) && is_within_bounds(mainGrid, bottom_row, x)) {
+                char top_cell = CELL(mainGrid, top_row, x);
+                char bottom_cell = CELL(mainGrid, bottom_row, x);
+                // only pass if floor or gold is on either side
+                if (!(top_cell == '.' || bottom_cell == '.' || top_cell == '*' || bottom_cell == '*'
+                        || isupper(top_cell) || isupper(bottom_cell))) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
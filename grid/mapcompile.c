@@ -0,0 +1,65 @@
+/*
+ * mapcompile.c - compile a map text file for the nuggets server
+ *
+ * Writes the compiled form of a map (see mapfile.h), which the server
+ * maps and uses as it is instead of parsing the text, then loads it
+ * back and checks its grid is the text map's.
+ *
+ * usage: ./mapcompile [-novis] map.txt map.bin
+ *   -novis leaves out the visibility table, which is the bulk of a
+ *   big map's file; the server then computes it as it would for text
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "grid.h"
+#include "mapfile.h"
+
+int main(const int argc, char* argv[])
+{
+    bool withVis = !(argc == 4 && strcmp(argv[1], "-novis") == 0);
+    if (argc != (withVis ? 3 : 4)) {
+        fprintf(stderr, "usage: %s [-novis] map.txt map.bin\n", argv[0]);
+        return 1;
+    }
+    const char* textFile = argv[argc - 2];
+    const char* outFile = argv[argc - 1];
+    grid_t* grid = grid_load(textFile);
+    if (grid == NULL) {
+        fprintf(stderr, "could not load %s\n", textFile);
+        return 1;
+    }
+    if (!mapfile_write(grid, outFile, withVis)) {
+        fprintf(stderr, "could not write %s\n", outFile);
+        grid_delete(grid);
+        return 1;
+    }
+
+    // read it back the way the server will
+    grid_t* compiled = grid_loadMapped(outFile);
+    bool same = compiled != NULL && compiled->compiled != NULL
+                && compiled->nrow == grid->nrow && compiled->ncol == grid->ncol;
+    for (int r = 0; same && r < grid->nrow; r++) {
+        same = memcmp(&compiled->gridArray[r * (grid->ncol + 1)],
+                      &grid->gridArray[r * (grid->ncol + 1)], grid->ncol) == 0;
+    }
+    if (!same) {
+        fprintf(stderr, "%s does not load back as %s\n", outFile, textFile);
+        grid_delete(grid);
+        grid_delete(compiled);
+        return 1;
+    }
+    const mapHeader_t* header = compiled->compiled;
+    printf("%s: %dx%d, %d floor cells, %d rooms, %d components, %s, %llu bytes\n",
+           outFile, header->nrow, header->ncol, header->numFloor, header->numRooms,
+           header->numComponents, header->visWords > 0 ? "visibility table" : "no visibility table",
+           (unsigned long long)header->length);
+    grid_delete(grid);
+    grid_delete(compiled);
+    return 0;
+}
@@ -0,0 +1,303 @@
+/*
+ * mapfile.c - compiled map files for the nuggets program
+ *
+ * see mapfile.h for more detailed description
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "../support/log.h"
+#include "grid.h"
+#include "mapfile.h"
+
+/************ local functions *************/
+static bool isFloor(char cell);
+static bool isWalkable(char cell);
+static int label(grid_t* grid, int32_t* labels, bool (*joins)(char cell));
+static uint64_t align8(uint64_t at);
+static bool fits(uint64_t at, uint64_t size, size_t length);
+static bool writeAt(FILE* fp, uint64_t at, const void* data, size_t size);
+
+/************ global functions *************/
+
+/**************** mapfile_write *****************/
+/* see mapfile.h for more detailed description */
+bool
+mapfile_write(grid_t* grid, const char* outFile, bool withVis)
+{
+    if (grid == NULL || outFile == NULL) {
+        log_e("Error: grid or file name is NULL");
+        return false;
+    }
+    int nrow = grid->nrow;
+    int ncol = grid->ncol;
+    int cells = nrow * ncol;
+    mapHeader_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MAPFILE_MAGIC, sizeof(MAPFILE_MAGIC));
+    header.order = mapfile_Order;
+    header.nrow = nrow;
+    header.ncol = ncol;
+
+    int32_t* floor = malloc(cells * sizeof(int32_t));
+    int32_t* rooms = malloc(cells * sizeof(int32_t));
+    int32_t* components = malloc(cells * sizeof(int32_t));
+    uint64_t* vis = NULL;
+    bool ok = floor != NULL && rooms != NULL && components != NULL;
+    if (ok) {
+        for (int r = 0; r < nrow; r++) {
+            for (int c = 0; c < ncol; c++) {
+                char cell = grid_getCell(grid, r, c);
+                if (isFloor(cell)) {
+                    floor[header.numFloor++] = r * (ncol + 1) + c;
+                }
+                if (isWalkable(cell)) {
+                    header.numOrigins++;
+                }
+            }
+        }
+        header.numRooms = label(grid, rooms, isFloor);
+        header.numComponents = label(grid, components, isWalkable);
+        ok = header.numRooms >= 0 && header.numComponents >= 0;
+    }
+    if (ok && withVis) {
+        // one row per origin, in the order viscache numbers them
+        header.visWords = (cells + 63) / 64;
+        vis = malloc(((size_t)header.numOrigins * header.visWords + 1) * sizeof(uint64_t));
+        ok = vis != NULL;
+        for (int i = 0, origin = 0; ok && i < cells; i++) {
+            if (isWalkable(grid_getCell(grid, i / ncol, i % ncol))) {
+                grid_fieldOfView(grid, i / ncol, i % ncol, &vis[(size_t)origin++ * header.visWords]);
+            }
+        }
+    }
+    if (!ok) {
+        log_e("Error: could not allocate memory to compile the map");
+        free(floor);
+        free(rooms);
+        free(components);
+        free(vis);
+        return false;
+    }
+
+    // lay the sections out after the header
+    uint64_t at = align8(sizeof(header));
+    header.gridAt = at;
+    at = align8(at + (uint64_t)nrow * (ncol + 1));
+    header.floorAt = at;
+    at = align8(at + (uint64_t)header.numFloor * sizeof(int32_t));
+    header.roomsAt = at;
+    at = align8(at + (uint64_t)cells * sizeof(int32_t));
+    header.componentsAt = at;
+    at = align8(at + (uint64_t)cells * sizeof(int32_t));
+    header.visAt = withVis ? at : 0;
+    header.length = at + (uint64_t)header.numOrigins * header.visWords * sizeof(uint64_t);
+
+    // write beside the old file and rename over it, so a server that
+    // still has the old one mapped keeps it whole instead of seeing it
+    // cut short under it
+    char* tempFile = malloc(strlen(outFile) + sizeof(".tmp"));
+    FILE* fp = NULL;
+    if (tempFile != NULL) {
+        sprintf(tempFile, "%s.tmp", outFile);
+        fp = fopen(tempFile, "wb");
+    }
+    if (fp == NULL) {
+        log_e("Error: could not open the compiled map for writing");
+        ok = false;
+    } else {
+        ok = writeAt(fp, 0, &header, sizeof(header));
+        for (int r = 0; ok && r < nrow; r++) {
+            ok = writeAt(fp, header.gridAt + (uint64_t)r * (ncol + 1), &grid->gridArray[r * (ncol + 1)], ncol)
+                 && fputc('\n', fp) != EOF;
+        }
+        ok = ok && writeAt(fp, header.floorAt, floor, header.numFloor * sizeof(int32_t))
+                && writeAt(fp, header.roomsAt, rooms, cells * sizeof(int32_t))
+                && writeAt(fp, header.componentsAt, components, cells * sizeof(int32_t))
+                && (!withVis || writeAt(fp, header.visAt, vis,
+                                        (size_t)header.numOrigins * header.visWords * sizeof(uint64_t)));
+        ok = (fclose(fp) == 0) && ok;
+        ok = ok && rename(tempFile, outFile) == 0;
+        if (!ok) {
+            log_e("Error: could not write the compiled map");
+            remove(tempFile);
+        }
+    }
+    free(tempFile);
+    free(floor);
+    free(rooms);
+    free(components);
+    free(vis);
+    return ok;
+}
+
+/**************** mapfile_check *****************/
+/* see mapfile.h for more detailed description */
+const mapHeader_t*
+mapfile_check(const char* bytes, size_t length)
+{
+    if (!mapfile_isCompiled(bytes, length) || length < sizeof(mapHeader_t)) {
+        return NULL;
+    }
+    const mapHeader_t* header = (const mapHeader_t*)bytes;
+    if (header->order != mapfile_Order || header->length != length) {
+        log_v("Compiled map has the wrong byte order or length");
+        return NULL;
+    }
+    if (header->nrow <= 0 || header->ncol <= 0
+        || (int64_t)header->nrow * (header->ncol + 1) > INT32_MAX) {
+        return NULL;
+    }
+    uint64_t cells = (uint64_t)header->nrow * header->ncol;
+    if (header->numFloor < 0 || header->numFloor > cells
+        || header->numOrigins < 0 || header->numOrigins > cells
+        || header->numRooms < 0 || header->numComponents < 0
+        || (header->visWords != 0 && header->visWords != (cells + 63) / 64)) {
+        return NULL;
+    }
+    if (!fits(header->gridAt, (uint64_t)header->nrow * (header->ncol + 1), length)
+        || !fits(header->floorAt, header->numFloor * sizeof(int32_t), length)
+        || !fits(header->roomsAt, cells * sizeof(int32_t), length)
+        || !fits(header->componentsAt, cells * sizeof(int32_t), length)
+        || (header->visWords > 0
+            && !fits(header->visAt, (uint64_t)header->numOrigins * header->visWords * sizeof(uint64_t), length))) {
+        log_v("Compiled map has a section out of place");
+        return NULL;
+    }
+    // the floor list is used to index the grid, so it must stay on it
+    const int32_t* floor = (const int32_t*)(bytes + header->floorAt);
+    for (int i = 0; i < header->numFloor; i++) {
+        if (floor[i] < 0 || floor[i] >= header->nrow * (header->ncol + 1)
+            || floor[i] % (header->ncol + 1) == header->ncol) {
+            log_v("Compiled map has a floor cell off the grid");
+            return NULL;
+        }
+    }
+    return header;
+}
+
+/**************** mapfile_isCompiled *****************/
+/* see mapfile.h for more detailed description */
+bool
+mapfile_isCompiled(const char* bytes, size_t length)
+{
+    return bytes != NULL && length >= sizeof(MAPFILE_MAGIC)
+           && memcmp(bytes, MAPFILE_MAGIC, sizeof(MAPFILE_MAGIC)) == 0;
+}
+
+/************ local functions *************/
+
+/**************** isFloor *****************/
+/*
+ * True for a room's floor, where players and gold are placed
+ */
+static bool
+isFloor(char cell)
+{
+    return cell == '.';
+}
+
+/**************** isWalkable *****************/
+/*
+ * True for floor and passage cells, where a player can stand
+ */
+static bool
+isWalkable(char cell)
+{
+    return cell == '.' || cell == '#';
+}
+
+/**************** label *****************/
+/*
+ * Number the groups of cells for which joins is true that a player
+ * can move between, one step in any of the eight directions at a
+ * time, without leaving such cells. labels gets each cell's group
+ * (r * ncol + c), or -1; return the number of groups, -1 on error
+ */
+static int
+label(grid_t* grid, int32_t* labels, bool (*joins)(char cell))
+{
+    int cells = grid->nrow * grid->ncol;
+    int* stack = malloc((cells > 0 ? cells : 1) * sizeof(int));
+    if (stack == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < cells; i++) {
+        labels[i] = -1;
+    }
+    int groups = 0;
+    for (int i = 0; i < cells; i++) {
+        if (labels[i] >= 0 || !(*joins)(grid_getCell(grid, i / grid->ncol, i % grid->ncol))) {
+            continue;
+        }
+        // flood out from the first cell of a new group
+        int top = 0;
+        labels[i] = groups;
+        stack[top++] = i;
+        while (top > 0) {
+            int cell = stack[--top];
+            int r = cell / grid->ncol;
+            int c = cell % grid->ncol;
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    int next = (r + dr) * grid->ncol + (c + dc);
+                    if (is_within_bounds(grid, r + dr, c + dc) && labels[next] < 0
+                        && (*joins)(grid_getCell(grid, r + dr, c + dc))) {
+                        labels[next] = groups;
+                        stack[top++] = next;
+                    }
+                }
+            }
+        }
+        groups++;
+    }
+    free(stack);
+    return groups;
+}
+
+/**************** align8 *****************/
+/*
+ * Round a file offset up to the next multiple of 8
+ */
+static uint64_t
+align8(uint64_t at)
+{
+    return (at + 7) / 8 * 8;
+}
+
+/**************** fits *****************/
+/*
+ * True if a section of size bytes at offset at is aligned and lies
+ * within a file of length bytes
+ */
+static bool
+fits(uint64_t at, uint64_t size, size_t length)
+{
+    return at % 8 == 0 && at <= length && size <= length - at;
+}
+
+/**************** writeAt *****************/
+/*
+ * Write size bytes at offset at of a file being written front to
+ * back, padding any gap before them with zeros; false on error
+ */
+static bool
+writeAt(FILE* fp, uint64_t at, const void* data, size_t size)
+{
+    long here = ftell(fp);
+    if (here < 0 || (uint64_t)here > at) {
+        return false;
+    }
+    for (; (uint64_t)here < at; here++) {
+        if (fputc('\0', fp) == EOF) {
+            return false;
+        }
+    }
+    return fwrite(data, 1, size, fp) == size;
+}
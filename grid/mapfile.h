@@ -0,0 +1,101 @@
+/*
+ * mapfile.h - compiled map files for the nuggets program
+ *
+ * A compiled map holds everything the server works out from a map
+ * text file, so a game can be set up by mapping the file instead of
+ * parsing it: the grid itself, in the ncol + 1 stride CELL expects,
+ * the floor cells players and gold are placed on, which room each
+ * floor cell belongs to, which connected component each floor or
+ * passage cell belongs to, and optionally the visibility table
+ * viscache would otherwise compute.
+ *
+ * The file is a mapHeader_t followed by its sections, each starting
+ * on a multiple of 8 bytes. Numbers are in the byte order of the
+ * machine that compiled the map; a map from a machine with the other
+ * order is refused rather than misread. grid_load and grid_loadMapped
+ * recognize a compiled map by its magic and load it in place of the
+ * text one; mapcompile writes them.
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+#ifndef MAPFILE_H
+#define MAPFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "grid.h"
+
+/************ Global Constants **************/
+// first bytes of every compiled map, format version included
+#define MAPFILE_MAGIC "NUGMAP1"
+// written as is, so a loader can tell the byte order matches
+static const uint32_t mapfile_Order = 0x01020304;
+
+/************ Global Structures **************/
+typedef struct mapHeader {
+    char magic[8];          // MAPFILE_MAGIC and '\0'
+    uint32_t order;         // mapfile_Order
+    int32_t nrow;
+    int32_t ncol;
+    int32_t numFloor;       // '.' cells
+    int32_t numRooms;       // rooms: '.' cells joined by moves over '.'
+    int32_t numComponents;  // '.' and '#' cells joined by moves over either
+    int32_t numOrigins;     // '.' and '#' cells, rows in the visibility table
+    int32_t visWords;       // 64-bit words per visibility row, 0 if no table
+    // byte offsets of the sections, from the start of the file
+    uint64_t gridAt;        // nrow * (ncol + 1) chars, '\n' ending each row
+    uint64_t floorAt;       // int32_t gridArray position of each floor cell
+    uint64_t roomsAt;       // int32_t room per cell (r * ncol + c), -1 if none
+    uint64_t componentsAt;  // int32_t component per cell, -1 if none
+    uint64_t visAt;         // a row per origin, origins in row-major order
+    uint64_t length;        // bytes in the whole file
+} mapHeader_t;
+
+/************ Global Functions **************/
+
+/**************** mapfile_write *****************/
+/*
+ * Compile a map into a file
+ *
+ * Inputs:
+ *   grid - a map loaded from its text file, as by grid_load
+ *   outFile - pathname of the compiled map to write
+ *   withVis - true to include the visibility table
+ *
+ * Output:
+ *   true if the whole file was written, false otherwise
+ *
+ * We do:
+ *   number the floor cells, label rooms and components with a
+ *   flood fill over the eight directions a player can move in, and,
+ *   with withVis, compute the field of view from every floor and
+ *   passage cell. The table grows with the square of the map's size.
+ *   The file is written as outFile.tmp and renamed over outFile, so a
+ *   grid still mapping the old one keeps it as it was
+ */
+bool mapfile_write(grid_t* grid, const char* outFile, bool withVis);
+
+/**************** mapfile_check *****************/
+/*
+ * Check that a mapped file is a compiled map this machine can use
+ *
+ * Inputs:
+ *   bytes - the mapped file
+ *   length - its length in bytes
+ *
+ * Output:
+ *   the header if the magic, byte order, sizes and section offsets
+ *   hold together and every floor position is on the grid; NULL
+ *   otherwise. Nothing else is read, so this costs next to nothing
+ */
+const mapHeader_t* mapfile_check(const char* bytes, size_t length);
+
+/**************** mapfile_isCompiled *****************/
+/*
+ * True if the bytes start like a compiled map, whether or not it is
+ * a valid one; a map text file never does
+ */
+bool mapfile_isCompiled(const char* bytes, size_t length);
+
+#endif
@@ -0,0 +1,351 @@
+/*
+ * shadowcast.c - shadowcasting field of view for the nuggets program
+ *
+ * see shadowcast.h for more detailed description
+ *
+ * Within one octant a cell is named by its depth d (rows or columns
+ * away from the origin) and offset m (0 <= m <= d) and a ray by its
+ * slope m/d. line_of_sight blocks a ray when
+ *   - it crosses depth line k (0 < k < d) inside a run of opaque
+ *     cells a..b on that line, i.e. the slope is in [a/k, b/k], or
+ *   - it crosses offset line x (x >= 1) between two opaque cells at
+ *     depths k and k+1, i.e. the slope is in (x/(k+1), x/k); the
+ *     endpoints are the cells themselves and are covered above.
+ * Both kinds of shadow only matter for cells deeper than k, so we
+ * add them to the shadow list once depth k has been lit.
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "../support/log.h"
+#include "grid.h"
+#include "shadowcast.h"
+
+/*
+ * CELL macros accesses cell position
+ * from a given row and column.
+ */
+#define CELL(grid,r,c) ((grid)->gridArray[(r)*((grid)->ncol + 1) + (c)])
+
+/************ local structures **************/
+/* a range of slopes lo..hi, each end a fraction that may be open */
+typedef struct span {
+    int loNum, loDen;
+    bool loOpen;
+    int hiNum, hiDen;
+    bool hiOpen;
+} span_t;
+
+/* a growable array of spans */
+typedef struct spanList {
+    span_t* spans;
+    int count;
+    int size;
+} spanList_t;
+
+/* one octant: a cell at (d, m) is at origin + d*depth + m*offset */
+typedef struct octant {
+    grid_t* grid;
+    int r0, c0;
+    int dr, dc;     // step for one unit of depth
+    int mr, mc;     // step for one unit of offset
+    int maxDepth;   // furthest depth still inside the grid
+    int maxOffset;  // furthest offset still inside the grid
+} octant_t;
+
+/************ local functions *************/
+static void castOctant(octant_t* oct, uint64_t* visible, spanList_t* shadows,
+                       spanList_t* gaps, spanList_t* fresh);
+static bool isOpaque(octant_t* oct, int d, int m);
+static int cmpFrac(int aNum, int aDen, int bNum, int bDen);
+static int cmpSpans(const void* a, const void* b);
+static bool addSpan(spanList_t* list, int loNum, int loDen, bool loOpen,
+                    int hiNum, int hiDen, bool hiOpen);
+static void mergeSpans(spanList_t* shadows, spanList_t* fresh);
+static void findGaps(spanList_t* shadows, spanList_t* gaps);
+static int floorDiv(long long num, long long den);
+static int ceilDiv(long long num, long long den);
+
+/************ global functions *************/
+
+/**************** shadowcast_fov *****************/
+/* see shadowcast.h for more detailed description */
+void
+shadowcast_fov(grid_t* grid, int r, int c, uint64_t* visible)
+{
+    if (grid == NULL || visible == NULL) {
+        log_v("shadowcast_fov: NULL grid or bitset");
+        return;
+    }
+    int ncells = grid->nrow * grid->ncol;
+    memset(visible, 0, ((ncells + 63) / 64) * sizeof(uint64_t));
+    if (!is_within_bounds(grid, r, c)) {
+        return;
+    }
+    int origin = r * grid->ncol + c;
+    visible[origin / 64] |= (uint64_t)1 << (origin % 64);
+
+    spanList_t shadows = { NULL, 0, 0 };
+    spanList_t gaps = { NULL, 0, 0 };
+    spanList_t fresh = { NULL, 0, 0 };
+
+    // depth along +-rows with offset along +-columns, then the reverse
+    static const int dirs[4][2] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+    for (int i = 0; i < 4; i++) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            octant_t oct;
+            oct.grid = grid;
+            oct.r0 = r;
+            oct.c0 = c;
+            oct.dr = dirs[i][0];
+            oct.dc = dirs[i][1];
+            oct.mr = oct.dc * sign;  // perpendicular to depth
+            oct.mc = oct.dr * sign;
+            oct.maxDepth = oct.dr > 0 ? grid->nrow - 1 - r : oct.dr < 0 ? r
+                         : oct.dc > 0 ? grid->ncol - 1 - c : c;
+            oct.maxOffset = oct.mr > 0 ? grid->nrow - 1 - r : oct.mr < 0 ? r
+                          : oct.mc > 0 ? grid->ncol - 1 - c : c;
+            shadows.count = 0;
+            castOctant(&oct, visible, &shadows, &gaps, &fresh);
+        }
+    }
+
+    free(shadows.spans);
+    free(gaps.spans);
+    free(fresh.spans);
+}
+
+/************ local functions *************/
+
+/**************** castOctant *****************/
+/*
+ * Light one octant, depth by depth, until every slope is in shadow
+ * or we leave the grid
+ */
+static void
+castOctant(octant_t* oct, uint64_t* visible, spanList_t* shadows,
+           spanList_t* gaps, spanList_t* fresh)
+{
+    int ncol = oct->grid->ncol;
+
+    for (int d = 1; d <= oct->maxDepth; d++) {
+        findGaps(shadows, gaps);
+        if (gaps->count == 0) {
+            return;  // whole octant is dark from here on
+        }
+
+        fresh->count = 0;
+        for (int g = 0; g < gaps->count; g++) {
+            span_t* gap = &gaps->spans[g];
+
+            // light every cell at this depth whose slope is in the gap
+            long long lo = (long long)gap->loNum * d;
+            long long hi = (long long)gap->hiNum * d;
+            int first = gap->loOpen ? floorDiv(lo, gap->loDen) + 1 : ceilDiv(lo, gap->loDen);
+            int last = gap->hiOpen ? ceilDiv(hi, gap->hiDen) - 1 : floorDiv(hi, gap->hiDen);
+            if (last > oct->maxOffset) {
+                last = oct->maxOffset;
+            }
+            for (int m = first; m <= last; m++) {
+                int cell = (oct->r0 + d * oct->dr + m * oct->mr) * ncol
+                         + (oct->c0 + d * oct->dc + m * oct->mc);
+                visible[cell / 64] |= (uint64_t)1 << (cell % 64);
+            }
+
+            // runs of opaque cells on this depth line shade [a/d, b/d];
+            // one cell either side of the gap catches runs that span it
+            int from = floorDiv(lo, gap->loDen);
+            int to = ceilDiv(hi, gap->hiDen);
+            if (to > oct->maxOffset) {
+                to = oct->maxOffset;
+            }
+            for (int m = from; m <= to; m++) {
+                if (!isOpaque(oct, d, m)) {
+                    continue;
+                }
+                int a = m;
+                while (m + 1 <= to && isOpaque(oct, d, m + 1)) {
+                    m++;
+                }
+                addSpan(fresh, a, d, false, m, d, false);
+            }
+
+            // opaque pairs at depths d and d+1 on offset line x shade
+            // the open slopes (x/(d+1), x/d)
+            if (d + 1 <= oct->maxDepth) {
+                int xFrom = from > 1 ? from : 1;
+                int xTo = ceilDiv((long long)gap->hiNum * (d + 1), gap->hiDen);
+                if (xTo > oct->maxOffset) {
+                    xTo = oct->maxOffset;
+                }
+                for (int x = xFrom; x <= xTo; x++) {
+                    if (isOpaque(oct, d, x) && isOpaque(oct, d + 1, x)) {
+                        addSpan(fresh, x, d + 1, true, x, d, true);
+                    }
+                }
+            }
+        }
+        mergeSpans(shadows, fresh);
+    }
+}
+
+/**************** isOpaque *****************/
+/*
+ * Return true if the cell at (d, m) of the octant blocks light;
+ * cells outside the grid never do, as in line_of_sight
+ */
+static bool
+isOpaque(octant_t* oct, int d, int m)
+{
+    int r = oct->r0 + d * oct->dr + m * oct->mr;
+    int c = oct->c0 + d * oct->dc + m * oct->mc;
+    if (!is_within_bounds(oct->grid, r, c)) {
+        return false;
+    }
+    return !grid_transparent[(unsigned char)CELL(oct->grid, r, c)];
+}
+
+/**************** cmpFrac *****************/
+/*
+ * Compare aNum/aDen with bNum/bDen (denominators positive)
+ */
+static int
+cmpFrac(int aNum, int aDen, int bNum, int bDen)
+{
+    long long left = (long long)aNum * bDen;
+    long long right = (long long)bNum * aDen;
+    return (left > right) - (left < right);
+}
+
+/**************** cmpSpans *****************/
+/*
+ * qsort comparator: by low end, closed ends before open ones
+ */
+static int
+cmpSpans(const void* a, const void* b)
+{
+    const span_t* x = a;
+    const span_t* y = b;
+    int cmp = cmpFrac(x->loNum, x->loDen, y->loNum, y->loDen);
+    if (cmp != 0) {
+        return cmp;
+    }
+    return (int)x->loOpen - (int)y->loOpen;
+}
+
+/**************** addSpan *****************/
+/*
+ * Append a span clipped to slopes [0, 1]; return false if it was
+ * empty after clipping or we ran out of memory
+ */
+static bool
+addSpan(spanList_t* list, int loNum, int loDen, bool loOpen,
+        int hiNum, int hiDen, bool hiOpen)
+{
+    if (cmpFrac(loNum, loDen, 0, 1) < 0) {
+        loNum = 0; loDen = 1; loOpen = false;
+    }
+    if (cmpFrac(hiNum, hiDen, 1, 1) > 0) {
+        hiNum = 1; hiDen = 1; hiOpen = false;
+    }
+    int cmp = cmpFrac(loNum, loDen, hiNum, hiDen);
+    if (cmp > 0 || (cmp == 0 && (loOpen || hiOpen))) {
+        return false;
+    }
+    if (list->count == list->size) {
+        int size = list->size > 0 ? list->size * 2 : 16;
+        span_t* spans = realloc(list->spans, size * sizeof(span_t));
+        if (spans == NULL) {
+            log_e("Error: could not grow shadow list");
+            return false;
+        }
+        list->spans = spans;
+        list->size = size;
+    }
+    span_t* span = &list->spans[list->count++];
+    span->loNum = loNum; span->loDen = loDen; span->loOpen = loOpen;
+    span->hiNum = hiNum; span->hiDen = hiDen; span->hiOpen = hiOpen;
+    return true;
+}
+
+/**************** mergeSpans *****************/
+/*
+ * Add the fresh spans to the shadow list and merge everything into
+ * sorted, disjoint spans
+ */
+static void
+mergeSpans(spanList_t* shadows, spanList_t* fresh)
+{
+    for (int i = 0; i < fresh->count; i++) {
+        span_t* s = &fresh->spans[i];
+        addSpan(shadows, s->loNum, s->loDen, s->loOpen, s->hiNum, s->hiDen, s->hiOpen);
+    }
+    if (shadows->count < 2) {
+        return;
+    }
+    qsort(shadows->spans, shadows->count, sizeof(span_t), cmpSpans);
+
+    int out = 0;
+    for (int i = 1; i < shadows->count; i++) {
+        span_t* last = &shadows->spans[out];
+        span_t* next = &shadows->spans[i];
+        int touch = cmpFrac(next->loNum, next->loDen, last->hiNum, last->hiDen);
+        if (touch < 0 || (touch == 0 && !(last->hiOpen && next->loOpen))) {
+            // overlapping or meeting: extend last if next reaches further
+            int cmp = cmpFrac(next->hiNum, next->hiDen, last->hiNum, last->hiDen);
+            if (cmp > 0) {
+                last->hiNum = next->hiNum;
+                last->hiDen = next->hiDen;
+                last->hiOpen = next->hiOpen;
+            } else if (cmp == 0) {
+                last->hiOpen = last->hiOpen && next->hiOpen;
+            }
+        } else {
+            shadows->spans[++out] = *next;
+        }
+    }
+    shadows->count = out + 1;
+}
+
+/**************** findGaps *****************/
+/*
+ * Fill gaps with the lit slopes of [0, 1], i.e. everything the
+ * sorted, disjoint shadows do not cover
+ */
+static void
+findGaps(spanList_t* shadows, spanList_t* gaps)
+{
+    gaps->count = 0;
+    int num = 0, den = 1;
+    bool open = false;
+    for (int i = 0; i < shadows->count; i++) {
+        span_t* s = &shadows->spans[i];
+        addSpan(gaps, num, den, open, s->loNum, s->loDen, !s->loOpen);
+        num = s->hiNum;
+        den = s->hiDen;
+        open = !s->hiOpen;
+    }
+    addSpan(gaps, num, den, open, 1, 1, false);
+}
+
+/**************** floorDiv *****************/
+/* floor(num / den) for num >= 0, den > 0 */
+static int
+floorDiv(long long num, long long den)
+{
+    return (int)(num / den);
+}
+
+/**************** ceilDiv *****************/
+/* ceil(num / den) for num >= 0, den > 0 */
+static int
+ceilDiv(long long num, long long den)
+{
+    return (int)((num + den - 1) / den);
+}
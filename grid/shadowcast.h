@@ -0,0 +1,38 @@
+/*
+ * shadowcast.h - shadowcasting field of view for the nuggets program
+ *
+ * Computes every cell visible from one origin in a single sweep
+ * instead of walking a separate ray to each cell. The sweep works
+ * octant by octant, moving one row (or column) further from the
+ * origin at a time and keeping a list of the slopes that are in
+ * shadow. Slopes are kept as exact fractions, so the visible set is
+ * identical to calling line_of_sight on every cell: a ray crossing a
+ * row or column line between two opaque cells, or exactly through an
+ * opaque cell, is blocked; floor, gold and players let light through.
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+#ifndef SHADOWCAST_H
+#define SHADOWCAST_H
+
+#include <stdint.h>
+#include "grid.h"
+
+/**************** shadowcast_fov *****************/
+/*
+ * Compute the field of view from one cell
+ *
+ * Inputs:
+ *   grid - pointer to grid struct whose cells block light
+ *   r - row position of origin
+ *   c - column position of origin
+ *   visible - bitset of (nrow * ncol + 63) / 64 words
+ *
+ * We do:
+ *   clear the bitset, then set bit (r * ncol + c) for every
+ *   cell in line of sight of the origin, origin included
+ */
+void shadowcast_fov(grid_t* grid, int r, int c, uint64_t* visible);
+
+#endif
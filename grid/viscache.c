@@ -0,0 +1,282 @@
+/*
+ * viscache.c - visibility cache for the nuggets program
+ *
+ * see viscache.h for more detailed description
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "../support/log.h"
+#include "grid.h"
+#include "viscache.h"
+
+/************ local structures **************/
+typedef struct viscache {
+    grid_t* grid;       // original map the rows are computed from
+    int ncells;         // nrow * ncol
+    int words;          // 64-bit words per bitset row
+    int numOrigins;     // number of floor/passage cells
+    int* originOf;      // cell index -> origin index, or -1
+    int* originCell;    // origin index -> cell index
+    uint64_t* rows;     // numSlots rows of bitsets
+    int numSlots;       // rows we have room for
+    bool full;          // true if every origin owns a slot
+    bool adopted;       // rows belong to a compiled map, not to the cache
+    // LRU bookkeeping, only used when !full
+    int* slotOf;        // origin index -> slot, or -1
+    int* ownerOf;       // slot -> origin index, or -1
+    int* prev;          // slot -> more recently used slot, or -1
+    int* next;          // slot -> less recently used slot, or -1
+    int head;           // most recently used slot
+    int tail;           // least recently used slot
+} viscache_t;
+
+/************ local functions *************/
+static void fillRow(viscache_t* cache, int origin, uint64_t* row);
+static void touchSlot(viscache_t* cache, int slot);
+static viscache_t* newIndex(grid_t* grid);
+
+/************ global functions *************/
+
+/**************** viscache_new *****************/
+/* see viscache.h for more detailed description */
+viscache_t*
+viscache_new(grid_t* grid, size_t budget)
+{
+    if (grid == NULL) {
+        log_v("viscache_new: grid is NULL");
+        return NULL;
+    }
+    viscache_t* cache = newIndex(grid);
+    if (cache == NULL) {
+        return NULL;
+    }
+
+    // decide between the full table and LRU mode
+    size_t rowBytes = cache->words * sizeof(uint64_t);
+    size_t fitting = budget / rowBytes;
+    if (fitting >= (size_t)cache->numOrigins) {
+        cache->full = true;
+        cache->numSlots = cache->numOrigins;
+    } else {
+        cache->full = false;
+        cache->numSlots = fitting > 0 ? (int)fitting : 1;
+    }
+    cache->rows = malloc((cache->numSlots > 0 ? cache->numSlots : 1) * rowBytes);
+    if (cache->rows == NULL) {
+        log_e("Error: could not allocate visibility cache rows");
+        viscache_delete(cache);
+        return NULL;
+    }
+
+    if (cache->full) {
+        for (int o = 0; o < cache->numOrigins; o++) {
+            fillRow(cache, o, &cache->rows[(size_t)o * cache->words]);
+        }
+        log_d("Visibility cache precomputed %d rows", cache->numOrigins);
+        return cache;
+    }
+
+    // budget mode: all slots start empty and chained in LRU order
+    cache->slotOf = malloc(cache->numOrigins * sizeof(int));
+    cache->ownerOf = malloc(cache->numSlots * sizeof(int));
+    cache->prev = malloc(cache->numSlots * sizeof(int));
+    cache->next = malloc(cache->numSlots * sizeof(int));
+    if (cache->slotOf == NULL || cache->ownerOf == NULL
+            || cache->prev == NULL || cache->next == NULL) {
+        log_e("Error: could not allocate visibility cache LRU");
+        viscache_delete(cache);
+        return NULL;
+    }
+    for (int o = 0; o < cache->numOrigins; o++) {
+        cache->slotOf[o] = -1;
+    }
+    for (int s = 0; s < cache->numSlots; s++) {
+        cache->ownerOf[s] = -1;
+        cache->prev[s] = s - 1;
+        cache->next[s] = (s + 1 < cache->numSlots) ? s + 1 : -1;
+    }
+    cache->head = 0;
+    cache->tail = cache->numSlots - 1;
+    log_d("Visibility cache in budget mode with %d rows", cache->numSlots);
+    return cache;
+}
+
+/**************** viscache_adopt *****************/
+/* see viscache.h for more detailed description */
+viscache_t*
+viscache_adopt(grid_t* grid, const uint64_t* table, int numRows)
+{
+    if (grid == NULL || table == NULL) {
+        log_v("viscache_adopt: grid or table is NULL");
+        return NULL;
+    }
+    viscache_t* cache = newIndex(grid);
+    if (cache == NULL) {
+        return NULL;
+    }
+    if (cache->numOrigins != numRows) {
+        log_v("viscache_adopt: the table does not match the grid");
+        viscache_delete(cache);
+        return NULL;
+    }
+    // the table is never written through, only handed out as const
+    cache->rows = (uint64_t*)table;
+    cache->adopted = true;
+    cache->full = true;
+    cache->numSlots = cache->numOrigins;
+    log_d("Visibility cache adopted %d precomputed rows", cache->numOrigins);
+    return cache;
+}
+
+/**************** viscache_get *****************/
+/* see viscache.h for more detailed description */
+const uint64_t*
+viscache_get(viscache_t* cache, int r, int c)
+{
+    if (cache == NULL || !is_within_bounds(cache->grid, r, c)) {
+        return NULL;
+    }
+    int origin = cache->originOf[r * cache->grid->ncol + c];
+    if (origin < 0) {
+        return NULL;
+    }
+    if (cache->full) {
+        return &cache->rows[(size_t)origin * cache->words];
+    }
+
+    // budget mode: hit moves the row to the front, miss reuses the tail
+    int slot = cache->slotOf[origin];
+    if (slot < 0) {
+        slot = cache->tail;
+        if (cache->ownerOf[slot] >= 0) {
+            cache->slotOf[cache->ownerOf[slot]] = -1;
+        }
+        cache->ownerOf[slot] = origin;
+        cache->slotOf[origin] = slot;
+        fillRow(cache, origin, &cache->rows[(size_t)slot * cache->words]);
+    }
+    touchSlot(cache, slot);
+    return &cache->rows[(size_t)slot * cache->words];
+}
+
+/**************** viscache_words *****************/
+/* see viscache.h for more detailed description */
+int
+viscache_words(viscache_t* cache)
+{
+    return cache == NULL ? 0 : cache->words;
+}
+
+/**************** viscache_isFull *****************/
+/* see viscache.h for more detailed description */
+bool
+viscache_isFull(viscache_t* cache)
+{
+    return cache != NULL && cache->full;
+}
+
+/**************** viscache_delete *****************/
+/* see viscache.h for more detailed description */
+void
+viscache_delete(viscache_t* cache)
+{
+    if (cache != NULL) {
+        free(cache->originOf);
+        free(cache->originCell);
+        if (!cache->adopted) {
+            free(cache->rows);
+        }
+        free(cache->slotOf);
+        free(cache->ownerOf);
+        free(cache->prev);
+        free(cache->next);
+        free(cache);
+    }
+}
+
+/************ local functions *************/
+
+/**************** newIndex *****************/
+/*
+ * Allocate a cache for a grid with no rows yet, numbering every floor
+ * and passage cell as an origin in row-major order; NULL on error
+ */
+static viscache_t*
+newIndex(grid_t* grid)
+{
+    viscache_t* cache = calloc(1, sizeof(viscache_t));
+    if (cache == NULL) {
+        log_e("Error: could not allocate visibility cache");
+        return NULL;
+    }
+    cache->grid = grid;
+    cache->ncells = grid->nrow * grid->ncol;
+    cache->words = (cache->ncells + 63) / 64;
+    cache->originOf = malloc(cache->ncells * sizeof(int));
+    cache->originCell = malloc(cache->ncells * sizeof(int));
+    if (cache->originOf == NULL || cache->originCell == NULL) {
+        log_e("Error: could not allocate visibility cache index");
+        viscache_delete(cache);
+        return NULL;
+    }
+
+    // every floor or passage cell is somewhere a player can stand
+    for (int r = 0; r < grid->nrow; r++) {
+        for (int c = 0; c < grid->ncol; c++) {
+            int cell = r * grid->ncol + c;
+            char ch = grid_getCell(grid, r, c);
+            if (ch == '.' || ch == '#') {
+                cache->originOf[cell] = cache->numOrigins;
+                cache->originCell[cache->numOrigins++] = cell;
+            } else {
+                cache->originOf[cell] = -1;
+            }
+        }
+    }
+    return cache;
+}
+
+/**************** fillRow *****************/
+/*
+ * Compute the bitset of cells visible from one origin
+ */
+static void
+fillRow(viscache_t* cache, int origin, uint64_t* row)
+{
+    grid_t* grid = cache->grid;
+    int cell = cache->originCell[origin];
+    grid_fieldOfView(grid, cell / grid->ncol, cell % grid->ncol, row);
+}
+
+/**************** touchSlot *****************/
+/*
+ * Move a slot to the most recently used end of the LRU list
+ */
+static void
+touchSlot(viscache_t* cache, int slot)
+{
+    if (cache->head == slot) {
+        return;
+    }
+    // unlink
+    if (cache->prev[slot] >= 0) {
+        cache->next[cache->prev[slot]] = cache->next[slot];
+    }
+    if (cache->next[slot] >= 0) {
+        cache->prev[cache->next[slot]] = cache->prev[slot];
+    }
+    if (cache->tail == slot) {
+        cache->tail = cache->prev[slot];
+    }
+    // push on front
+    cache->prev[slot] = -1;
+    cache->next[slot] = cache->head;
+    cache->prev[cache->head] = slot;
+    cache->head = slot;
+}
@@ -0,0 +1,110 @@
+/*
+ * viscache.h - visibility cache header file for the nuggets program
+ *
+ * The walls of a map never move, so whether one cell can see another
+ * only depends on the original map layout. This module stores, for
+ * every floor ('.') and passage ('#') cell, a bitset with one bit per
+ * grid cell that is set when that cell is in line of sight.
+ *
+ * If the full table fits in the memory budget it is precomputed when
+ * the cache is created. Otherwise the cache keeps as many rows as the
+ * budget allows, fills them on first use and evicts the least recently
+ * used row when it needs room for a new one.
+ *
+ * Team Big D Nuggies
+ * Jake Fleming, Fall 2024
+ */
+#ifndef VISCACHE_H
+#define VISCACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "grid.h"
+
+/************ Global Constants **************/
+// default number of bytes the cache may spend on bitset rows
+static const size_t viscache_DefaultBudget = 16 * 1024 * 1024;
+
+/************ Global Structures **************/
+typedef struct viscache viscache_t;  // opaque to users of this module
+
+/************ Global Functions **************/
+
+/**************** viscache_new *****************/
+/*
+ * Create a visibility cache for a grid
+ *
+ * Inputs:
+ *   grid - pointer to the original (unchanging) map grid
+ *   budget - maximum bytes to spend on bitset rows
+ *
+ * Output:
+ *   initialized cache, or NULL on error
+ *
+ * We do:
+ *   precompute every row if the whole table fits in budget,
+ *   otherwise set up an LRU of as many rows as will fit
+ *
+ * The grid must outlive the cache. User is responsible for
+ * calling viscache_delete later
+ */
+viscache_t* viscache_new(grid_t* grid, size_t budget);
+
+/**************** viscache_adopt *****************/
+/*
+ * Create a full cache around a table computed ahead of time
+ *
+ * Inputs:
+ *   grid - pointer to the original (unchanging) map grid
+ *   table - one row of viscache_words() words per floor and passage
+ *           cell, in row-major order, as a compiled map holds it
+ *   numRows - rows in the table
+ *
+ * Output:
+ *   initialized cache in full mode, or NULL if numRows is not the
+ *   grid's number of floor and passage cells (or on error)
+ *
+ * The table is used where it is, never copied, written or freed, so
+ * it must outlive the cache. User is responsible for calling
+ * viscache_delete later
+ */
+viscache_t* viscache_adopt(grid_t* grid, const uint64_t* table, int numRows);
+
+/**************** viscache_get *****************/
+/*
+ * Provide caller the visibility bitset for an origin cell
+ *
+ * Inputs:
+ *   cache - pointer to cache
+ *   r - row position of origin
+ *   c - column position of origin
+ *
+ * Output:
+ *   pointer to viscache_words() words where bit (r*ncol + c) is set
+ *   if that cell is visible from the origin, or NULL if the origin
+ *   is not a floor or passage cell. In budget mode the pointer is
+ *   only valid until the next call to viscache_get
+ */
+const uint64_t* viscache_get(viscache_t* cache, int r, int c);
+
+/**************** viscache_words *****************/
+/*
+ * Provide caller the number of 64-bit words in one bitset row
+ */
+int viscache_words(viscache_t* cache);
+
+/**************** viscache_isFull *****************/
+/*
+ * Return true if the whole table was precomputed,
+ * false if the cache is running in budget (LRU) mode
+ */
+bool viscache_isFull(viscache_t* cache);
+
+/**************** viscache_delete *****************/
+/*
+ * Free the memory allocated for a cache
+ */
+void viscache_delete(viscache_t* cache);
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ * loadtest.c - load test for the server's message handling
+ *
+ * Starts ./server on a map once with '-io select' and once with
+ * '-io mmsg', joins it with a number of simulated players (26 by
+ * default, a full game; the server is told to take as many as there
+ * are), and has every player press keys as fast as
+ * the server answers for a few seconds. Each player steps back and
+ * forth between two cells so the game never runs out of gold, answers
+ * GRID with "ACK 0 RLE BATCH" like our client, and ACKs every frame.
+ *
+ * For each mode it prints the keys the server answered per second (a
+ * key is answered once a frame shows its player's '@' somewhere new;
+ * frames sent because someone else moved in sight don't count), the
+ * frames per second players got, and the datagrams per second it
+ * received and sent. A player whose key goes unanswered for a while
+ * presses again.
+ *
+ * usage: ./loadtest map.txt [players] [seconds]
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#define _GNU_SOURCE     // for poll, kill and clock_gettime
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include "message.h"
+#include "batch.h"
+#include "delta.h"
+
+/**************** file-local constants ****************/
+static const int DefaultPlayers = 26;   // players in a full game, by default
+static const int MaxLoadPlayers = 1000; // one socket each, so under the usual file limit
+static const int StallMillis = 20;      // press again if a key is unanswered this long
+
+/**************** local types ****************/
+typedef struct loadPlayer {
+  int socket;           // this player's own UDP socket
+  bool joined;          // got GRID, and ACKed it
+  bool answered;        // a frame moved our '@' since the last key we pressed
+  double pressedAt;     // when we pressed that key
+  int nextKey;          // 0 steps left, 1 steps right
+  delta_t* history;     // decodes our frames, as the client does
+  int position;         // where our '@' is in the last frame, -1 before one
+  long frames;          // KEYFRAME/DELTA/DISPLAY messages received
+  long keys;            // keys answered
+  long datagrams;       // datagrams received
+  long sent;            // datagrams sent (keys and ACKs)
+} loadPlayer_t;
+
+/**************** file-local functions ****************/
+static pid_t startServer(const char* map, const char* mode, const int numPlayers,
+                         int* port, FILE** out);
+static bool runLoad(const char* map, const char* mode, const int numPlayers, const int seconds);
+static bool handleLoadMessage(void* arg, const addr_t from, const char* message);
+static void sendTo(loadPlayer_t* player, const addr_t to, const char* message);
+static void seeFrame(loadPlayer_t* player, const char* frame);
+static double now(void);
+
+/**************** main ****************/
+int
+main(const int argc, char* argv[])
+{
+  if (argc < 2 || argc > 4) {
+    fprintf(stderr, "usage: %s map.txt [players] [seconds]\n", argv[0]);
+    return 1;
+  }
+  int numPlayers = argc > 2 ? atoi(argv[2]) : DefaultPlayers;
+  int seconds = argc > 3 ? atoi(argv[3]) : 5;
+  if (numPlayers < 1 || numPlayers > MaxLoadPlayers || seconds < 1) {
+    fprintf(stderr, "players must be 1-%d and seconds positive\n", MaxLoadPlayers);
+    return 1;
+  }
+
+  printf("%d players for %d seconds on %s\n", numPlayers, seconds, argv[1]);
+  bool ok = runLoad(argv[1], "select", numPlayers, seconds)
+         && runLoad(argv[1], "mmsg", numPlayers, seconds);
+  return ok ? 0 : 1;
+}
+
+/**************** runLoad ****************/
+/* Run one server in the given -io mode under load and print its rates. */
+static bool
+runLoad(const char* map, const char* mode, const int numPlayers, const int seconds)
+{
+  int port;
+  FILE* serverOut;
+  pid_t server = startServer(map, mode, numPlayers, &port, &serverOut);
+  if (server < 0) {
+    return false;
+  }
+  addr_t serverAddr;
+  char portString[16];
+  snprintf(portString, sizeof(portString), "%d", port);
+  if (!message_setAddr("localhost", portString, &serverAddr)) {
+    kill(server, SIGTERM);
+    fclose(serverOut);
+    return false;
+  }
+
+  loadPlayer_t players[numPlayers];
+  struct pollfd fds[numPlayers];
+  memset(players, 0, sizeof(players));
+  for (int i = 0; i < numPlayers; i++) {
+    players[i].position = -1;
+    players[i].socket = socket(AF_INET, SOCK_DGRAM, 0);
+    int bufferSize = 4 << 20;
+    setsockopt(players[i].socket, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+    fds[i].fd = players[i].socket;
+    fds[i].events = POLLIN;
+    char play[32];
+    snprintf(play, sizeof(play), "PLAY load%d", i);
+    sendTo(&players[i], serverAddr, play);
+  }
+
+  char* buf = malloc(message_MaxBytes);
+  double start = 0, stop = 0;
+  long startKeys = 0, startFrames = 0, startReceived = 0, startSent = 0;
+  bool measuring = false;
+  while (!measuring || now() < stop) {
+    int ready = poll(fds, numPlayers, StallMillis);
+    for (int i = 0; i < numPlayers; i++) {
+      loadPlayer_t* player = &players[i];
+      if (ready > 0 && (fds[i].revents & POLLIN)) {
+        int nbytes;
+        while ((nbytes = recv(player->socket, buf, message_MaxBytes - 1, MSG_DONTWAIT)) >= 0) {
+          buf[nbytes] = '\0';
+          player->datagrams++;
+          if (strncmp(buf, "BATCH ", strlen("BATCH ")) == 0) {
+            batch_split(buf, handleLoadMessage, player, serverAddr);
+          } else {
+            handleLoadMessage(player, serverAddr, buf);
+          }
+        }
+      }
+      // press the next key once the last one was answered, or it seems
+      // lost (or the step was into a wall, which nobody is told about)
+      double time = now();
+      if (player->joined
+          && (player->answered || time - player->pressedAt > StallMillis / 1000.0)) {
+        player->keys += player->answered;
+        sendTo(player, serverAddr, player->nextKey == 0 ? "KEY h" : "KEY l");
+        player->nextKey = !player->nextKey;
+        player->answered = false;
+        player->pressedAt = time;
+      }
+    }
+
+    // start the clock once everyone is in
+    if (!measuring) {
+      int joined = 0;
+      for (int i = 0; i < numPlayers; i++) {
+        joined += players[i].joined;
+      }
+      if (joined == numPlayers) {
+        measuring = true;
+        start = now();
+        stop = start + seconds;
+        for (int i = 0; i < numPlayers; i++) {
+          startKeys += players[i].keys;
+          startFrames += players[i].frames;
+          startReceived += players[i].datagrams;
+          startSent += players[i].sent;
+        }
+      } else if (start == 0) {
+        start = now();
+      } else if (now() - start > 5) {
+        fprintf(stderr, "only %d of %d players could join\n", joined, numPlayers);
+        break;
+      }
+    }
+  }
+  double elapsed = now() - start;
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+  fclose(serverOut);
+  free(buf);
+  long keys = -startKeys, frames = -startFrames, received = -startReceived, sent = -startSent;
+  for (int i = 0; i < numPlayers; i++) {
+    keys += players[i].keys;
+    frames += players[i].frames;
+    delta_delete(players[i].history);
+    received += players[i].datagrams;
+    sent += players[i].sent;
+    close(players[i].socket);
+  }
+  if (!measuring) {
+    return false;
+  }
+  printf("-io %-6s  %8.0f keys/s  %8.0f frames/s  %8.0f datagrams/s in  %8.0f datagrams/s out\n",
+         mode, keys / elapsed, frames / elapsed, sent / elapsed, received / elapsed);
+  return true;
+}
+
+/**************** handleLoadMessage ****************/
+/* Answer one message from the server the way our client would. */
+static bool
+handleLoadMessage(void* arg, const addr_t from, const char* message)
+{
+  loadPlayer_t* player = arg;
+  int nrow, ncol;
+  if (sscanf(message, "GRID %d %d", &nrow, &ncol) == 2) {
+    delta_delete(player->history);
+    player->history = delta_new(nrow, ncol);
+    sendTo(player, from, "ACK 0 RLE BATCH");
+    player->joined = true;
+    player->answered = true;
+  } else if (strncmp(message, "KEYFRAME ", strlen("KEYFRAME ")) == 0
+             || strncmp(message, "DELTA ", strlen("DELTA ")) == 0) {
+    int seq = delta_decode(player->history, message);
+    char ack[32];
+    snprintf(ack, sizeof(ack), "ACK %d", seq);
+    sendTo(player, from, ack);
+    if (seq > 0) {
+      seeFrame(player, delta_frame(player->history));
+    }
+  } else if (strncmp(message, "DISPLAY\n", strlen("DISPLAY\n")) == 0) {
+    seeFrame(player, message + strlen("DISPLAY\n"));
+  }
+  return false;
+}
+
+/**************** seeFrame ****************/
+/* Count a frame, and answer our key if it shows our '@' has moved. */
+static void
+seeFrame(loadPlayer_t* player, const char* frame)
+{
+  player->frames++;
+  const char* at = strchr(frame, '@');
+  int position = at == NULL ? -1 : at - frame;
+  if (position != player->position) {
+    player->answered = player->position >= 0;
+    player->position = position;
+  }
+}
+
+/**************** sendTo ****************/
+/* Send a message from this player's socket, counting it. */
+static void
+sendTo(loadPlayer_t* player, const addr_t to, const char* message)
+{
+  if (sendto(player->socket, message, strlen(message), 0,
+             (const struct sockaddr*) &to, sizeof(to)) >= 0) {
+    player->sent++;
+  }
+}
+
+/**************** startServer ****************/
+/* Start ./server on map with '-io mode' and room for numPlayers in one
+ * game, its log thrown away, and read the port it announces on stdout, which the caller closes once the
+ * server is gone. Return its pid, or -1 on error.
+ */
+static pid_t
+startServer(const char* map, const char* mode, const int numPlayers,
+            int* port, FILE** out)
+{
+  char players[16];
+  snprintf(players, sizeof(players), "%d", numPlayers);
+  int pipeFds[2];
+  if (pipe(pipeFds) < 0) {
+    perror("pipe");
+    return -1;
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return -1;
+  }
+  if (pid == 0) {
+    dup2(pipeFds[1], STDOUT_FILENO);
+    close(pipeFds[0]);
+    if (freopen("/dev/null", "w", stderr) == NULL) {
+      _exit(1);
+    }
+    execl("./server", "./server", map, "1", "-io", mode, "-players", players, (char*) NULL);
+    _exit(1);
+  }
+  close(pipeFds[1]);
+  *out = fdopen(pipeFds[0], "r");
+  char line[200];
+  *port = 0;
+  while (*port == 0 && fgets(line, sizeof(line), *out) != NULL) {
+    sscanf(line, "Ready to play, waiting at port '%d'", port);
+  }
+  if (*port == 0) {
+    fprintf(stderr, "./server did not start\n");
+    fclose(*out);
+    waitpid(pid, NULL, 0);
+    return -1;
+  }
+  return pid;
+}
+
+/**************** now ****************/
+/* Seconds on a monotonic clock. */
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
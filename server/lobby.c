@@ -0,0 +1,268 @@
+/*
+ * lobby - route clients to the games one server is hosting
+ *
+ * see lobby.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "message.h"
+#include "addrmap.h"
+#include "lobby.h"
+
+/**************** local types ****************/
+typedef struct lobby {
+  void** games;       // maxGames slots, NULL where there is no game
+  int maxGames;
+  int numGames;
+  int newest;         // slot of the last game added, -1 once it is removed
+  addrmap_t* routes;  // client address to its game's slot
+} lobby_t;
+
+/**************** lobby_new ****************/
+/* see lobby.h for description */
+lobby_t*
+lobby_new(const int maxGames)
+{
+  if (maxGames <= 0) {
+    return NULL;
+  }
+  lobby_t* lobby = calloc(1, sizeof(lobby_t));
+  if (lobby == NULL) {
+    return NULL;
+  }
+  lobby->games = calloc(maxGames, sizeof(void*));
+  lobby->routes = addrmap_new();
+  if (lobby->games == NULL || lobby->routes == NULL) {
+    free(lobby->games);
+    addrmap_delete(lobby->routes);
+    free(lobby);
+    return NULL;
+  }
+  lobby->maxGames = maxGames;
+  lobby->newest = -1;
+  return lobby;
+}
+
+/**************** lobby_addGame ****************/
+/* see lobby.h for description */
+int
+lobby_addGame(lobby_t* lobby, void* game)
+{
+  if (lobby == NULL || game == NULL || lobby->numGames == lobby->maxGames) {
+    return -1;
+  }
+  for (int slot = 0; slot < lobby->maxGames; slot++) {
+    if (lobby->games[slot] == NULL) {
+      lobby->games[slot] = game;
+      lobby->numGames++;
+      lobby->newest = slot;
+      return slot;
+    }
+  }
+  return -1;
+}
+
+/**************** lobby_removeGame ****************/
+/* see lobby.h for description */
+void*
+lobby_removeGame(lobby_t* lobby, const int slot)
+{
+  if (lobby == NULL || slot < 0 || slot >= lobby->maxGames || lobby->games[slot] == NULL) {
+    return NULL;
+  }
+  void* game = lobby->games[slot];
+  lobby->games[slot] = NULL;
+  lobby->numGames--;
+  if (lobby->newest == slot) {
+    lobby->newest = -1;
+  }
+  addrmap_removeValue(lobby->routes, slot);
+  return game;
+}
+
+/**************** lobby_getGame ****************/
+/* see lobby.h for description */
+void*
+lobby_getGame(lobby_t* lobby, const int slot)
+{
+  if (lobby == NULL || slot < 0 || slot >= lobby->maxGames) {
+    return NULL;
+  }
+  return lobby->games[slot];
+}
+
+/**************** lobby_newest ****************/
+/* see lobby.h for description */
+int
+lobby_newest(lobby_t* lobby)
+{
+  return lobby == NULL ? -1 : lobby->newest;
+}
+
+/**************** lobby_numGames ****************/
+/* see lobby.h for description */
+int
+lobby_numGames(lobby_t* lobby)
+{
+  return lobby == NULL ? 0 : lobby->numGames;
+}
+
+/**************** lobby_maxGames ****************/
+/* see lobby.h for description */
+int
+lobby_maxGames(lobby_t* lobby)
+{
+  return lobby == NULL ? 0 : lobby->maxGames;
+}
+
+/**************** lobby_route ****************/
+/* see lobby.h for description */
+int
+lobby_route(lobby_t* lobby, const addr_t address)
+{
+  if (lobby == NULL) {
+    return -1;
+  }
+  return addrmap_get(lobby->routes, address);
+}
+
+/**************** lobby_join ****************/
+/* see lobby.h for description */
+bool
+lobby_join(lobby_t* lobby, const addr_t address, const int slot)
+{
+  if (lobby_getGame(lobby, slot) == NULL) {
+    return false;
+  }
+  return addrmap_put(lobby->routes, address, slot);
+}
+
+/**************** lobby_leave ****************/
+/* see lobby.h for description */
+void
+lobby_leave(lobby_t* lobby, const addr_t address)
+{
+  if (lobby == NULL) {
+    return;
+  }
+  addrmap_remove(lobby->routes, address);
+}
+
+/**************** lobby_delete ****************/
+/* see lobby.h for description */
+void
+lobby_delete(lobby_t* lobby, void (*deleteGame)(void* game))
+{
+  if (lobby != NULL) {
+    for (int slot = 0; slot < lobby->maxGames; slot++) {
+      if (lobby->games[slot] != NULL && deleteGame != NULL) {
+        (*deleteGame)(lobby->games[slot]);
+      }
+    }
+    free(lobby->games);
+    addrmap_delete(lobby->routes);
+    free(lobby);
+  }
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test checks what the lobby adds to the route table, with a
+ * handful of addresses: joining only games that exist, removing a game
+ * dropping its routes and nobody else's, reusing the freed slot, and
+ * what lobby_newest says as games come and go.
+ *
+ *   ./lobbytest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+static int deleted;
+static void countDelete(void* game) { deleted++; }
+
+// the made-up client i, on a port of its own
+static addr_t
+testAddress(const int i)
+{
+  addr_t address = { 0 };
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(0x7F000001);
+  address.sin_port = htons(40000 + i);
+  return address;
+}
+
+int
+main(const int argc, char* argv[])
+{
+  int failures = 0;
+  int games[4];
+
+  CHECK(lobby_new(0) == NULL);
+  lobby_t* lobby = lobby_new(3);
+  CHECK(lobby != NULL);
+  CHECK(lobby_newest(lobby) == -1);
+
+  // an empty slot, or one past the end, takes nobody
+  CHECK(!lobby_join(lobby, testAddress(0), 0));
+  CHECK(!lobby_join(lobby, testAddress(0), 3));
+  CHECK(lobby_route(lobby, testAddress(0)) == -1);
+
+  // three games fill the slots in order; the last one is the newest
+  for (int g = 0; g < 3; g++) {
+    CHECK(lobby_addGame(lobby, &games[g]) == g);
+    CHECK(lobby_newest(lobby) == g);
+  }
+  CHECK(lobby_addGame(lobby, &games[3]) == -1);
+  CHECK(lobby_numGames(lobby) == 3);
+
+  // two clients in each game; client 5 moves from game 2 to game 0
+  for (int i = 0; i < 6; i++) {
+    CHECK(lobby_join(lobby, testAddress(i), i / 2));
+  }
+  CHECK(lobby_join(lobby, testAddress(5), 0));
+  CHECK(lobby_route(lobby, testAddress(5)) == 0);
+  lobby_leave(lobby, testAddress(4));
+  CHECK(lobby_route(lobby, testAddress(4)) == -1);
+
+  // game 1 ends: its two clients are newcomers again, nobody else moves
+  CHECK(lobby_removeGame(lobby, 1) == &games[1]);
+  CHECK(lobby_removeGame(lobby, 1) == NULL);
+  CHECK(lobby_getGame(lobby, 1) == NULL);
+  CHECK(lobby_route(lobby, testAddress(2)) == -1);
+  CHECK(lobby_route(lobby, testAddress(3)) == -1);
+  CHECK(lobby_route(lobby, testAddress(0)) == 0);
+  CHECK(lobby_route(lobby, testAddress(1)) == 0);
+  CHECK(lobby_route(lobby, testAddress(5)) == 0);
+  CHECK(!lobby_join(lobby, testAddress(2), 1));
+
+  // removing an older game leaves the newest alone; removing the
+  // newest leaves no newest, even with games still running
+  CHECK(lobby_newest(lobby) == 2);
+  CHECK(lobby_removeGame(lobby, 2) == &games[2]);
+  CHECK(lobby_newest(lobby) == -1);
+  CHECK(lobby_numGames(lobby) == 1);
+
+  // the first free slot is reused, becomes the newest, and starts with
+  // no routes from the game that had it
+  CHECK(lobby_addGame(lobby, &games[3]) == 1);
+  CHECK(lobby_newest(lobby) == 1);
+  CHECK(lobby_getGame(lobby, 1) == &games[3]);
+  CHECK(lobby_route(lobby, testAddress(2)) == -1);
+  CHECK(lobby_join(lobby, testAddress(2), 1));
+  CHECK(lobby_route(lobby, testAddress(2)) == 1);
+
+  lobby_delete(lobby, countDelete);
+  CHECK(deleted == 2);
+
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
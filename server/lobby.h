@@ -0,0 +1,113 @@
+/*
+ * lobby - route clients to the games one server is hosting
+ *
+ * Lets one server process host many independent games on one port.
+ * The lobby keeps up to maxGames games in numbered slots, and remembers
+ * which slot each client address belongs to in a hash table keyed by
+ * the address, so routing a datagram is one lookup however many games
+ * are running. A game is whatever the caller keeps for it (the server
+ * keeps its gamestatus_t and bookkeeping); the lobby only holds the
+ * pointer.
+ *
+ * Newcomers are usually sent to the newest game, which the lobby also
+ * remembers. When a game ends the caller removes it, which forgets
+ * every address routed to it and frees its slot for a new game.
+ *
+ * Typical use:
+ *   lobby = lobby_new(maxGames);
+ *   slot = lobby_addGame(lobby, game);
+ *   for each datagram:
+ *     slot = lobby_route(lobby, from);      // -1 for a newcomer
+ *     ... pick a game for a newcomer, handle the message ...
+ *     lobby_join(lobby, from, slot);        // once it is in that game
+ *   game = lobby_removeGame(lobby, slot);   // at game over
+ *   lobby_delete(lobby, deleteGame);
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _LOBBY_H_
+#define _LOBBY_H_
+
+#include <stdbool.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct lobby lobby_t;  // opaque to users of this module
+
+/****************** global functions *********************/
+
+/******************************************/
+/* lobby_new: create a lobby with no games.
+ * Caller provides:
+ *   the most games it may hold at once (> 0).
+ * Function returns:
+ *   new lobby, or NULL on error.
+ * Caller is responsible for calling lobby_delete later.
+ */
+lobby_t* lobby_new(const int maxGames);
+
+/******************************************/
+/* lobby_addGame: put a game in a free slot; it becomes the newest.
+ * Function returns:
+ *   the game's slot, or -1 if the lobby is full or game is NULL.
+ */
+int lobby_addGame(lobby_t* lobby, void* game);
+
+/******************************************/
+/* lobby_removeGame: take a game out of its slot.
+ * We do:
+ *   forget every address routed to the slot, so their next datagrams
+ *   route as newcomers.
+ * Function returns:
+ *   the game, which the caller then frees, or NULL if the slot was empty.
+ */
+void* lobby_removeGame(lobby_t* lobby, const int slot);
+
+/******************************************/
+/* lobby_getGame: the game in a slot, or NULL if the slot is empty.
+ * Slots run from 0 to lobby_maxGames - 1.
+ */
+void* lobby_getGame(lobby_t* lobby, const int slot);
+
+/******************************************/
+/* lobby_newest: the slot of the game added most recently, or -1 if
+ * that game has been removed (or none was ever added).
+ */
+int lobby_newest(lobby_t* lobby);
+
+/******************************************/
+/* lobby_numGames: games in the lobby. */
+int lobby_numGames(lobby_t* lobby);
+
+/******************************************/
+/* lobby_maxGames: the maxGames given to lobby_new. */
+int lobby_maxGames(lobby_t* lobby);
+
+/******************************************/
+/* lobby_route: which game an address belongs to.
+ * Function returns:
+ *   the slot from the address's last lobby_join, or -1 if it has none.
+ */
+int lobby_route(lobby_t* lobby, const addr_t address);
+
+/******************************************/
+/* lobby_join: route an address to the game in a slot, replacing any
+ * route it had.
+ * Function returns:
+ *   false if the slot is empty or there was no memory for the route.
+ */
+bool lobby_join(lobby_t* lobby, const addr_t address, const int slot);
+
+/******************************************/
+/* lobby_leave: forget an address's route, if it has one. */
+void lobby_leave(lobby_t* lobby, const addr_t address);
+
+/******************************************/
+/* lobby_delete: free a lobby, calling deleteGame (if not NULL) on each
+ * game still in it; NULL lobby is ignored.
+ */
+void lobby_delete(lobby_t* lobby, void (*deleteGame)(void* game));
+
+#endif // _LOBBY_H_
@@ -4,11 +4,37 @@
  *  Usage:
  *   The server accepts two command-line arguments:
  *      - <map.txt>: the pathname of the map file to be read.
- *      - [seed]: an optional parameter that is used for the randomness of the program
+ *      - [seed]: an optional parameter that is used for the randomness of the program;
+ *        each worker thread draws from its own generator, seeded from it
+ *   followed by any of these options:
+ *      - -vis rays|shadow: how player visibility is computed (default shadow);
+ *        both give the same result, shadowcasting is much faster
+ *      - -io select|mmsg: read one message per wakeup, or every waiting
+ *        message at once with recvmmsg and reply to them together, waiting
+ *        with epoll (default mmsg)
+ *      - -tick hz: queue KEY messages and apply them hz times a second,
+ *        sending one round of DISPLAY and GOLD messages per tick
+ *        (default 0, which handles each message as it arrives)
+ *      - -games n: host up to n games at once on the one port (default 1).
+ *        Newcomers join the newest game, and a new game starts when it
+ *        is full; with more than one game the server keeps running after
+ *        a game ends, instead of exiting
+ *      - -map file: another map for new games; games take turns through
+ *        <map.txt> and every -map given
+ *      - -workers n: run n threads, each with its own socket on the port
+ *        (SO_REUSEPORT) and its own games, up to -games each; the kernel
+ *        keeps every client on one thread, and a newcomer joins a game
+ *        on the thread it reached. With more than one worker the server
+ *        runs until it is killed
+ *      - -pool n: work out each player's view and frame on n extra
+ *        threads (per worker) before sending, rather than one player
+ *        after another; the messages sent are the same (default 0)
+ *      - -players n: let each game take up to n players (default 26);
+ *        past Z the players' letters start again from A
  * 
  *  Exit codes:
  *   0  - Success (Server ran successfully)
- *   1  - Incorrect number of command-line arguments
+ *   1  - Incorrect number of command-line arguments or unknown option
  *   2  - Failed to open the map file
  *   3  - Invalid seed value provided
  *   4  - Failure to initialize message handling
@@ -19,24 +45,129 @@
  *  Jacob Fleming, Fall 2024
  */
 
+#define _GNU_SOURCE     // for pthread barriers
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
+#include <pthread.h>
 #include "file.h"
 #include "log.h"
 #include "message.h"
+#include "delta.h"
+#include "fragment.h"
+#include "batch.h"
 #include "player.h"
 #include "spectator.h"
 #include "grid.h"
+#include "viscache.h"
 #include "gold.h"
 #include "gamestatus.h"
+#include "lobby.h"
+#include "pool.h"
 
 /**************** global constants (defined by REQUIREMENTS) ****************/
 static const int MaxNameLength = 50;   // maximum number of chars in playerName
 
+/**************** global types ****************/
+/* settings picked on the command line */
+typedef struct serverOptions {
+    int seed;                       // seed for grid_seedRandom, mixed with each worker's index
+    gridVisEngine_t visEngine;      // how player visibility is computed
+    bool batchIO;                   // message_loopBatch rather than message_loop
+    int tickRate;                   // ticks per second, 0 for no ticks
+    int maxGames;                   // games hosted at once
+    const char** maps;              // map files for new games, in turn
+    int numMaps;                    // entries in maps
+    int workers;                    // threads sharing the port
+    int poolThreads;                // extra threads for players' views, 0 for none
+    int maxPlayers;                 // players each game takes
+} serverOptions_t;
+
+/* main grid cells changed since DISPLAY messages were last sent */
+typedef struct cellChanges {
+    int* positions;         // gridArray indexes of the changed cells
+    bool* isMarked;         // gridArray index -> already in positions
+    int count;              // number of entries in positions
+} cellChanges_t;
+
+/* KEY presses waiting for the next tick, in tick mode; changed also
+ * holds a game's round back to the end of a recvmmsg batch */
+typedef struct keyQueue {
+    char* keys;             // MaxQueuedKeys keys per player ID, oldest first
+    int* count;             // player ID -> number of keys waiting
+    int slots;              // player IDs keys and count have room for
+    bool changed;           // the game changed since the last round was sent
+} keyQueue_t;
+
+/* one game the server is hosting, with the server's bookkeeping for it */
+typedef struct match {
+    gamestatus_t* game;
+    int slot;               // the game's slot in the lobby
+    cellChanges_t changes;  // cells to patch into unmoved players' grids
+    keyQueue_t keyQueue;    // keys for the next tick; keys is NULL unless in tick mode
+    int* path;              // sprintPlayer's run, room for as many steps as the map is wide or tall
+} match_t;
+
+/* one round of player displays, worked out on the pool before sending */
+typedef struct displayRound {
+    gamestatus_t* game;
+    const cellChanges_t* changes;   // the game's changed cells, for unmoved players
+    player_t** players;             // players to send to, in player order
+    char* frames;                   // frameSize bytes per player; "" for none
+    size_t frameSize;               // the worker's frameBufferSize, which the pool can't see
+} displayRound_t;
+
+/* a thread hosting its share of the games, on its own socket */
+typedef struct worker {
+    const serverOptions_t* options;
+    int port;               // the port every worker's socket shares
+    int index;              // 1 for the first thread main starts; main's own is 0
+    pthread_t thread;
+} worker_t;
+
+/* a map new games can be played on */
+typedef struct catalogMap {
+    const char* mapFile;
+    grid_t* originalGrid;   // loaded with its visibility cache for the first
+                            // game on this map, and shared by the rest
+} catalogMap_t;
+
+/**************** file-local constants ****************/
+static const int MaxQueuedKeys = 8;     // a player's keys per tick; more are dropped
+static const int MaxTickRate = 1000;    // the timers only count milliseconds
+static const int MaxGames = 10000;      // most games one worker may host at once
+static const int MaxWorkers = 256;      // most threads one server may run
+static const int MaxPoolThreads = 64;   // most extra threads one worker may use for views
+static const int RoundBatch = 256;      // players whose frames the pool works out in one go
+
+/**************** file-local global variables ****************/
+/* set before any worker starts, and only read after */
+static bool tickMode;           // keys wait for handleTick
+static bool batchRounds;        // rounds wait for handleBatchEnd (-io mmsg)
+static int playersPerGame;      // the limit every new game gets
+static int numWorkers;          // threads hosting games
+static pthread_barrier_t workersBound;  // every worker has bound its socket
+
+/* each worker thread has its own */
+static _Thread_local lobby_t* lobby;          // every game being hosted, and who is in which
+static _Thread_local match_t* match;          // the game whose message or tick is being handled
+static _Thread_local catalogMap_t* catalog;   // maps new games are started on
+static _Thread_local int numMaps;             // entries in catalog
+static _Thread_local int nextMap;             // catalog entry for the next new game
+static _Thread_local char* frameBuffer;       // reused for every DISPLAY/KEYFRAME/DELTA we send
+static _Thread_local size_t frameBufferSize;  // sized from the grid, so big maps are never cut off
+static _Thread_local batch_t* outbox;         // messages for BATCH clients, sent when handleMessage is done
+static _Thread_local pool_t* visPool;         // works out players' views; NULL without -pool
+static _Thread_local char* roundFrames;       // one frame per player for the pool to write
+static _Thread_local match_t** changedMatches; // games with a round to send at handleBatchEnd
+static _Thread_local int numChanged;          // entries in changedMatches
+static _Thread_local const char* openFailure; // why openMatch last returned NULL, for the QUIT
+static _Thread_local size_t roundFramesSize;
+
 /**************** helper functions definitions ****************/
 
 /* 
@@ -54,13 +185,25 @@ void handleSpectateMessage(gamestatus_t* game, const addr_t from, const char* sp
  */
 void handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey);
 
+/* 
+ * handleAckMessage - Process a frame acknowledgement from the client.
+ */
+void handleAckMessage(gamestatus_t* game, const addr_t from, const char* seqText);
+
+/* 
+ * pressKey - Carry out a movement key for a player.
+ */
+void pressKey(gamestatus_t* game, player_t* player, char key);
+
 /* 
  * randomInt - Generate a random integer within a specified range.
  */
 int randomInt(int lowerBound, int upperBound);
 
 /* 
- * getPlayerLetter - Get the letter corresponding to a player's ID.
+ * getPlayerLetter - Get the letter corresponding to a player's ID:
+ * 'A' for 0 to 'Z' for 25, then 'A' again for 26, and so on. This is the
+ * letter in the main grid; letterPlayers gives each player's display its own.
  */
 char getPlayerLetter(int ID);
 
@@ -69,6 +212,18 @@ char getPlayerLetter(int ID);
  */
 void movePlayer(gamestatus_t* game, player_t* player, int r, int c);
 
+/* 
+ * stepPlayer - Move a player one cell, collecting gold or swapping with
+ * another player, but leave its view alone; true if it moved.
+ */
+bool stepPlayer(gamestatus_t* game, player_t* player, int r, int c);
+
+/* 
+ * sprintPlayer - Move a player as far as it can go in one direction,
+ * then update what it sees once, remembering what it passed.
+ */
+void sprintPlayer(gamestatus_t* game, player_t* player, int dr, int dc);
+
 /* 
  * handlePlayerQuit - Marks a player as no longer active and sends a quit message.
  */
@@ -80,7 +235,8 @@ void handlePlayerQuit(gamestatus_t* game, const addr_t from);
 void handleSpectatorQuit(gamestatus_t* game, const addr_t from);
 
 /* 
- * sendPlayersGoldMessage - Sends updated gold information to all players in the game.
+ * sendPlayersGoldMessage - Sends updated gold information to all players
+ * in the game who have not yet been told how much gold is left.
  */
 void sendPlayersGoldMessage(gamestatus_t* game);
 
@@ -94,11 +250,67 @@ void sendSpectatorGoldMessage(gamestatus_t* game);
  */
 void sendPlayerDisplayMessage(gamestatus_t* game, player_t* player);
 
+/* 
+ * refreshPlayerGrid - Bring a player's grid up to date with the main grid,
+ * given the cells that changed since it was last sent.
+ *
+ * Returns:
+ *   true if the player moved or could see one of the changes, so needs
+ *   a new frame; false if their grid is just as it was.
+ */
+bool refreshPlayerGrid(gamestatus_t* game, player_t* player, const cellChanges_t* changes);
+
+/* 
+ * letterPlayers - Name the other players in a player's grid with that
+ * player's own letters, so no two it can see share one. A player keeps
+ * its letter while it stays in sight, and takes getPlayerLetter's when
+ * that is free, so games of up to 26 look the same to everyone.
+ */
+void letterPlayers(gamestatus_t* game, player_t* player);
+
+/* 
+ * prepareDisplay - Pool job for one player of a displayRound_t: refresh
+ * the player's grid and write its frame into the round's buffer.
+ */
+void prepareDisplay(void* arg, const int index);
+
 /* 
  * sendSpectatorDisplayMessage - Delivers a visual representation of the game state to a specific spectator.
  */
 void sendSpectatorDisplayMessage(gamestatus_t* game, spectator_t* spectator);
 
+/* 
+ * sendGridFrame - Sends a grid as KEYFRAME/DELTA to clients that ACK frames, as DISPLAY otherwise,
+ * in FRAGMENT pieces if it is longer than one datagram.
+ */
+void sendGridFrame(const addr_t to, delta_t* frames, const bool batched, grid_t* grid);
+
+/* 
+ * encodeGridFrame - Writes the frame sendGridFrame would send into buffer;
+ * returns 0 if it did not fit, more than 0 otherwise.
+ */
+int encodeGridFrame(delta_t* frames, grid_t* grid, char* buffer, size_t size);
+
+/* 
+ * sendToClient - Queues a message for a client that takes BATCH messages, sends it right away otherwise.
+ */
+void sendToClient(const addr_t to, const bool batched, const char* message);
+
+/* 
+ * sendToPlayer - sendToClient for a player; a NULL player is ignored.
+ */
+void sendToPlayer(player_t* player, const char* message);
+
+/* 
+ * sendToSpectator - sendToClient for the spectator; a NULL spectator is ignored.
+ */
+void sendToSpectator(spectator_t* spectator, const char* message);
+
+/* 
+ * hasOption - Checks whether a space-separated list of options (as in "ACK 0 RLE BATCH") holds name.
+ */
+bool hasOption(const char* options, const char* name);
+
 /* 
  * sendInitOKMessage - Sends an initialization confirmation message to a specified player.
  */
@@ -135,7 +347,8 @@ bool isGameDone(gamestatus_t* game);
 void endGame(gamestatus_t* game);
 
 /* 
- * sendUpdatedDisplays - Updates and sends the current game display to players and spectators.
+ * sendUpdatedDisplays - Updates and sends the current game display to the
+ * spectator and to each player who moved or can see a changed cell.
  */
 void sendUpdatedDisplays(gamestatus_t* game);
 
@@ -149,6 +362,27 @@ void sendUpdatedGold(gamestatus_t* game);
  */
 void goldPickedUp(gamestatus_t* game, player_t* player, int goldPileValue);
 
+/* 
+ * initChanges - Allocate a changed-cell list for the game's grid.
+ */
+bool initChanges(cellChanges_t* changes, gamestatus_t* game);
+
+/* 
+ * markChanged - Record that a cell of match's main grid changed.
+ */
+void markChanged(int position);
+
+/* 
+ * clearChanges - Forget the changed cells once every player has them.
+ */
+void clearChanges(void);
+
+/* 
+ * updatePlayerVis - Recompute a player's visible set and whole grid,
+ * adding what it glimpsed from the cells of path on the way.
+ */
+void updatePlayerVis(gamestatus_t* game, player_t* player, const int* path, int pathLength);
+
 
 /**************** core functions definitions ****************/
 
@@ -156,16 +390,16 @@ void goldPickedUp(gamestatus_t* game, player_t* player, int goldPileValue);
  * parseArgs - Parse command-line arguments for the game settings.
  *
  * Checks the number of arguments, opens the specified map file, 
- * and validates an optional seed value. Exits with an error 
- * message if the map file cannot be opened or if the seed 
- * is invalid.
+ * and validates an optional seed value and any options. Exits 
+ * with an error message if the map file cannot be opened or if 
+ * the seed or an option is invalid.
  *
  * Parameters:
  *   argc - Number of command-line arguments.
  *   argv - Array of command-line argument strings.
- *   seed - Pointer to store the parsed seed value.
+ *   options - Pointer to options, already holding the defaults.
  */
-void parseArgs(const int argc, const char* argv[], int* seed);
+void parseArgs(const int argc, const char* argv[], serverOptions_t* options);
 
 /* 
  * handleMessage - Process incoming messages for the game.
@@ -187,48 +421,292 @@ void parseArgs(const int argc, const char* argv[], int* seed);
 
 bool handleMessage(void *arg, const addr_t from, const char *message);
 
+/* 
+ * dispatchMessage - Hand a message to the handler for its type.
+ *
+ * Does the work for handleMessage, which then flushes the outbox,
+ * so every message queued here for a client goes out as one BATCH.
+ *
+ * Returns:
+ *   true if the game is over.
+ */
+bool dispatchMessage(gamestatus_t* game, const addr_t from, const char *message);
+
+/* 
+ * handleBatchMessage - handleMessage for message_loopBatch.
+ *
+ * Handles the message but leaves the round of displays and gold it
+ * calls for, and the outbox, to handleBatchEnd, so everything a group
+ * of messages caused goes out together.
+ */
+bool handleBatchMessage(void *arg, const addr_t from, const char *message);
+
+/* 
+ * handleBatchEnd - Once message_loopBatch has handed us every message
+ * that arrived together, send one round for each game they changed and
+ * flush the outbox, so a client gets at most one frame per wakeup.
+ *
+ * Returns:
+ *   true if the server should stop: its only game is over.
+ */
+bool handleBatchEnd(void *arg);
+
+/* 
+ * sendRound - Send every client the displays and gold that changed,
+ * and end the game if all the gold is gone.
+ *
+ * Returns:
+ *   true if the game is over.
+ */
+bool sendRound(gamestatus_t* game);
+
+/* 
+ * initKeyQueue - Allocate a tick mode key queue, empty, with room for
+ * players with IDs below slots.
+ */
+bool initKeyQueue(keyQueue_t* keyQueue, const int slots);
+
+/* 
+ * queueKey - In tick mode, hold a playing player's movement key for
+ * the next tick; false if the key should be handled right away.
+ */
+bool queueKey(gamestatus_t* game, const addr_t from, const char* pressedKey);
+
+/* 
+ * handleTick - Timer handler for tick mode: apply the queued keys a
+ * round at a time in player ID order, then send one round of updates
+ * if anything changed.
+ *
+ * Returns:
+ *   true if the game is over.
+ */
+bool handleTick(void *arg);
+
+/* 
+ * applyTick - handleTick's work for the game in match.
+ *
+ * Returns:
+ *   true if the game is over.
+ */
+bool applyTick(gamestatus_t* game);
+
+/* 
+ * routeMessage - Find the game a message is for, starting one if
+ * need be, and hand it the message.
+ *
+ * Returns:
+ *   true if the server should stop: its only game is over.
+ */
+bool routeMessage(lobby_t* lobby, const addr_t from, const char *message);
+
+/* 
+ * findMatch - The game an address is in; for a newcomer, the newest
+ * game, or a new one if a player wants in and that one is full.
+ * NULL if there is none and none could be started.
+ */
+match_t* findMatch(lobby_t* lobby, const addr_t from, const char *message);
+
+/* 
+ * openMatch - Start a game on the next map in the catalog.
+ *
+ * Returns:
+ *   the new match, or NULL if the lobby is full or on error, with
+ *   openFailure saying which for the client's QUIT message.
+ */
+match_t* openMatch(lobby_t* lobby);
+
+/* 
+ * finishMatch - Deal with the end of the game in match.
+ *
+ * Returns:
+ *   true if the server should stop, because it hosts one game on
+ *   one thread;
+ *   otherwise the game is deleted and false returned.
+ */
+bool finishMatch(lobby_t* lobby);
+
+/* 
+ * deleteMatch - Free a match and its game; for lobby_delete.
+ */
+void deleteMatch(void* item);
+
+/* 
+ * serveGames - Host games on this thread's socket until the message
+ * loop ends, then free this thread's games and buffers.
+ */
+void serveGames(const serverOptions_t* options);
+
+/* 
+ * runWorker - Thread body for the workers after the first: open a
+ * socket on the shared port, wait for the rest, then serveGames.
+ */
+void* runWorker(void* arg);
+
+/* 
+ * workerSeed - The seed a worker's thread gives grid_seedRandom: the
+ * server's seed for worker 0, so one worker plays as before, and the
+ * seed mixed with the index for the rest, so no two play alike.
+ */
+unsigned int workerSeed(int seed, int index);
+
+/* 
+ * initCatalog - Set up the catalog from the maps on the command line.
+ */
+bool initCatalog(const serverOptions_t* options);
+
+/* 
+ * deleteCatalog - Free the catalog and the original grids it loaded.
+ */
+void deleteCatalog(void);
+
 /**************** main() ****************/
 /* Controls the flow of the program and execution */
 int
 main(const int argc, const char* argv[])
 {
     log_init(stderr);
-    int seed = getpid();
-    parseArgs(argc, argv, &seed);
-    srand(seed);
-
-    int port = message_init(stderr);
+    serverOptions_t options = { getpid(), GRID_VIS_SHADOW, true, 0, 1, NULL, 0, 1, 0, MaxPlayers };
+    parseArgs(argc, argv, &options);
+    grid_seedRandom(workerSeed(options.seed, 0));
+    grid_setVisEngine(options.visEngine);
+    tickMode = options.tickRate > 0;
+    batchRounds = options.batchIO && !tickMode;
+    playersPerGame = options.maxPlayers;
+    numWorkers = options.workers;
+
+    int port = numWorkers > 1 ? message_initShared(stderr, 0) : message_init(stderr);
     if (port == 0){
         log_v("Could not initialize message in server main()...\n");
         exit(4);
     }
+
+    // this thread is the first worker; the others share its port
+    worker_t* workers = NULL;
+    if (numWorkers > 1) {
+        workers = calloc(numWorkers - 1, sizeof(worker_t));
+        if (workers == NULL || pthread_barrier_init(&workersBound, NULL, numWorkers) != 0) {
+            log_v("Server could not allocate its workers...\n");
+            exit(5);
+        }
+        for (int i = 0; i < numWorkers - 1; i++) {
+            workers[i].options = &options;
+            workers[i].port = port;
+            workers[i].index = i + 1;
+            if (pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) != 0) {
+                log_v("Server could not start a worker thread...\n");
+                exit(5);
+            }
+        }
+        // the kernel spreads clients over the sockets there are, so
+        // nobody may arrive before they are all bound
+        pthread_barrier_wait(&workersBound);
+    }
     printf("Ready to play, waiting at port '%d'\n", port);
+    fflush(stdout);     // for scripts and loadtest reading the port from a pipe
 
-    // int randomNumGoldPile = randomInt(GoldMinNumPiles, GoldMaxNumPiles);
-    gamestatus_t* game = gamestatus_new(argv[1], seed);
-    if (game == NULL) {
-        log_v("Server could not initialize a new gamestatus_t...\n");
-        exit(5);
+    serveGames(&options);
+    message_done();
+
+    for (int i = 0; i < numWorkers - 1; i++) {
+        pthread_join(workers[i].thread, NULL);
     }
+    free(workers);
+    free(options.maps);
 
-    message_loop(game, 0, NULL, NULL, handleMessage);
+    return 0;
+}
 
+/**************** runWorker() ****************/
+/* See top of the file for the description */
+void* 
+runWorker(void* arg)
+{
+    worker_t* worker = arg;
+    log_init(stderr);
+    grid_seedRandom(workerSeed(worker->options->seed, worker->index));
+    int port = message_initShared(stderr, worker->port);
+    pthread_barrier_wait(&workersBound);
+    if (port == 0) {
+        log_v("Could not initialize message in a worker thread...\n");
+        exit(4);
+    }
+
+    serveGames(worker->options);
     message_done();
+    return NULL;
+}
 
-    gamestatus_delete(game);
+/**************** workerSeed() ****************/
+/* See top of the file for the description */
+unsigned int 
+workerSeed(int seed, int index)
+{
+    // an odd multiplier spreads consecutive indexes over every bit
+    return (unsigned int) seed ^ ((unsigned int) index * 2654435761u);
+}
 
-    return 0;
+/**************** serveGames() ****************/
+/* See top of the file for the description */
+void 
+serveGames(const serverOptions_t* options)
+{
+    outbox = batch_new();
+    if (outbox == NULL) {
+        log_v("Server could not allocate the outbox...\n");
+        exit(5);
+    }
+    if (options->poolThreads > 0 && (visPool = pool_new(options->poolThreads)) == NULL) {
+        log_v("Server could not start the view threads...\n");
+        exit(5);
+    }
+    lobby = lobby_new(options->maxGames);
+    changedMatches = malloc(options->maxGames * sizeof(match_t*));
+    if (lobby == NULL || changedMatches == NULL || !initCatalog(options)) {
+        log_v("Server could not allocate the lobby...\n");
+        exit(5);
+    }
+
+    // the first game is ready before anyone asks, as it always was
+    if (openMatch(lobby) == NULL) {
+        log_s("Server could not start the first game: %s...\n", openFailure);
+        exit(5);
+    }
+
+    if (tickMode) {
+        if (message_setTimer(1.0f / options->tickRate, true, handleTick) == 0) {
+            log_v("Server could not start the tick timer...\n");
+            exit(5);
+        }
+        // ticks need the event loop; "-io select" still flushes per message
+        if (options->batchIO) {
+            message_loopEvents(lobby, 0, NULL, NULL, handleBatchMessage, handleBatchEnd);
+        } else {
+            message_loopEvents(lobby, 0, NULL, NULL, handleMessage, NULL);
+        }
+    } else if (options->batchIO) {
+        message_loopEvents(lobby, 0, NULL, NULL, handleBatchMessage, handleBatchEnd);
+    } else {
+        message_loop(lobby, 0, NULL, NULL, handleMessage);
+    }
+
+    lobby_delete(lobby, deleteMatch);
+    deleteCatalog();
+    free(frameBuffer);
+    free(roundFrames);
+    free(changedMatches);
+    pool_delete(visPool);
+    batch_delete(outbox);
 }
 
 /**************** parseArgs() ****************/
 /* See top of the file for the description */
 void 
-parseArgs(const int argc, const char* argv[], int* seed)
+parseArgs(const int argc, const char* argv[], serverOptions_t* options)
 {
     // Check for the correct number of arguments
-    if (argc < 2 || argc > 3) {
+    if (argc < 2) {
         log_v("Wrong number of inputs provided...\n");
-        printf("Usage: ./server map.txt <seed>\n");
+        printf("Usage: ./server map.txt <seed> [-vis rays|shadow] [-io select|mmsg] [-tick hz] [-games n] [-map file]... [-workers n] [-pool n] [-players n]\n");
         exit(1);
     }
 
@@ -240,11 +718,90 @@ parseArgs(const int argc, const char* argv[], int* seed)
     }
     fclose(fp);
 
-    // Validate the seed if it's provided
-    if (argc == 3) {
-        if (sscanf(argv[2], "%d", seed) != 1) {
-            log_s("Invalid seed number provided: %s\n", argv[2]);
-            exit(3);
+    // the catalog starts with the map on the command line
+    options->maps = malloc(argc * sizeof(char*));
+    if (options->maps == NULL) {
+        log_v("Could not allocate the map catalog...\n");
+        exit(5);
+    }
+    options->maps[options->numMaps++] = argv[1];
+
+    // Validate the seed and options if they're provided
+    bool seenSeed = false;
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "-vis") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rays") == 0) {
+                options->visEngine = GRID_VIS_RAYS;
+            } else if (strcmp(argv[i], "shadow") == 0) {
+                options->visEngine = GRID_VIS_SHADOW;
+            } else {
+                log_s("Unknown visibility engine: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-io") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "select") == 0) {
+                options->batchIO = false;
+            } else if (strcmp(argv[i], "mmsg") == 0) {
+                options->batchIO = true;
+            } else {
+                log_s("Unknown I/O mode: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-tick") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d", &options->tickRate) != 1
+                || options->tickRate < 0 || options->tickRate > MaxTickRate) {
+                log_s("Invalid tick rate: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-games") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d", &options->maxGames) != 1
+                || options->maxGames < 1 || options->maxGames > MaxGames) {
+                log_s("Invalid number of games: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-map") == 0 && i + 1 < argc) {
+            i++;
+            if ((fp = fopen(argv[i], "r")) == NULL) {
+                log_s("Could not open the map file provided: %s\n", argv[i]);
+                exit(2);
+            }
+            fclose(fp);
+            options->maps[options->numMaps++] = argv[i];
+        } else if (strcmp(argv[i], "-workers") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d", &options->workers) != 1
+                || options->workers < 1 || options->workers > MaxWorkers) {
+                log_s("Invalid number of workers: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-pool") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d", &options->poolThreads) != 1
+                || options->poolThreads < 0 || options->poolThreads > MaxPoolThreads) {
+                log_s("Invalid number of view threads: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (strcmp(argv[i], "-players") == 0 && i + 1 < argc) {
+            i++;
+            if (sscanf(argv[i], "%d", &options->maxPlayers) != 1
+                || options->maxPlayers < 1 || options->maxPlayers > MaxPlayersLimit) {
+                log_s("Invalid number of players per game: %s\n", argv[i]);
+                exit(1);
+            }
+        } else if (!seenSeed && (argv[i][0] != '-' || isdigit(argv[i][1]))) {
+            if (sscanf(argv[i], "%d", &options->seed) != 1) {
+                log_s("Invalid seed number provided: %s\n", argv[i]);
+                exit(3);
+            }
+            seenSeed = true;
+        } else {
+            log_s("Unexpected argument provided: %s\n", argv[i]);
+            printf("Usage: ./server map.txt <seed> [-vis rays|shadow] [-io select|mmsg] [-tick hz] [-games n] [-map file]... [-workers n] [-pool n] [-players n]\n");
+            exit(1);
         }
     }
 }
@@ -261,8 +818,238 @@ handleMessage(void *arg, const addr_t from, const char *message)
         return true;
     }
 
-    gamestatus_t* game = (gamestatus_t*) arg;
-
+    bool serverDone = routeMessage((lobby_t*) arg, from, message);
+
+    // everything the message caused, one datagram per client
+    batch_flush(outbox);
+    return serverDone;
+}
+
+/**************** handleBatchMessage() ****************/
+/* See top of the file for the description */
+bool 
+handleBatchMessage(void *arg, const addr_t from, const char *message) 
+{
+    if (arg == NULL || message == NULL) {
+        log_v("Entered message loop without a gamestatus...\n");
+        return true;
+    }
+    return routeMessage((lobby_t*) arg, from, message);
+}
+
+/**************** routeMessage() ****************/
+/* See top of the file for the description */
+bool 
+routeMessage(lobby_t* lobby, const addr_t from, const char *message) 
+{
+    bool routed = lobby_route(lobby, from) >= 0;
+    match = findMatch(lobby, from, message);
+    if (match == NULL) {
+        log_s("No game could be found or started for: %s\n", message);
+        if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0 || strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0) {
+            char quitMessage[100];
+            snprintf(quitMessage, sizeof(quitMessage), "QUIT Sorry - %s.\n", openFailure);
+            message_send(from, quitMessage);
+        }
+        return false;
+    }
+
+    bool gameOver = dispatchMessage(match->game, from, message);
+
+    // a newcomer who joined is routed straight to this game from now on
+    if (!routed && gamestatus_getSession(match->game, from) != NULL) {
+        lobby_join(lobby, from, match->slot);
+    }
+    return gameOver && finishMatch(lobby);
+}
+
+/**************** findMatch() ****************/
+/* See top of the file for the description */
+match_t* 
+findMatch(lobby_t* lobby, const addr_t from, const char *message) 
+{
+    match_t* found = lobby_getGame(lobby, lobby_route(lobby, from));
+    if (found != NULL) {
+        if (gamestatus_getSession(found->game, from) != NULL) {
+            return found;
+        }
+        // e.g. a spectator who was replaced: route them afresh
+        lobby_leave(lobby, from);
+    }
+
+    bool isPlay = strncmp(message, "PLAY ", strlen("PLAY ")) == 0 || strncmp(message, "play ", strlen("PLAY ")) == 0;
+    bool isSpectate = strncmp(message, "SPECTATE", strlen("SPECTATE")) == 0 || strncmp(message, "spectate", strlen("SPECTATE")) == 0;
+    found = lobby_getGame(lobby, lobby_newest(lobby));
+    if ((found == NULL && (isPlay || isSpectate))
+        || (found != NULL && isPlay && found->game->numPlayers >= found->game->maxPlayers)) {
+        match_t* opened = openMatch(lobby);
+        if (opened != NULL) {
+            found = opened;
+        }
+    }
+    return found;
+}
+
+/**************** openMatch() ****************/
+/* See top of the file for the description */
+match_t* 
+openMatch(lobby_t* lobby)
+{
+    if (lobby_numGames(lobby) >= lobby_maxGames(lobby)) {
+        openFailure = "the server is hosting as many games as it can";
+        return NULL;
+    }
+    catalogMap_t* map = &catalog[nextMap];
+    if (map->originalGrid == NULL) {
+        map->originalGrid = grid_loadCopied(map->mapFile);
+        if (map->originalGrid == NULL) {
+            log_s("Server could not load the map %s...\n", map->mapFile);
+            openFailure = "the server could not load the map for a new game";
+            return NULL;
+        }
+        // walls never change, so visibility can be worked out once up front
+        if (!grid_loadVisibility(map->originalGrid, viscache_DefaultBudget)) {
+            log_v("Server could not build the visibility cache, using line of sight...\n");
+        }
+    }
+
+    // anything else that goes wrong from here is a shortage of memory
+    openFailure = "the server is out of memory for a new game";
+    match_t* opened = calloc(1, sizeof(match_t));
+    if (opened == NULL) {
+        log_v("Server could not allocate a new game...\n");
+        return NULL;
+    }
+    opened->game = gamestatus_newShared(map->mapFile, map->originalGrid);
+    if (opened->game != NULL) {
+        // a run is never longer than the map is wide or tall
+        grid_t* grid = opened->game->grid;
+        opened->path = malloc((grid->nrow > grid->ncol ? grid->nrow : grid->ncol) * sizeof(int));
+    }
+    if (opened->game == NULL || opened->path == NULL
+        || !initChanges(&opened->changes, opened->game)
+        || (tickMode && !initKeyQueue(&opened->keyQueue, playersPerGame))) {
+        log_v("Server could not initialize a new gamestatus_t...\n");
+        deleteMatch(opened);
+        return NULL;
+    }
+    if (!gamestatus_setMaxPlayers(opened->game, playersPerGame)) {
+        // the next game tries the next map, so one bad map can't stop them all
+        log_s("Map %s has no floor for players after the gold...\n", map->mapFile);
+        openFailure = "the map has no room for players";
+        nextMap = (nextMap + 1) % numMaps;
+        deleteMatch(opened);
+        return NULL;
+    }
+    if (opened->game->maxPlayers < playersPerGame) {
+        log_d("Map has floor for only %d players after the gold\n", opened->game->maxPlayers);
+    }
+
+    // a KEYFRAME header is a little longer than "DISPLAY\n"; the buffer
+    // grows to fit the biggest map being played
+    size_t size = grid_displaySize(opened->game->grid) + 32;
+    if (size > frameBufferSize) {
+        char* bigger = realloc(frameBuffer, size);
+        if (bigger == NULL) {
+            log_v("Server could not allocate the frame buffer...\n");
+            deleteMatch(opened);
+            return NULL;
+        }
+        frameBuffer = bigger;
+        frameBufferSize = size;
+    }
+
+    opened->slot = lobby_addGame(lobby, opened);
+    nextMap = (nextMap + 1) % numMaps;
+    log_d("Started game %d\n", opened->slot);
+    return opened;
+}
+
+/**************** finishMatch() ****************/
+/* See top of the file for the description */
+bool 
+finishMatch(lobby_t* lobby)
+{
+    if (lobby_maxGames(lobby) == 1 && numWorkers == 1) {
+        return true;
+    }
+    log_d("Game %d is over\n", match->slot);
+    deleteMatch(lobby_removeGame(lobby, match->slot));
+    match = NULL;
+    return false;
+}
+
+/**************** deleteMatch() ****************/
+/* See top of the file for the description */
+void 
+deleteMatch(void* item)
+{
+    match_t* doomed = item;
+    if (doomed != NULL) {
+        gamestatus_delete(doomed->game);
+        free(doomed->changes.positions);
+        free(doomed->changes.isMarked);
+        free(doomed->keyQueue.keys);
+        free(doomed->keyQueue.count);
+        free(doomed->path);
+        free(doomed);
+    }
+}
+
+/**************** initCatalog() ****************/
+/* See top of the file for the description */
+bool 
+initCatalog(const serverOptions_t* options)
+{
+    catalog = calloc(options->numMaps, sizeof(catalogMap_t));
+    if (catalog == NULL) {
+        return false;
+    }
+    for (int i = 0; i < options->numMaps; i++) {
+        catalog[i].mapFile = options->maps[i];
+    }
+    numMaps = options->numMaps;
+    nextMap = 0;
+    return true;
+}
+
+/**************** deleteCatalog() ****************/
+/* See top of the file for the description */
+void 
+deleteCatalog(void)
+{
+    for (int i = 0; i < numMaps; i++) {
+        grid_delete(catalog[i].originalGrid);
+    }
+    free(catalog);
+    catalog = NULL;
+    numMaps = 0;
+}
+
+/**************** handleBatchEnd() ****************/
+/* See top of the file for the description */
+bool 
+handleBatchEnd(void *arg)
+{
+    lobby_t* lobby = (lobby_t*) arg;
+    bool serverDone = false;
+    for (int i = 0; i < numChanged; i++) {
+        match = changedMatches[i];
+        match->keyQueue.changed = false;
+        if (sendRound(match->game)) {
+            serverDone = finishMatch(lobby) || serverDone;
+        }
+    }
+    numChanged = 0;
+    batch_flush(outbox);
+    return serverDone;
+}
+
+/**************** dispatchMessage() ****************/
+/* See top of the file for the description */
+bool 
+dispatchMessage(gamestatus_t* game, const addr_t from, const char *message) 
+{
     if (strncmp(message, "PLAY ", strlen("PLAY ")) == 0 || strncmp(message, "play ", strlen("PLAY ")) == 0) {
         const char* playerName = message + strlen("PLAY ");
         handlePlayMessage(game, from, playerName);
@@ -271,7 +1058,14 @@ handleMessage(void *arg, const addr_t from, const char *message)
         handleSpectateMessage(game, from, spectatorName);
     } else if (strncmp(message, "KEY ", strlen("KEY ")) == 0 || strncmp(message, "key ", strlen("KEY ")) == 0) {
         const char* keyPressed = message + strlen("KEY "); // Should be just a single character, error checking done later
+        if (queueKey(game, from, keyPressed)) {
+            return false;
+        }
         handleKeyMessage(game, from, keyPressed);
+    } else if (strncmp(message, "ACK ", strlen("ACK ")) == 0) {
+        // acknowledgements change nothing in the game, so nothing to send
+        handleAckMessage(game, from, message + strlen("ACK "));
+        return false;
     } else {
         log_v("A valid message was not provided to the server...\n");
         log_s("The invalid message was: %s\n", message);
@@ -279,7 +1073,35 @@ handleMessage(void *arg, const addr_t from, const char *message)
         return false;
     }
 
+#ifdef DEBUGPRINT
+    if (!gamestatus_checkOccupancy(game)) {
+        printf("Occupancy map is out of sync after: %s\n", message);
+    }
+#endif
+
+    // in tick mode the next tick sends what this message changed, and
+    // with -io mmsg the end of the batch does, once for all its messages
+    if (tickMode) {
+        match->keyQueue.changed = true;
+        return false;
+    }
+    if (batchRounds) {
+        if (!match->keyQueue.changed) {
+            match->keyQueue.changed = true;
+            changedMatches[numChanged++] = match;
+        }
+        return false;
+    }
+    return sendRound(game);
+}
+
+/**************** sendRound() ****************/
+/* See top of the file for the description */
+bool 
+sendRound(gamestatus_t* game)
+{
     sendUpdatedDisplays(game);
+    clearChanges();
     sendUpdatedGold(game);
 
     // Check if the game is ended
@@ -291,6 +1113,100 @@ handleMessage(void *arg, const addr_t from, const char *message)
   }
 }
 
+/**************** initKeyQueue() ****************/
+/* See top of the file for the description */
+bool 
+initKeyQueue(keyQueue_t* keyQueue, const int slots)
+{
+    keyQueue->keys = malloc((size_t)slots * MaxQueuedKeys);
+    keyQueue->count = calloc(slots, sizeof(int));
+    keyQueue->slots = slots;
+    keyQueue->changed = false;
+    return keyQueue->keys != NULL && keyQueue->count != NULL;
+}
+
+/**************** queueKey() ****************/
+/* See top of the file for the description */
+bool 
+queueKey(gamestatus_t* game, const addr_t from, const char* pressedKey)
+{
+    if (!tickMode || strlen(pressedKey) != 1 || pressedKey[0] == 'Q') {
+        return false;
+    }
+    player_t* player = gamestatus_getPlayerByAddress(game, from);
+    if (player == NULL || !player->isPlaying || player->ID < 0 || player->ID >= match->keyQueue.slots) {
+        return false;
+    }
+
+    keyQueue_t* keyQueue = &match->keyQueue;
+    int* count = &keyQueue->count[player->ID];
+    if (*count < MaxQueuedKeys) {
+        keyQueue->keys[player->ID * MaxQueuedKeys + *count] = pressedKey[0];
+        (*count)++;
+    } else {
+        log_d("Dropped a key from player %d, who already has a tick's worth queued\n", player->ID);
+    }
+    return true;
+}
+
+/**************** handleTick() ****************/
+/* See top of the file for the description */
+bool 
+handleTick(void *arg)
+{
+    lobby_t* lobby = (lobby_t*) arg;
+    if (lobby == NULL) {
+        return true;
+    }
+
+    bool serverDone = false;
+    for (int slot = 0; slot < lobby_maxGames(lobby); slot++) {
+        match = lobby_getGame(lobby, slot);
+        if (match != NULL && applyTick(match->game)) {
+            serverDone = finishMatch(lobby) || serverDone;
+        }
+    }
+    batch_flush(outbox);
+    return serverDone;
+}
+
+/**************** applyTick() ****************/
+/* See top of the file for the description */
+bool 
+applyTick(gamestatus_t* game)
+{
+    keyQueue_t* keyQueue = &match->keyQueue;
+
+    // everyone's first key, then everyone's second, ... so nobody
+    // gets ahead by sending more keys or by sending them sooner
+    for (int round = 0; round < MaxQueuedKeys; round++) {
+        bool any = false;
+        for (int id = 0; id < keyQueue->slots; id++) {
+            if (keyQueue->count[id] > round) {
+                pressKey(game, game->players[id], keyQueue->keys[id * MaxQueuedKeys + round]);
+                any = true;
+            }
+        }
+        if (!any) {
+            break;
+        }
+        keyQueue->changed = true;
+    }
+    memset(keyQueue->count, 0, keyQueue->slots * sizeof(int));
+
+    bool gameOver = false;
+    if (keyQueue->changed) {
+        keyQueue->changed = false;
+#ifdef DEBUGPRINT
+        if (!gamestatus_checkOccupancy(game)) {
+            printf("Occupancy map is out of sync after a tick\n");
+        }
+#endif
+        gameOver = sendRound(game);
+    }
+    return gameOver;
+}
+
 /**************** sendUpdatedDisplays() ****************/
 /* See top of the file for the description */
 void 
@@ -300,13 +1216,57 @@ sendUpdatedDisplays(gamestatus_t* game)
     sendSpectatorDisplayMessage(game, game->spectator);
 
     // Sends updated display and gold for players
-    int numPlayers = game->numPlayers;
+    int numSlots = game->playerSlots;
     player_t** players = game->players;
-    for(int i = 0; i < numPlayers; i++){
-        if (players[i] == NULL){
+
+    // with a pool, the players' views and frames are worked out a batch at
+    // a time and then sent in player order, so clients get exactly what they
+    // did before, and the frames take the same room however many play.
+    // Threads may only share a visibility cache that never changes: one over
+    // its budget fills rows as they are asked for, so those games stay serial
+    viscache_t* cache = game->originalGrid != NULL ? game->originalGrid->vis : NULL;
+    int batchSize = numSlots < RoundBatch ? numSlots : RoundBatch;
+    size_t needed = (size_t)batchSize * frameBufferSize;
+    if (visPool != NULL && game->numPlayers > 1 && (cache == NULL || viscache_isFull(cache))) {
+        if (needed > roundFramesSize) {
+            char* bigger = realloc(roundFrames, needed);
+            if (bigger != NULL) {
+                roundFrames = bigger;
+                roundFramesSize = needed;
+            }
+        }
+        if (needed <= roundFramesSize) {
+            player_t* active[RoundBatch];
+            int next = 0;
+            while (next < numSlots) {
+                int count = 0;
+                for (; next < numSlots && count < RoundBatch; next++) {
+                    if (players[next] != NULL && players[next]->isPlaying) {
+                        active[count++] = players[next];
+                    }
+                }
+                displayRound_t round = { game, &match->changes, active, roundFrames, frameBufferSize };
+                pool_run(visPool, count, prepareDisplay, &round);
+                for (int i = 0; i < count; i++) {
+                    char* frame = &roundFrames[i * frameBufferSize];
+                    if (frame[0] != '\0') {
+                        sendToClient(active[i]->IPaddress, active[i]->batched, frame);
+                    }
+                }
+            }
+            return;
+        }
+    }
+
+    // only players who saw something change get a frame; a quitter gets none
+    for(int i = 0; i < numSlots; i++){
+        player_t* player = players[i];
+        if (player == NULL || !player->isPlaying){
             continue;
         }
-        sendPlayerDisplayMessage(game, players[i]);
+        if (refreshPlayerGrid(game, player, &match->changes)) {
+            sendGridFrame(player->IPaddress, player->frames, player->batched, player->grid);
+        }
     }
 }
 
@@ -333,7 +1293,7 @@ handleSpectateMessage(gamestatus_t* game, const addr_t from, const char* spectat
 
     // Check if there is already another spectator
     if (game->spectator != NULL) {
-        spectator_sendMessage(game->spectator, "QUIT You have been replaced by a new spectator.\n");
+        sendToSpectator(game->spectator, "QUIT You have been replaced by a new spectator.\n");
         gamestatus_removeSpectator(game);
         // need to free spectator before changing pointer
         game->spectator = NULL;
@@ -379,28 +1339,21 @@ handlePlayMessage(gamestatus_t* game, const addr_t from, const char* playerName)
 #endif
 
     player_t* player;
-    // Add player to gamestatus and send initialization messages
+    // Add player to gamestatus (which keeps a copy of the name in the
+    // game's arena) and send initialization messages
     if ((player = gamestatus_addPlayer(game, actualPlayerName, from)) == NULL) {
         message_send(from, "QUIT Game is full: no more players can join.\n");
         return;
     }
 
-    player->name = malloc(strlen(actualPlayerName) + 1); // +1 for the null terminator
-    if (player->name == NULL) {
-        log_v("Failed to allocate memory for player name.\n");
-        free(player); // Free previously allocated memory for the player structure
-        message_send(from, "QUIT Server error: Unable to allocate player details.\n");
-        return;
-    }
-
-    strcpy(player->name, actualPlayerName); // Copy the name into the allocated space
-
 #ifdef DEBUGPRINT
     printf("Printed the name being stored: %s\n", player->name);
 #endif
     
     game->grid->gridArray[player->position] = getPlayerLetter(player->ID);
     player->grid->gridArray[player->position] = '@';
+    gamestatus_setOccupant(game, player->position, player);
+    markChanged(player->position);
 
     sendInitOKMessage(game, from);
     sendInitGridMessage(game, from, true);
@@ -423,9 +1376,9 @@ sendInitGridMessage(gamestatus_t* game, const addr_t to, bool isPlayer)
         if (player == NULL) {
             log_v("Could not find the player to send the GRID initialization message...\n");
         }
-        player_sendMessage(player, initMessage);
+        sendToPlayer(player, initMessage);
     } else {
-        spectator_sendMessage(game->spectator, initMessage);
+        sendToSpectator(game->spectator, initMessage);
     }
 }
 
@@ -442,7 +1395,7 @@ sendInitOKMessage(gamestatus_t* game, const addr_t to)
 
     char initMessage[100];
     snprintf(initMessage, sizeof(initMessage), "OK %c", getPlayerLetter(player->ID));
-    player_sendMessage(player, initMessage);
+    sendToPlayer(player, initMessage);
 }
 
 /**************** handleKeyMessage() ****************/
@@ -455,18 +1408,12 @@ handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey)
         return;
     }
 
-    grid_t* grid;
     player_t* player = gamestatus_getPlayerByAddress(game, from);
-    int r;
-    int c;
-    if (player != NULL) {
-        grid = player->grid;
-        r = extractRowFromPosition(player->position, grid->ncol);
-        c = extractColumnFromPosition(player->position, grid->ncol);
 #ifdef DEBUGPRINT
-    printf("Printed the name at handleKeyMessage: %s\n", player->name);
-#endif
+    if (player != NULL) {
+        printf("Printed the name at handleKeyMessage: %s\n", player->name);
     }
+#endif
     
     char keyPressed;
     if (strlen(pressedKey) > 1) {
@@ -481,7 +1428,7 @@ handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey)
                 if ((message_eqAddr(from, game->spectator->IPaddress))) {
                     handleSpectatorQuit(game, from);
                 } 
-            } else if (player->isPlaying == false) {
+            } else if (player == NULL || player->isPlaying == false) {
                 log_v("A player client that has already quit tried to play with keyboard...\n");
                 return;
             } else {
@@ -489,6 +1436,24 @@ handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey)
             }
             break;
 
+        default:
+            pressKey(game, player, keyPressed);
+            break;
+        }
+}
+
+/**************** pressKey() ****************/
+/* See top of the file for the description */
+void 
+pressKey(gamestatus_t* game, player_t* player, char key)
+{
+    if (game == NULL || player == NULL) {
+        return;
+    }
+    int r = extractRowFromPosition(player->position, game->grid->ncol);
+    int c = extractColumnFromPosition(player->position, game->grid->ncol);
+
+    switch (key) {
         // Horizontal movement
         case 'l': 
             movePlayer(game, player, r, c + 1);
@@ -521,64 +1486,32 @@ handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey)
 
         // Max horizontal movements
         case 'L': 
-            while(!grid_isWall(grid, r, c + 1)){
-                movePlayer(game, player, r, c + 1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, 0, 1);
             break;
         case 'H': 
-            while(!grid_isWall(grid, r, c - 1)){
-                movePlayer(game, player, r, c - 1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, 0, -1);
             break;
 
         // Max vertical movements
         case 'K': 
-            while(!grid_isWall(grid, r - 1, c)){
-                movePlayer(game, player, r - 1, c);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, -1, 0);
             break;
         case 'J': 
-            while(!grid_isWall(grid, r + 1, c)){
-                movePlayer(game, player, r + 1, c);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, 1, 0);
             break;
         
         // Max diagonal movements
         case 'U': 
-            while(!grid_isWall(grid, r - 1, c+1)){
-                movePlayer(game, player, r - 1, c+1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, -1, 1);
             break;
         case 'Y': 
-            while(!grid_isWall(grid, r - 1, c-1)){
-                movePlayer(game, player, r - 1, c-1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, -1, -1);
             break;
         case 'B': 
-            while(!grid_isWall(grid, r+ 1, c-1)){
-                movePlayer(game, player, r+ 1, c-1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, 1, -1);
             break;
         case 'N': 
-            while(!grid_isWall(grid, r+1, c+1)){
-                movePlayer(game, player, r+1, c+1);
-                r = extractRowFromPosition(player->position, grid->ncol);
-                c = extractColumnFromPosition(player->position, grid->ncol);
-            }
+            sprintPlayer(game, player, 1, 1);
             break;
 
         // Ignore situations where the client detects a key but it is not one of the specific keys
@@ -588,6 +1521,57 @@ handleKeyMessage(gamestatus_t* game, const addr_t from, const char* pressedKey)
 }
 
 
+/**************** handleAckMessage() ****************/
+/* See top of the file for the description */
+void 
+handleAckMessage(gamestatus_t* game, const addr_t from, const char* seqText)
+{
+    int seq, used;
+    if (sscanf(seqText, "%d%n", &seq, &used) != 1 || seq < 0) {
+        log_s("Invalid ACK received by server: %s\n", seqText);
+        return;
+    }
+
+    session_t* session = gamestatus_getSession(game, from);
+    player_t* player = session == NULL ? NULL : session->player;
+    spectator_t* spectator = game->spectator;
+    delta_t** frames;
+    bool* batched;
+    if (player != NULL) {
+        frames = &player->frames;
+        batched = &player->batched;
+    } else if (session != NULL && session->isSpectator) {
+        frames = &spectator->frames;
+        batched = &spectator->batched;
+    } else {
+        log_v("ACK received from an address that is not in the game...\n");
+        return;
+    }
+
+    // the first ACK tells us this client understands KEYFRAME and DELTA;
+    // "ACK 0 RLE BATCH" says it also takes run-length encoded keyframes
+    // and several messages in one BATCH
+    if (*frames == NULL) {
+        *frames = delta_new(game->grid->nrow, game->grid->ncol);
+        if (*frames == NULL) {
+            log_v("Could not allocate frame history, sticking with DISPLAY...\n");
+            return;
+        }
+        delta_useRLE(*frames, hasOption(seqText + used, "RLE"));
+        *batched = hasOption(seqText + used, "BATCH");
+    }
+    delta_ack(*frames, seq);
+
+    // "ACK 0" means the client has no usable frame, so send one right away
+    if (seq == 0) {
+        if (player != NULL) {
+            sendPlayerDisplayMessage(game, player);
+        } else {
+            sendSpectatorDisplayMessage(game, spectator);
+        }
+    }
+}
+
 /**************** randomInt() ****************/
 /* See top of the file for the description */
 int 
@@ -597,7 +1581,7 @@ randomInt(int lowerBound, int upperBound)
         log_v("Server tried to create a random number with invalid ranges...\n");
         return -1;
     } else {
-        return (rand() % (upperBound - lowerBound + 1)) + lowerBound;
+        return (grid_random() % (upperBound - lowerBound + 1)) + lowerBound;
     }
 }
 
@@ -606,11 +1590,14 @@ randomInt(int lowerBound, int upperBound)
 char 
 getPlayerLetter(int ID) 
 {
-    if (ID < 0 || ID > 25) {
+    if (ID < 0) {
         log_v("Invalid player ID was provided to convert to letter...\n");
         return '?'; // Placeholder for invalid letter
     }
-    return 'A' + ID; 
+    // past Z the letters come round again in the main grid; players'
+    // displays are relettered by letterPlayers, and the game summary
+    // tells players apart by name
+    return 'A' + ID % 26; 
 }
 
 /**************** movePlayer() ****************/
@@ -618,16 +1605,60 @@ getPlayerLetter(int ID)
 void 
 movePlayer(gamestatus_t *game, player_t *player, int r, int c)
 {
-    if (game == NULL) {
-		return;
+    if (stepPlayer(game, player, r, c)) {
+        // Update visibility after each move
+        updatePlayerVis(game, player, NULL, 0);
+    }
+}
+
+/**************** sprintPlayer() ****************/
+/* See top of the file for the description */
+void 
+sprintPlayer(gamestatus_t *game, player_t *player, int dr, int dc)
+{
+    if (game == NULL || player == NULL) {
+        return;
+    }
+    grid_t* mainGrid = game->grid;
+    int r = extractRowFromPosition(player->position, mainGrid->ncol);
+    int c = extractColumnFromPosition(player->position, mainGrid->ncol);
+
+    // the game's path has room for the longest run; the key being
+    // handled is always for the current match
+    int maxSteps = mainGrid->nrow > mainGrid->ncol ? mainGrid->nrow : mainGrid->ncol;
+    int* path = match->path;
+    int pathLength = 0;
+    while (pathLength < maxSteps && is_within_bounds(mainGrid, r + dr, c + dc)
+           && !grid_isWall(mainGrid, r + dr, c + dc)) {
+        int from = player->position;
+        if (!stepPlayer(game, player, r + dr, c + dc)) {
+            break;
+        }
+        path[pathLength++] = from;
+        r += dr;
+        c += dc;
+    }
+
+    if (pathLength > 0) {
+        updatePlayerVis(game, player, path, pathLength);
+    }
+}
+
+/**************** stepPlayer() ****************/
+/* See top of the file for the description */
+bool 
+stepPlayer(gamestatus_t *game, player_t *player, int r, int c)
+{
+    if (game == NULL || player == NULL || !player->isPlaying) {
+		return false;
 	}
 
     if(r < 0 || c < 0|| c >= game->grid->ncol || r >= game->grid->nrow){
-        return;
+        return false;
     }
 
 	grid_t* mainGrid = game->grid;
- 	gold_t** gameGold = game->goldPiles;
+ 	goldPool_t* gameGold = game->goldPool;
     if (gameGold == NULL) {
         log_v("Error: Gold piles are null in move player.\n");
     }
@@ -635,20 +1666,13 @@ movePlayer(gamestatus_t *game, player_t *player, int r, int c)
   	char* playerGridArray = player->grid->gridArray;
 	char* mainGridArray = mainGrid->gridArray;
     char* originalGridArray = game->originalGrid->gridArray;
-	// int* gold_array = gameGold->goldCounter;
 
-	player_t** players = (player_t**) game->players;
     int positionToMoveTo = convertCoordinatesToPosition(r, c, mainGrid->ncol);
-	player_t* otherPlayer = NULL;
 
     // check if another player is in the position
-	for(int i = 0; i < game->numPlayers; i++) {
-		otherPlayer = players[i];
-		if ((otherPlayer->position == positionToMoveTo) && (otherPlayer->ID != player->ID)){
-			break;
-		} else{
-            otherPlayer = NULL;
-		}
+	player_t* otherPlayer = gamestatus_playerAt(game, positionToMoveTo);
+	if (otherPlayer == player) {
+		otherPlayer = NULL;
 	}
 
 	if (!grid_isWall(mainGrid, r, c)) {
@@ -662,17 +1686,15 @@ movePlayer(gamestatus_t *game, player_t *player, int r, int c)
             mainGridArray[positionToMoveTo] = getPlayerLetter(player->ID);
 
             player->position = positionToMoveTo;
-
-            for (int i = 0; i < game->numGoldPiles; i++) {
-                if (gameGold[i] == NULL) {
-                    continue;
-                } 
-                if (gameGold[i]->placement == positionToMoveTo && gameGold[i]->isFound == false) {
-                    gameGold[i]->isFound = true;
-                    game->totalGold = game->totalGold - gameGold[i]->value;
-                    player->score = player->score + gameGold[i]->value;
-                    goldPickedUp(game, player, gameGold[i]->value);
-                }
+            gamestatus_setOccupant(game, position, NULL);
+            gamestatus_setOccupant(game, positionToMoveTo, player);
+
+            int pile = gold_poolFind(gameGold, positionToMoveTo);
+            if (pile >= 0) {
+                int value = gold_poolCollect(gameGold, pile);
+                game->totalGold = game->totalGold - value;
+                player->score = player->score + value;
+                goldPickedUp(game, player, value);
             }
 
 		} else if (otherPlayer != NULL) {
@@ -690,6 +1712,9 @@ movePlayer(gamestatus_t *game, player_t *player, int r, int c)
 
             player->position = positionToMoveTo;
             otherPlayer->position = position;
+            otherPlayer->visDirty = true;
+            gamestatus_setOccupant(game, position, otherPlayer);
+            gamestatus_setOccupant(game, positionToMoveTo, player);
 			
 		} else {
             // If we get here, then the spot is just an empty spot/corridor that player is moving to
@@ -698,12 +1723,14 @@ movePlayer(gamestatus_t *game, player_t *player, int r, int c)
             playerGridArray[positionToMoveTo] = '@';
             mainGridArray[positionToMoveTo] = getPlayerLetter(player->ID);
 			player->position = positionToMoveTo;
+            gamestatus_setOccupant(game, position, NULL);
+            gamestatus_setOccupant(game, positionToMoveTo, player);
 		}
-        // Update visibility after each move
-        grid_calculateVis(mainGrid, player->grid, game->originalGrid, 
-                          extractRowFromPosition(player->position, mainGrid->ncol), 
-                          extractColumnFromPosition(player->position, mainGrid->ncol));
+        markChanged(position);
+        markChanged(positionToMoveTo);
+        return true;
 	}
+    return false;
 }
 
 /**************** handlePlayerQuit() ****************/
@@ -719,7 +1746,9 @@ handlePlayerQuit(gamestatus_t *game, const addr_t from)
     player->isPlaying = false;
     player->grid->gridArray[player->position] = game->originalGrid->gridArray[player->position];
     game->grid->gridArray[player->position] = game->originalGrid->gridArray[player->position];
-    player_sendMessage(player, "QUIT Thank you for playing!");
+    gamestatus_setOccupant(game, player->position, NULL);
+    markChanged(player->position);
+    sendToPlayer(player, "QUIT Thank you for playing!");
   } else {
     log_v("No matching player OR spectator found for an incoming QUIT keystroke\n");
   }
@@ -734,7 +1763,7 @@ handleSpectatorQuit(gamestatus_t *game, const addr_t from)
     spectator_t* spectator = game->spectator;
 
     // Send quit message to spectator and remove from gamestatus
-    spectator_sendMessage(spectator, "QUIT Thank you for watching!");
+    sendToSpectator(spectator, "QUIT Thank you for watching!");
     gamestatus_removeSpectator(game);
 }
 
@@ -745,22 +1774,27 @@ sendPlayersGoldMessage(gamestatus_t* game)
 {
     // Loop over every player
     player_t** allPlayers = game->players;
-    int numPlayers = game->numPlayers;
+    int numSlots = game->playerSlots;
 
     // Buffer for the gold message
     char goldMessage[100]; // Declare a fixed-size array for the message
 
-    for (int i = 0; i < numPlayers; i++) {
-        if (allPlayers[i] == NULL) {
+    // GOLD only goes to players who don't yet know how much is left: the
+    // total changed, or they just joined. Their own pickups were sent by
+    // goldPickedUp
+    for (int i = 0; i < numSlots; i++) {
+        if (allPlayers[i] == NULL || !allPlayers[i]->isPlaying
+            || allPlayers[i]->goldSeen == game->totalGold) {
             continue;
         }
+        allPlayers[i]->goldSeen = game->totalGold;
         int currentPlayerGold = allPlayers[i]->score;
         int justCollectedGold = 0;
         int goldLeftInGame = game->totalGold;
 
         // Format the message
         snprintf(goldMessage, sizeof(goldMessage), "GOLD %d %d %d", justCollectedGold, currentPlayerGold, goldLeftInGame);
-        player_sendMessage(allPlayers[i], goldMessage);
+        sendToPlayer(allPlayers[i], goldMessage);
     }
 }
 
@@ -781,7 +1815,7 @@ sendSpectatorGoldMessage(gamestatus_t* game)
     // Create the gold message and send it
     char goldMessage[100];
     sprintf(goldMessage, "GOLD %d %d %d", goldCollected, goldCollectedTotal, goldLeftInGame);
-    spectator_sendMessage(spectator, goldMessage);
+    sendToSpectator(spectator, goldMessage);
 
 }
 
@@ -790,18 +1824,113 @@ sendSpectatorGoldMessage(gamestatus_t* game)
 void 
 sendPlayerDisplayMessage(gamestatus_t* game, player_t* player)
 {
-    // Update player's visible grid
-    grid_t* mainGrid = game->grid;
-    grid_t* originalGrid = game->originalGrid;
-    grid_calculateVis(mainGrid, player->grid, originalGrid, extractRowFromPosition(player->position, mainGrid->ncol), extractColumnFromPosition(player->position, mainGrid->ncol));
+    refreshPlayerGrid(game, player, &match->changes);
+    sendGridFrame(player->IPaddress, player->frames, player->batched, player->grid);
+}
+
+/**************** refreshPlayerGrid() ****************/
+/* See top of the file for the description */
+bool 
+refreshPlayerGrid(gamestatus_t* game, player_t* player, const cellChanges_t* changes)
+{
+    // Update player's visible grid: players who moved need a new visible
+    // set, everyone else only needs the cells that changed since last time,
+    // and no frame at all if they saw none of them. A player whose move
+    // already redrew their grid (updatePlayerVis) needs one either way
+    if (player->visDirty || player->visible == NULL) {
+        updatePlayerVis(game, player, NULL, 0);
+    } else if (grid_patchVis(game->grid, player->grid, game->originalGrid,
+                             player->visible, changes->positions, changes->count) > 0) {
+        player->gridDirty = true;
+    }
 
     player->grid->gridArray[player->position] = '@';
+    bool changed = player->gridDirty;
+    if (changed) {
+        letterPlayers(game, player);
+    }
+    player->gridDirty = false;
+    return changed;
+}
 
-    // grid_toString sends a string in the format: 'DISPLAY\n[grid with rows seperated by \n]'
-    char playerGridAsString[10000];
-    grid_toString(player->grid, playerGridAsString);
-    player_sendMessage(player, playerGridAsString);
-    
+/**************** letterPlayers() ****************/
+/* See top of the file for the description */
+void 
+letterPlayers(gamestatus_t* game, player_t* player)
+{
+    // runs on pool threads as well: reads the occupancy map and the other
+    // players, but writes only this player's grid and letters
+    char* gridArray = player->grid->gridArray;
+    const char* originalGridArray = game->originalGrid->gridArray;
+    int ncol = player->grid->ncol;
+    int cells = player->grid->nrow * ncol;
+    const uint64_t* visible = player->visible;
+    bool inSight[PlayerLetters] = { false };
+    int newcomers[PlayerLetters]; // cells of players in sight with no letter yet
+    int numNewcomers = 0;
+
+    // players in sight who had a letter keep it. Only the cells in the
+    // visible set are looked at, a word at a time, so a frame costs the
+    // cells in sight rather than the map
+    for (int w = 0; w < (cells + 63) / 64; w++) {
+        for (uint64_t word = visible != NULL ? visible[w] : ~0ull; word != 0; word &= word - 1) {
+            int i = w * 64 + __builtin_ctzll(word);
+            if (i >= cells) {
+                break;
+            }
+            int position = i + i / ncol; // the row's '\n' comes after each row
+            if (gridArray[position] < 'A' || gridArray[position] > 'Z') {
+                continue;
+            }
+            player_t* other = gamestatus_playerAt(game, position);
+            if (other == NULL) { // should not happen, but never name nobody
+                gridArray[position] = originalGridArray[position];
+                continue;
+            }
+            int letter = other->ID % PlayerLetters;
+            for (int j = 0; player->letters[letter] != other->ID + 1 && j < PlayerLetters; j++) {
+                letter = j;
+            }
+            if (player->letters[letter] == other->ID + 1) {
+                inSight[letter] = true;
+                gridArray[position] = 'A' + letter;
+            } else if (numNewcomers < PlayerLetters) {
+                newcomers[numNewcomers++] = position;
+            }
+        }
+    }
+
+    // the rest take a letter nobody in sight has, their own if they can;
+    // past 26 in sight at once the last keep the main grid's, and repeat
+    for (int n = 0; n < numNewcomers; n++) {
+        player_t* other = gamestatus_playerAt(game, newcomers[n]);
+        int letter = other->ID % PlayerLetters;
+        for (int i = 0; inSight[letter] && i < PlayerLetters; i++) {
+            letter = i;
+        }
+        if (!inSight[letter]) {
+            inSight[letter] = true;
+            player->letters[letter] = other->ID + 1;
+            gridArray[newcomers[n]] = 'A' + letter;
+        }
+    }
+}
+
+/**************** prepareDisplay() ****************/
+/* See top of the file for the description */
+void 
+prepareDisplay(void* arg, const int index)
+{
+    // runs on a pool thread: only this player's grid, visible set and
+    // frames are written, and nothing is sent from here
+    displayRound_t* round = arg;
+    player_t* player = round->players[index];
+    char* frame = &round->frames[index * round->frameSize];
+
+    if (!refreshPlayerGrid(round->game, player, round->changes)
+        || encodeGridFrame(player->frames, player->grid, frame, round->frameSize) == 0) {
+        frame[0] = '\0';
+    }
 }
 
 /**************** sendSpectatorDisplayMessage() ****************/
@@ -814,11 +1943,80 @@ sendSpectatorDisplayMessage(gamestatus_t* game, spectator_t* spectator)
         return;
     }
 
-    // grid_toString sends a string in the format: 'DISPLAY\n[grid with rows seperated by \n]'
-    grid_t* mainGrid = game->grid;
-    char mainGridString[message_MaxBytes];
-    grid_toString(mainGrid, mainGridString);
-    spectator_sendMessage(spectator, mainGridString);
+    sendGridFrame(spectator->IPaddress, spectator->frames, spectator->batched, game->grid);
+}
+
+/**************** sendGridFrame() ****************/
+/* See top of the file for the description */
+void 
+sendGridFrame(const addr_t to, delta_t* frames, const bool batched, grid_t* grid)
+{
+    if (encodeGridFrame(frames, grid, frameBuffer, frameBufferSize) > 0) {
+        sendToClient(to, batched, frameBuffer);
+    }
+}
+
+/**************** encodeGridFrame() ****************/
+/* See top of the file for the description */
+int 
+encodeGridFrame(delta_t* frames, grid_t* grid, char* buffer, size_t size)
+{
+    // only the cells changed since the client's last ACK, or a keyframe
+    if (frames != NULL) {
+        int seq = delta_encode(frames, grid->gridArray, grid->ncol + 1, buffer, size);
+        if (seq > 0) {
+            return seq;
+        }
+    }
+
+    // grid_serialize writes a string in the format: 'DISPLAY\n[grid with rows seperated by \n]'
+    return (int)grid_serialize(grid, buffer, size);
+}
+
+/**************** sendToClient() ****************/
+/* See top of the file for the description */
+void 
+sendToClient(const addr_t to, const bool batched, const char* message)
+{
+    // the outbox copies the message, so callers may reuse their buffer
+    if (batched && batch_add(outbox, to, message)) {
+        return;
+    }
+    fragment_send(to, message);
+}
+
+/**************** sendToPlayer() ****************/
+/* See top of the file for the description */
+void 
+sendToPlayer(player_t* player, const char* message)
+{
+    if (player != NULL) {
+        sendToClient(player->IPaddress, player->batched, message);
+    }
+}
+
+/**************** sendToSpectator() ****************/
+/* See top of the file for the description */
+void 
+sendToSpectator(spectator_t* spectator, const char* message)
+{
+    if (spectator != NULL) {
+        sendToClient(spectator->IPaddress, spectator->batched, message);
+    }
+}
+
+/**************** hasOption() ****************/
+/* See top of the file for the description */
+bool 
+hasOption(const char* options, const char* name)
+{
+    size_t length = strlen(name);
+    for (const char* p = strstr(options, name); p != NULL; p = strstr(p + length, name)) {
+        if ((p == options || p[-1] == ' ') && (p[length] == '\0' || p[length] == ' ')) {
+            return true;
+        }
+    }
+    return false;
 }
 
 /**************** extractRowFromPosition() ****************/
@@ -872,20 +2070,22 @@ void endGame(gamestatus_t *game) {
         return;
     }
 
-    // Calculate the maximum required size for the endMessage buffer
-    size_t maxMessageSize = numPlayers * (MaxNameLength + 20) + 25;
-    char *endMessage = calloc(maxMessageSize, sizeof(char));
+    // Calculate the maximum required size for the endMessage buffer; it
+    // comes from the game's arena, and goes when the game is deleted
+    size_t maxMessageSize = (size_t)numPlayers * (MaxNameLength + 20) + 25;
+    char *endMessage = arena_calloc(game->arena, maxMessageSize * sizeof(char));
     if (endMessage == NULL) {
         log_v("Memory allocation failed for endMessage...\n");
         return;
     }
 
     strcpy(endMessage, "QUIT GAME OVER:\n"); // Initialize with a message
+    size_t length = strlen(endMessage);       // so appending doesn't rescan it
 
-    for (int i = 0; i < numPlayers; i++) {
+    int numSlots = game->playerSlots;
+    for (int i = 0; i < numSlots; i++) {
         if (allPlayers[i] == NULL) {
-            log_v("Skipping uninitialized player slot...\n");
-            continue;
+            continue;   // the players array has room for more than joined
         }
 #ifdef DEBUGPRINT
         printf("Player Name in endGame Before Formatting: %s\n", allPlayers[i]->name);
@@ -899,24 +2099,22 @@ void endGame(gamestatus_t *game) {
         printf("Generated Message for Player %d: %s", i, tempBuffer);
 #endif
         // Append to the message
-        strncat(endMessage, tempBuffer, maxMessageSize - strlen(endMessage) - 1);
+        strncat(endMessage + length, tempBuffer, maxMessageSize - length - 1);
+        length += strlen(endMessage + length);
     }
 
 
     // Send the message to all players
-    for (int i = 0; i < numPlayers; i++) {
+    for (int i = 0; i < numSlots; i++) {
         if (allPlayers[i] != NULL) {
-            player_sendMessage(allPlayers[i], endMessage);
+            sendToPlayer(allPlayers[i], endMessage);
         }
     }
 
     // Send the message to the spectator, if present
     if (game->spectator != NULL) {
-        spectator_sendMessage(game->spectator, endMessage);
+        sendToSpectator(game->spectator, endMessage);
     }
-
-    // Free the dynamically allocated buffer
-    free(endMessage);
 }
 
 /**************** goldPickedUp() ****************/
@@ -930,8 +2128,77 @@ goldPickedUp(gamestatus_t* game, player_t* player, int goldPileValue)
     // Format individual GOLD message and send to player
     char goldCollectedMessage[50];
     sprintf(goldCollectedMessage, "GOLD %d %d %d", goldPileValue, currentPlayerGold, goldLeftInGame);
-    player_sendMessage(player, goldCollectedMessage);
+    sendToPlayer(player, goldCollectedMessage);
+    player->goldSeen = goldLeftInGame;
 
-    sendUpdatedGold(game);
+    // in tick mode everyone gets their GOLD once, at the end of the tick
+    if (!tickMode) {
+        sendUpdatedGold(game);
+    }
+}
+
+/**************** initChanges() ****************/
+/* See top of the file for the description */
+bool 
+initChanges(cellChanges_t* changes, gamestatus_t* game)
+{
+    int size = game->grid->nrow * (game->grid->ncol + 1);
+    changes->positions = malloc(size * sizeof(int));
+    changes->isMarked = calloc(size, sizeof(bool));
+    changes->count = 0;
+    return changes->positions != NULL && changes->isMarked != NULL;
+}
+
+/**************** markChanged() ****************/
+/* See top of the file for the description */
+void 
+markChanged(int position)
+{
+    cellChanges_t* changes = &match->changes;
+    if (changes->isMarked == NULL || changes->isMarked[position]) {
+        return;
+    }
+    changes->isMarked[position] = true;
+    changes->positions[changes->count++] = position;
+    grid_markDirty(match->game->grid, position);
+}
+
+/**************** clearChanges() ****************/
+/* See top of the file for the description */
+void 
+clearChanges(void)
+{
+    cellChanges_t* changes = &match->changes;
+    for (int i = 0; i < changes->count; i++) {
+        changes->isMarked[changes->positions[i]] = false;
+    }
+    changes->count = 0;
+    grid_clearDirty(match->game->grid);
 }
 
+/**************** updatePlayerVis() ****************/
+/* See top of the file for the description */
+void 
+updatePlayerVis(gamestatus_t* game, player_t* player, const int* path, int pathLength)
+{
+    grid_t* mainGrid = game->grid;
+    int r = extractRowFromPosition(player->position, mainGrid->ncol);
+    int c = extractColumnFromPosition(player->position, mainGrid->ncol);
+
+    player->gridDirty = true;
+    if (player->visible == NULL) {
+        player->visible = calloc((mainGrid->nrow * mainGrid->ncol + 63) / 64, sizeof(uint64_t));
+    }
+    if (player->visible == NULL) {
+        // no room to remember the set, so this player stays dirty
+        log_v("Could not allocate a visible set, recomputing every time...\n");
+        grid_calculateVis(mainGrid, player->grid, game->originalGrid, r, c);
+        return;
+    }
+    if (pathLength > 0) {
+        grid_sprintVis(mainGrid, player->grid, game->originalGrid, path, pathLength, r, c, player->visible);
+    } else {
+        grid_updateVis(mainGrid, player->grid, game->originalGrid, r, c, player->visible);
+    }
+    player->visDirty = false;
+}
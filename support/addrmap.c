@@ -0,0 +1,349 @@
+/*
+ * addrmap - a hash table from client address to a small integer
+ *
+ * see addrmap.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "message.h"
+#include "addrmap.h"
+
+/**************** file-local constants ****************/
+static const int MinSlots = 64;     // starting size of the table, a power of two
+
+/**************** local types ****************/
+typedef struct slot {
+  uint64_t key;       // the address, from addressKey
+  int value;          // its value, or -1 if this slot is empty
+} slot_t;
+
+typedef struct addrmap {
+  slot_t* slots;      // numSlots long
+  int numSlots;       // a power of two, kept at least twice numKeys
+  int numKeys;
+} addrmap_t;
+
+/**************** file-local functions ****************/
+static uint64_t addressKey(const addr_t address);
+static int home(const uint64_t key, const int numSlots);
+static slot_t* findSlot(addrmap_t* map, const uint64_t key);
+static void removeSlot(addrmap_t* map, int i);
+static bool grow(addrmap_t* map);
+
+/**************** addrmap_new ****************/
+/* see addrmap.h for description */
+addrmap_t*
+addrmap_new(void)
+{
+  addrmap_t* map = malloc(sizeof(addrmap_t));
+  if (map == NULL) {
+    return NULL;
+  }
+  map->slots = malloc(MinSlots * sizeof(slot_t));
+  if (map->slots == NULL) {
+    free(map);
+    return NULL;
+  }
+  map->numSlots = MinSlots;
+  addrmap_clear(map);
+  return map;
+}
+
+/**************** addrmap_get ****************/
+/* see addrmap.h for description */
+int
+addrmap_get(addrmap_t* map, const addr_t address)
+{
+  if (map == NULL) {
+    return -1;
+  }
+  return findSlot(map, addressKey(address))->value;
+}
+
+/**************** addrmap_put ****************/
+/* see addrmap.h for description */
+bool
+addrmap_put(addrmap_t* map, const addr_t address, const int value)
+{
+  if (map == NULL || value < 0) {
+    return false;
+  }
+  uint64_t key = addressKey(address);
+  slot_t* slot = findSlot(map, key);
+  if (slot->value < 0) {
+    // grow before the table is half full, so probes stay short
+    if (2 * (map->numKeys + 1) > map->numSlots) {
+      if (!grow(map)) {
+        return false;
+      }
+      slot = findSlot(map, key);
+    }
+    slot->key = key;
+    map->numKeys++;
+  }
+  slot->value = value;
+  return true;
+}
+
+/**************** addrmap_remove ****************/
+/* see addrmap.h for description */
+int
+addrmap_remove(addrmap_t* map, const addr_t address)
+{
+  if (map == NULL) {
+    return -1;
+  }
+  slot_t* slot = findSlot(map, addressKey(address));
+  int value = slot->value;
+  if (value >= 0) {
+    removeSlot(map, slot - map->slots);
+  }
+  return value;
+}
+
+/**************** addrmap_removeValue ****************/
+/* see addrmap.h for description */
+int
+addrmap_removeValue(addrmap_t* map, const int value)
+{
+  if (map == NULL || value < 0) {
+    return 0;
+  }
+  // removing slot i may shift a later entry (or, past the end of the
+  // table, one from the front, which has been looked at) into it, so
+  // look at i again before moving on
+  int removed = 0;
+  for (int i = 0; i < map->numSlots; i++) {
+    while (map->slots[i].value == value) {
+      removeSlot(map, i);
+      removed++;
+    }
+  }
+  return removed;
+}
+
+/**************** addrmap_clear ****************/
+/* see addrmap.h for description */
+void
+addrmap_clear(addrmap_t* map)
+{
+  if (map != NULL) {
+    for (int i = 0; i < map->numSlots; i++) {
+      map->slots[i].value = -1;
+    }
+    map->numKeys = 0;
+  }
+}
+
+/**************** addrmap_size ****************/
+/* see addrmap.h for description */
+int
+addrmap_size(addrmap_t* map)
+{
+  return map == NULL ? 0 : map->numKeys;
+}
+
+/**************** addrmap_delete ****************/
+/* see addrmap.h for description */
+void
+addrmap_delete(addrmap_t* map)
+{
+  if (map != NULL) {
+    free(map->slots);
+    free(map);
+  }
+}
+
+/**************** addressKey ****************/
+/* Pack an IPv4 address and port into one key: the address in bits
+ * 16-47, the port in bits 0-15.
+ */
+static uint64_t
+addressKey(const addr_t address)
+{
+  return ((uint64_t) ntohl(address.sin_addr.s_addr) << 16) | ntohs(address.sin_port);
+}
+
+/**************** home ****************/
+/* The slot a key's probe starts from (Fibonacci hashing). */
+static int
+home(const uint64_t key, const int numSlots)
+{
+  return (int) ((key * 0x9E3779B97F4A7C15ull) >> 40) & (numSlots - 1);
+}
+
+/**************** findSlot ****************/
+/* The slot holding key, or the empty slot where it would go. */
+static slot_t*
+findSlot(addrmap_t* map, const uint64_t key)
+{
+  int mask = map->numSlots - 1;
+  int i = home(key, map->numSlots);
+  while (map->slots[i].value >= 0 && map->slots[i].key != key) {
+    i = (i + 1) & mask;
+  }
+  return &map->slots[i];
+}
+
+/**************** removeSlot ****************/
+/* Empty slot i, shifting back any later entry in its run that would
+ * otherwise no longer be found.
+ */
+static void
+removeSlot(addrmap_t* map, int i)
+{
+  int mask = map->numSlots - 1;
+  for (int j = (i + 1) & mask; map->slots[j].value >= 0; j = (j + 1) & mask) {
+    int h = home(map->slots[j].key, map->numSlots);
+    // move j to i unless its home lies cyclically in (i, j]
+    if ((j > i && (h <= i || h > j)) || (j < i && h <= i && h > j)) {
+      map->slots[i] = map->slots[j];
+      i = j;
+    }
+  }
+  map->slots[i].value = -1;
+  map->numKeys--;
+}
+
+/**************** grow ****************/
+/* Double the table and rehash into it. Return false, keeping the old
+ * table, if there is no memory.
+ */
+static bool
+grow(addrmap_t* map)
+{
+  int numSlots = 2 * map->numSlots;
+  slot_t* slots = malloc(numSlots * sizeof(slot_t));
+  if (slots == NULL) {
+    return false;
+  }
+  for (int i = 0; i < numSlots; i++) {
+    slots[i].value = -1;
+  }
+  for (int i = 0; i < map->numSlots; i++) {
+    if (map->slots[i].value >= 0) {
+      int j = home(map->slots[i].key, numSlots);
+      while (slots[j].value >= 0) {
+        j = (j + 1) & (numSlots - 1);
+      }
+      slots[j] = map->slots[i];
+    }
+  }
+  free(map->slots);
+  map->slots = slots;
+  map->numSlots = numSlots;
+  return true;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test puts a few thousand made-up addresses in a map
+ * (enough to grow it several times), changes some values, removes
+ * some addresses one at a time and others by value, clears it and
+ * fills it again, and checks every address against a plain array after
+ * each step. Consecutive hosts and ports make long probe runs, which
+ * is where a wrong shift on removal would lose entries.
+ *
+ *   ./addrmaptest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+#define TestAddresses 3000
+
+// the made-up client i: a few ports on each of many hosts
+static addr_t
+testAddress(const int i)
+{
+  addr_t address = { 0 };
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(0x0A000000 + i / 3);
+  address.sin_port = htons(40000 + i % 3);
+  return address;
+}
+
+// how many addresses disagree with the expected values
+static int
+mismatches(addrmap_t* map, const int* expected)
+{
+  int bad = 0;
+  int size = 0;
+  for (int i = 0; i < TestAddresses; i++) {
+    bad += addrmap_get(map, testAddress(i)) != expected[i];
+    size += expected[i] >= 0;
+  }
+  return bad + (addrmap_size(map) != size);
+}
+
+int
+main(const int argc, char* argv[])
+{
+  int failures = 0;
+  int expected[TestAddresses];
+
+  addrmap_t* map = addrmap_new();
+  CHECK(map != NULL);
+  CHECK(addrmap_get(map, testAddress(0)) == -1);
+  CHECK(!addrmap_put(map, testAddress(0), -1));
+  CHECK(addrmap_remove(map, testAddress(0)) == -1);
+
+  for (int i = 0; i < TestAddresses; i++) {
+    expected[i] = i % 7;
+    CHECK(addrmap_put(map, testAddress(i), expected[i]));
+  }
+  CHECK(mismatches(map, expected) == 0);
+  for (int i = 0; i < TestAddresses; i += 2) {
+    expected[i] = i;
+    CHECK(addrmap_put(map, testAddress(i), i));
+  }
+  CHECK(mismatches(map, expected) == 0);
+
+  // every fifth address goes, some twice
+  for (int i = 0; i < TestAddresses; i += 5) {
+    CHECK(addrmap_remove(map, testAddress(i)) == expected[i]);
+    CHECK(addrmap_remove(map, testAddress(i)) == -1);
+    expected[i] = -1;
+  }
+  CHECK(mismatches(map, expected) == 0);
+
+  // then everything with value 3
+  int threes = 0;
+  for (int i = 0; i < TestAddresses; i++) {
+    if (expected[i] == 3) {
+      expected[i] = -1;
+      threes++;
+    }
+  }
+  CHECK(addrmap_removeValue(map, 3) == threes);
+  CHECK(addrmap_removeValue(map, 3) == 0);
+  CHECK(mismatches(map, expected) == 0);
+
+  addrmap_clear(map);
+  for (int i = 0; i < TestAddresses; i++) {
+    expected[i] = -1;
+  }
+  CHECK(mismatches(map, expected) == 0);
+  for (int i = TestAddresses - 1; i >= 0; i -= 3) {
+    expected[i] = i;
+    CHECK(addrmap_put(map, testAddress(i), i));
+  }
+  CHECK(mismatches(map, expected) == 0);
+
+  addrmap_delete(map);
+  addrmap_delete(NULL);
+  CHECK(addrmap_get(NULL, testAddress(0)) == -1);
+  CHECK(addrmap_size(NULL) == 0);
+
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
@@ -0,0 +1,89 @@
+/*
+ * addrmap - a hash table from client address to a small integer
+ *
+ * Maps IPv4 addresses and ports to ints (>= 0), such as a game's slot
+ * or an index into the caller's own array, so finding what belongs to
+ * the sender of a datagram is one lookup however many clients there
+ * are. The lobby routes addresses to games with one, gamestatus finds
+ * sessions with one, and batch finds each recipient's queue with one.
+ *
+ * Open addressing with linear probing, kept at most half full; the key
+ * packs the address and port into 64 bits, and removal shifts later
+ * entries back rather than leaving tombstones.
+ *
+ * Typical use:
+ *   map = addrmap_new();
+ *   addrmap_put(map, from, index);
+ *   index = addrmap_get(map, from);         // -1 if from is not there
+ *   addrmap_remove(map, from);
+ *   addrmap_delete(map);
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _ADDRMAP_H_
+#define _ADDRMAP_H_
+
+#include <stdbool.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct addrmap addrmap_t;  // opaque to users of this module
+
+/****************** global functions *********************/
+
+/******************************************/
+/* addrmap_new: create an empty map.
+ * Function returns:
+ *   new map, or NULL on error.
+ * Caller is responsible for calling addrmap_delete later.
+ */
+addrmap_t* addrmap_new(void);
+
+/******************************************/
+/* addrmap_get: the value for an address.
+ * Function returns:
+ *   the value, or -1 if the address is not in the map (or map is NULL).
+ */
+int addrmap_get(addrmap_t* map, const addr_t address);
+
+/******************************************/
+/* addrmap_put: set the value for an address, adding it if need be.
+ * Caller provides:
+ *   the value, >= 0.
+ * Function returns:
+ *   false if value is negative or there is no memory to grow the map,
+ *   which is then unchanged. Changing the value of an address already
+ *   in the map never fails.
+ */
+bool addrmap_put(addrmap_t* map, const addr_t address, const int value);
+
+/******************************************/
+/* addrmap_remove: take an address out of the map.
+ * Function returns:
+ *   the value it had, or -1 if it was not there.
+ */
+int addrmap_remove(addrmap_t* map, const addr_t address);
+
+/******************************************/
+/* addrmap_removeValue: take out every address with the given value,
+ * in one pass over the table and with no allocation.
+ * Function returns:
+ *   how many addresses were removed.
+ */
+int addrmap_removeValue(addrmap_t* map, const int value);
+
+/******************************************/
+/* addrmap_clear: take every address out; the table keeps its size. */
+void addrmap_clear(addrmap_t* map);
+
+/******************************************/
+/* addrmap_size: how many addresses are in the map (0 if map is NULL). */
+int addrmap_size(addrmap_t* map);
+
+/******************************************/
+/* addrmap_delete: free the map. NULL is ignored. */
+void addrmap_delete(addrmap_t* map);
+
+#endif // _ADDRMAP_H_
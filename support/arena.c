@@ -0,0 +1,293 @@
+/*
+ * arena - one game's memory, freed all at once
+ *
+ * see arena.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "arena.h"
+
+/**************** file-local constants ****************/
+#define Lists 8                             // sizes arena_recycle keeps lists for
+static const size_t Align = _Alignof(max_align_t);  // every block starts on this
+
+/**************** local types ****************/
+typedef struct chunk {
+  struct chunk* next;
+  size_t size;                        // bytes in data
+  size_t used;                        // bytes handed out from the front of data
+  max_align_t data[];
+} chunk_t;
+
+typedef struct freeList {
+  size_t size;                        // rounded block size, 0 if the list is unused
+  void* head;                         // each recycled block starts with the next one
+} freeList_t;
+
+typedef struct arena {
+  chunk_t* chunks;                    // the first one is the one being carved
+  size_t chunkSize;
+  size_t bytes;                       // taken from malloc so far
+  freeList_t lists[Lists];
+} arena_t;
+
+/**************** file-local functions ****************/
+static size_t roundUp(const size_t size);
+static chunk_t* newChunk(arena_t* arena, const size_t size);
+
+/**************** arena_new ****************/
+/* see arena.h for description */
+arena_t*
+arena_new(const size_t chunkSize)
+{
+  arena_t* arena = calloc(1, sizeof(arena_t));
+  if (arena == NULL) {
+    return NULL;
+  }
+  arena->chunkSize = roundUp(chunkSize > 0 ? chunkSize : arena_DefaultChunk);
+  return arena;
+}
+
+/**************** arena_alloc ****************/
+/* see arena.h for description */
+void*
+arena_alloc(arena_t* arena, const size_t size)
+{
+  if (arena == NULL || size == 0) {
+    return NULL;
+  }
+  size_t rounded = roundUp(size);
+
+  // a recycled block of the same size first
+  for (int i = 0; i < Lists; i++) {
+    freeList_t* list = &arena->lists[i];
+    if (list->size == rounded && list->head != NULL) {
+      void* block = list->head;
+      memcpy(&list->head, block, sizeof(void*));
+      return block;
+    }
+  }
+
+  chunk_t* chunk = arena->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < rounded) {
+    if (rounded > arena->chunkSize) {
+      // a big block gets a chunk to itself, behind the one being carved
+      chunk = newChunk(arena, rounded);
+      if (chunk == NULL) {
+        return NULL;
+      }
+      if (arena->chunks != NULL) {
+        chunk->next = arena->chunks->next;
+        arena->chunks->next = chunk;
+      } else {
+        arena->chunks = chunk;
+      }
+    } else {
+      chunk = newChunk(arena, arena->chunkSize);
+      if (chunk == NULL) {
+        return NULL;
+      }
+      chunk->next = arena->chunks;
+      arena->chunks = chunk;
+    }
+  }
+  void* block = (char*)chunk->data + chunk->used;
+  chunk->used += rounded;
+  return block;
+}
+
+/**************** arena_calloc ****************/
+/* see arena.h for description */
+void*
+arena_calloc(arena_t* arena, const size_t size)
+{
+  void* block = arena_alloc(arena, size);
+  if (block != NULL) {
+    memset(block, 0, size);
+  }
+  return block;
+}
+
+/**************** arena_recycle ****************/
+/* see arena.h for description */
+void
+arena_recycle(arena_t* arena, void* block, const size_t size)
+{
+  if (arena == NULL || block == NULL || size == 0) {
+    return;
+  }
+  size_t rounded = roundUp(size);
+  freeList_t* list = NULL;
+  for (int i = 0; i < Lists && list == NULL; i++) {
+    if (arena->lists[i].size == rounded || arena->lists[i].size == 0) {
+      list = &arena->lists[i];
+    }
+  }
+  if (list != NULL) {
+    list->size = rounded;
+    memcpy(block, &list->head, sizeof(void*));
+    list->head = block;
+  }
+}
+
+/**************** arena_bytes ****************/
+/* see arena.h for description */
+size_t
+arena_bytes(arena_t* arena)
+{
+  return arena == NULL ? 0 : arena->bytes;
+}
+
+/**************** arena_delete ****************/
+/* see arena.h for description */
+void
+arena_delete(arena_t* arena)
+{
+  if (arena != NULL) {
+    while (arena->chunks != NULL) {
+      chunk_t* next = arena->chunks->next;
+      free(arena->chunks);
+      arena->chunks = next;
+    }
+    free(arena);
+  }
+}
+
+/**************** roundUp ****************/
+/* A size rounded up to a whole number of Align, so the next block is
+ * aligned too; never less than Align, which leaves room for the link
+ * of a recycled block.
+ */
+static size_t
+roundUp(const size_t size)
+{
+  if (size <= Align) {
+    return Align;
+  }
+  return (size + Align - 1) / Align * Align;
+}
+
+/**************** newChunk ****************/
+/* Malloc an empty chunk with room for size bytes; NULL on error. */
+static chunk_t*
+newChunk(arena_t* arena, const size_t size)
+{
+  chunk_t* chunk = malloc(sizeof(chunk_t) + size);
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->next = NULL;
+  chunk->size = size;
+  chunk->used = 0;
+  arena->bytes += sizeof(chunk_t) + size;
+  return chunk;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test carves blocks of many sizes from a small arena and
+ * checks each is aligned and keeps its own contents, that a block
+ * bigger than a chunk works, that arena_calloc clears, and that
+ * players coming and going (recycling blocks of a few sizes) do not
+ * grow the arena.
+ *
+ *   ./arenatest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+#define Blocks 500
+
+int
+main(const int argc, char* argv[])
+{
+  int failures = 0;
+  CHECK(arena_alloc(NULL, 10) == NULL);
+  arena_t* arena = arena_new(1024);
+  CHECK(arena != NULL);
+  CHECK(arena_alloc(arena, 0) == NULL);
+
+  // blocks of many sizes, each filled with its own byte
+  unsigned char* blocks[Blocks];
+  size_t sizes[Blocks];
+  for (int i = 0; i < Blocks; i++) {
+    sizes[i] = 1 + (i * 37) % 300;
+    blocks[i] = arena_alloc(arena, sizes[i]);
+    CHECK(blocks[i] != NULL);
+    CHECK((uintptr_t)blocks[i] % Align == 0);
+    memset(blocks[i], i & 0xff, sizes[i]);
+  }
+  int overwritten = 0;
+  for (int i = 0; i < Blocks; i++) {
+    for (size_t b = 0; b < sizes[i]; b++) {
+      if (blocks[i][b] != (i & 0xff)) {
+        overwritten++;
+      }
+    }
+  }
+  CHECK(overwritten == 0);
+
+  // bigger than a chunk, then small ones still come from the chunk
+  size_t before = arena_bytes(arena);
+  char* big = arena_alloc(arena, 5000);
+  CHECK(big != NULL);
+  memset(big, 'x', 5000);
+  CHECK(arena_bytes(arena) >= before + 5000);
+  CHECK(arena_alloc(arena, 8) != NULL);
+
+  int* zeros = arena_calloc(arena, 100 * sizeof(int));
+  int nonzero = 0;
+  for (int i = 0; i < 100; i++) {
+    nonzero += zeros[i] != 0;
+  }
+  CHECK(nonzero == 0);
+
+  // a recycled block comes back for the same size, not another
+  void* a = arena_alloc(arena, 200);
+  arena_recycle(arena, a, 200);
+  CHECK(arena_alloc(arena, 100) != a);
+  CHECK(arena_alloc(arena, 200) == a);
+  CHECK(arena_alloc(arena, 200) != a);
+
+  // players joining and leaving: three blocks each, reused every time
+  void* player[3];
+  size_t playerSizes[] = { 72, 1700, 40 };
+  for (int k = 0; k < 3; k++) {
+    player[k] = arena_alloc(arena, playerSizes[k]);
+  }
+  before = arena_bytes(arena);
+  for (int round = 0; round < 10000; round++) {
+    for (int k = 0; k < 3; k++) {
+      arena_recycle(arena, player[k], playerSizes[k]);
+    }
+    for (int k = 2; k >= 0; k--) {
+      player[k] = arena_alloc(arena, playerSizes[k]);
+      memset(player[k], round & 0xff, playerSizes[k]);
+    }
+  }
+  CHECK(arena_bytes(arena) == before);
+
+  // more sizes than lists: the extras are simply not reused
+  for (int i = 0; i < 2 * Lists; i++) {
+    arena_recycle(arena, arena_alloc(arena, 1000 + i * Align), 1000 + i * Align);
+  }
+  CHECK(arena_alloc(arena, 1000 + (2 * Lists - 1) * Align) != NULL);
+
+  arena_recycle(arena, NULL, 10);
+  arena_delete(arena);
+  arena_delete(NULL);
+
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
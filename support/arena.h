@@ -0,0 +1,82 @@
+/*
+ * arena - one game's memory, freed all at once
+ *
+ * Hands out blocks carved from a few large chunks, so a game's grids,
+ * players and gold cost a handful of mallocs between them, and the
+ * game gives every block back with one arena_delete instead of one
+ * free per object. Blocks are aligned for any type.
+ *
+ * Blocks are not freed one at a time, but one can be recycled: the
+ * next arena_alloc of exactly the same size gets it back. A game's
+ * players all have blocks of the same few sizes, so players coming and
+ * going reuse each other's memory rather than growing the arena.
+ *
+ * An arena is not thread-safe; it belongs to whoever owns the game.
+ *
+ * Typical use:
+ *   arena = arena_new(0);
+ *   player = arena_alloc(arena, sizeof(player_t));
+ *   ...
+ *   arena_recycle(arena, player, sizeof(player_t));   // a player left
+ *   arena_delete(arena);                              // game over
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include <stddef.h>
+
+/****************** types *********************/
+typedef struct arena arena_t;  // opaque to users of this module
+
+/****************** constants *********************/
+// bytes in each chunk unless arena_new is told otherwise
+static const size_t arena_DefaultChunk = 64 * 1024;
+
+/****************** global functions *********************/
+
+/******************************************/
+/* arena_new: create an empty arena.
+ * Caller provides:
+ *   the size of the chunks to carve blocks from, or 0 for
+ *   arena_DefaultChunk; bigger blocks get a chunk of their own.
+ * Function returns:
+ *   new arena, or NULL on error.
+ * Caller is responsible for calling arena_delete later.
+ */
+arena_t* arena_new(const size_t chunkSize);
+
+/******************************************/
+/* arena_alloc: a block of at least size bytes, not cleared.
+ * Function returns:
+ *   the block, which lasts until arena_delete, or NULL on error
+ *   (or if size is 0).
+ */
+void* arena_alloc(arena_t* arena, const size_t size);
+
+/******************************************/
+/* arena_calloc: like arena_alloc, but the block is set to zeros. */
+void* arena_calloc(arena_t* arena, const size_t size);
+
+/******************************************/
+/* arena_recycle: let a later arena_alloc of the same size reuse a block.
+ * Caller provides:
+ *   a block from this arena and the size it was asked for with;
+ *   the caller must not use the block afterwards.
+ * The arena keeps lists for a few sizes only; a block of yet another
+ * size just waits for arena_delete. NULL is ignored.
+ */
+void arena_recycle(arena_t* arena, void* block, const size_t size);
+
+/******************************************/
+/* arena_bytes: bytes the arena has taken from malloc, for its chunks. */
+size_t arena_bytes(arena_t* arena);
+
+/******************************************/
+/* arena_delete: free an arena and every block in it; NULL is ignored. */
+void arena_delete(arena_t* arena);
+
+#endif // _ARENA_H_
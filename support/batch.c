@@ -0,0 +1,372 @@
+/*
+ * batch - send every message a client is owed in one datagram
+ *
+ * see batch.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "message.h"
+#include "fragment.h"
+#include "addrmap.h"
+#include "batch.h"
+
+/**************** file-local constants ****************/
+// room kept in front of each client's messages for the BATCH line
+static const int HeaderRoom = 32;
+// datagrams handed to message_sendBatch at a time; a #define so it can
+// size arrays, and as many as it sends per system call
+#define SliceSize 32
+
+/**************** local types ****************/
+typedef struct entry {
+  addr_t to;          // recipient
+  int count;          // messages queued
+  size_t first;       // offset of the first message itself, past its length
+  size_t length;      // chars used in text, including HeaderRoom
+  size_t capacity;    // chars text has room for, not counting the '\0'
+  char* text;         // HeaderRoom chars, then "<length>\n<message>" per message
+} entry_t;
+
+typedef struct batch {
+  int numEntries;     // clients with something queued
+  int capacity;       // entries allocated; entries past numEntries keep their text
+  entry_t* entries;
+  addrmap_t* index;   // each queued client's address to its entry
+} batch_t;
+
+/**************** file-local functions ****************/
+static entry_t* findEntry(batch_t* batch, const addr_t to);
+static const char* frameEntry(entry_t* entry);
+
+/**************** batch_new ****************/
+/* see batch.h for description */
+batch_t*
+batch_new(void)
+{
+  batch_t* batch = calloc(1, sizeof(batch_t));
+  if (batch == NULL) {
+    return NULL;
+  }
+  batch->index = addrmap_new();
+  if (batch->index == NULL) {
+    free(batch);
+    return NULL;
+  }
+  return batch;
+}
+
+/**************** batch_add ****************/
+/* see batch.h for description */
+bool
+batch_add(batch_t* batch, const addr_t to, const char* message)
+{
+  if (batch == NULL || message == NULL) {
+    return false;
+  }
+  entry_t* entry = findEntry(batch, to);
+  if (entry == NULL) {
+    return false;
+  }
+
+  char prefix[24];
+  size_t length = strlen(message);
+  int prefixLength = sprintf(prefix, "%zu\n", length);
+  size_t needed = entry->length + prefixLength + length;
+  if (needed > entry->capacity) {
+    size_t capacity = entry->capacity * 2 > needed ? entry->capacity * 2 : needed;
+    char* text = realloc(entry->text, capacity + 1);
+    if (text == NULL) {
+      return false;
+    }
+    entry->text = text;
+    entry->capacity = capacity;
+  }
+
+  if (entry->count == 0) {
+    entry->first = entry->length + prefixLength;
+  }
+  memcpy(entry->text + entry->length, prefix, prefixLength);
+  memcpy(entry->text + entry->length + prefixLength, message, length);
+  entry->length = needed;
+  entry->text[needed] = '\0';
+  entry->count++;
+  return true;
+}
+
+/**************** batch_flush ****************/
+/* see batch.h for description */
+void
+batch_flush(batch_t* batch)
+{
+  if (batch == NULL || batch->numEntries == 0) {
+    return;
+  }
+  // what fits in a datagram goes to the kernel a slice at a time, so
+  // the stack stays the same size however many clients there are
+  addr_t to[SliceSize];
+  const char* messages[SliceSize];
+  int count = 0;
+  for (int i = 0; i < batch->numEntries; i++) {
+    entry_t* entry = &batch->entries[i];
+    const char* text = frameEntry(entry);
+    if (entry->length - (text - entry->text) < message_MaxBytes) {
+      to[count] = entry->to;
+      messages[count++] = text;
+      if (count == SliceSize) {
+        message_sendBatch(to, messages, count);
+        count = 0;
+      }
+    } else {
+      fragment_send(entry->to, text);
+    }
+  }
+  if (count > 0) {
+    message_sendBatch(to, messages, count);
+  }
+  batch->numEntries = 0;
+  addrmap_clear(batch->index);
+}
+
+/**************** batch_split ****************/
+/* see batch.h for description */
+bool
+batch_split(const char* message,
+            bool (*handleMessage)(void* arg, const addr_t from, const char* message),
+            void* arg, const addr_t from)
+{
+  int count, used;
+  if (message == NULL || handleMessage == NULL
+      || sscanf(message, "BATCH %d%n", &count, &used) != 1
+      || count <= 0 || message[used] != '\n') {
+    return false;
+  }
+
+  // check every length before handling anything
+  const char* body = message + used + 1;
+  const char* end = body + strlen(body);
+  const char* p = body;
+  for (int i = 0; i < count; i++) {
+    char* rest;
+    long length = strtol(p, &rest, 10);
+    if (rest == p || *rest != '\n' || length < 0 || length > end - (rest + 1)) {
+      return false;
+    }
+    p = rest + 1 + length;
+  }
+  if (p != end) {
+    return false;
+  }
+
+  // handlers want null-terminated messages, so work on a copy
+  char* copy = malloc(end - body + 1);
+  if (copy == NULL) {
+    return false;
+  }
+  memcpy(copy, body, end - body + 1);
+  bool done = false;
+  char* q = copy;
+  for (int i = 0; i < count && !done; i++) {
+    char* text;
+    long length = strtol(q, &text, 10);
+    text++;
+    char next = text[length];
+    text[length] = '\0';
+    done = handleMessage(arg, from, text);
+    text[length] = next;
+    q = text + length;
+  }
+  free(copy);
+  return done;
+}
+
+/**************** batch_delete ****************/
+/* see batch.h for description */
+void
+batch_delete(batch_t* batch)
+{
+  if (batch != NULL) {
+    for (int i = 0; i < batch->capacity; i++) {
+      free(batch->entries[i].text);
+    }
+    free(batch->entries);
+    addrmap_delete(batch->index);
+    free(batch);
+  }
+}
+
+/**************** findEntry ****************/
+/* Return the entry queued for 'to', starting a new one if there is none;
+ * NULL if out of memory. The index finds it in one lookup, so a round
+ * that queues for every client stays linear in the number of clients.
+ */
+static entry_t*
+findEntry(batch_t* batch, const addr_t to)
+{
+  int i = addrmap_get(batch->index, to);
+  if (i >= 0) {
+    return &batch->entries[i];
+  }
+  if (batch->numEntries == batch->capacity) {
+    int capacity = batch->capacity == 0 ? 8 : batch->capacity * 2;
+    entry_t* entries = realloc(batch->entries, capacity * sizeof(entry_t));
+    if (entries == NULL) {
+      return NULL;
+    }
+    memset(entries + batch->capacity, 0, (capacity - batch->capacity) * sizeof(entry_t));
+    batch->entries = entries;
+    batch->capacity = capacity;
+  }
+  entry_t* entry = &batch->entries[batch->numEntries];
+  if (entry->text == NULL) {
+    entry->text = malloc(HeaderRoom + 1);
+    if (entry->text == NULL) {
+      return NULL;
+    }
+    entry->capacity = HeaderRoom;
+  }
+  if (!addrmap_put(batch->index, to, batch->numEntries)) {
+    return NULL;
+  }
+  batch->numEntries++;
+  entry->to = to;
+  entry->count = 0;
+  entry->length = HeaderRoom;
+  return entry;
+}
+
+/**************** frameEntry ****************/
+/* Return the text to send for an entry: its only message as is, or
+ * the BATCH line written just in front of the length-prefixed messages.
+ */
+static const char*
+frameEntry(entry_t* entry)
+{
+  if (entry->count == 1) {
+    return entry->text + entry->first;
+  }
+  char header[HeaderRoom];
+  int headerLength = snprintf(header, sizeof(header), "BATCH %d\n", entry->count);
+  char* start = entry->text + HeaderRoom - headerLength;
+  memcpy(start, header, headerLength);
+  return start;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test queues messages for three clients, frames them the
+ * way batch_flush would, and checks batch_split hands back the same
+ * messages in the same order, then queues for hundreds more and checks
+ * each finds its own entry. It also checks a handler that asks to
+ * stop is obeyed and that malformed BATCH messages are rejected
+ * without calling the handler.
+ *
+ *   ./batchtest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+static char received[8][200];
+static int numReceived;
+
+static bool
+record(void* arg, const addr_t from, const char* message)
+{
+  snprintf(received[numReceived++], sizeof(received[0]), "%s", message);
+  return arg != NULL && strncmp(message, "QUIT", 4) == 0;
+}
+
+int
+main(const int argc, char* argv[])
+{
+  const char* messages[3][4] = {
+    { "DISPLAY\n  +--+\n  |..|\n", "GOLD 0 5 245", "GOLD 3 8 242", NULL },
+    { "GOLD 0 0 242", NULL },
+    { "", "QUIT GAME OVER:\nA 8 alice\n", "GOLD 0 0 0", NULL },
+  };
+  int failures = 0;
+
+  batch_t* batch = batch_new();
+  addr_t clients[3];
+  for (int c = 0; c < 3; c++) {
+    clients[c] = message_noAddr();
+    clients[c].sin_port = htons(4000 + c);
+  }
+  // interleave the clients the way the server does
+  for (int i = 0; i < 4; i++) {
+    for (int c = 0; c < 3; c++) {
+      if (messages[c][i] != NULL && !batch_add(batch, clients[c], messages[c][i])) {
+        printf("batch_add failed\n");
+        failures++;
+      }
+    }
+  }
+
+  for (int c = 0; c < 3; c++) {
+    entry_t* entry = findEntry(batch, clients[c]);
+    const char* sent = frameEntry(entry);
+    numReceived = 0;
+    if (entry->count == 1) {
+      record(NULL, clients[c], sent);
+    } else {
+      // the third client's handler stops at QUIT
+      batch_split(sent, record, c == 2 ? batch : NULL, clients[c]);
+    }
+    bool ok = true;
+    int expected = 0;
+    for (int j = 0; messages[c][j] != NULL; j++) {
+      if (c == 2 && j == 2) {
+        break;
+      }
+      ok = ok && j < numReceived && strcmp(received[j], messages[c][j]) == 0;
+      expected++;
+    }
+    ok = ok && numReceived == expected;
+    printf("client %d: %d messages: %s\n", c, entry->count, ok ? "ok" : "WRONG");
+    failures += !ok;
+  }
+
+  // enough more clients to grow the entries and their index several times
+  bool found = true;
+  for (int round = 0; round < 2; round++) {
+    for (int c = 0; c < 500; c++) {
+      addr_t to = message_noAddr();
+      to.sin_port = htons(5000 + c);
+      found = found && batch_add(batch, to, "GOLD 0 0 0");
+    }
+  }
+  for (int c = 0; c < 500; c++) {
+    addr_t to = message_noAddr();
+    to.sin_port = htons(5000 + c);
+    entry_t* entry = findEntry(batch, to);
+    found = found && message_eqAddr(entry->to, to) && entry->count == 2;
+  }
+  found = found && batch->numEntries == 503;
+  printf("503 clients: %s\n", found ? "ok" : "WRONG");
+  failures += !found;
+
+  const char* malformed[] = {
+    "BATCH 2\n3\nabc", "BATCH 1\n5\nab", "BATCH 1\n2\nabc", "BATCH 0\n",
+    "BATCH 1\nx\n", "BATCH 1 2\nab",
+  };
+  for (int i = 0; i < sizeof(malformed) / sizeof(malformed[0]); i++) {
+    numReceived = 0;
+    if (batch_split(malformed[i], record, NULL, clients[0]) || numReceived != 0) {
+      printf("malformed BATCH %d was accepted\n", i);
+      failures++;
+    }
+  }
+
+  batch_delete(batch);
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
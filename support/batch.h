@@ -0,0 +1,91 @@
+/*
+ * batch - send every message a client is owed in one datagram
+ *
+ * Handling one KEY can owe a client a DISPLAY (or DELTA) and one or
+ * two GOLD messages, and sending each on its own costs a system call
+ * apiece. Instead the server adds messages to a batch as it goes and
+ * flushes it once it is done with the message that caused them. A
+ * client that gets one message gets it unchanged; a client that gets
+ * more gets them all in one
+ *
+ *   BATCH count\n<length>\n<message><length>\n<message>...
+ *
+ * where each message is preceded by its length in chars and a newline,
+ * so messages may hold newlines of their own. batch_flush hands every
+ * client's datagram to message_sendBatch at once; a batch too long for
+ * one datagram goes out as FRAGMENT pieces (see fragment.h). The receiver
+ * hands a BATCH to batch_split, which passes each message in order to
+ * the same handler message_loop uses.
+ *
+ * Only clients that said they understand BATCH should be added to a
+ * batch; our client says so with "ACK 0 RLE BATCH".
+ *
+ * Typical server sequence:
+ *   batch = batch_new();
+ *   batch_add(batch, client, message);   // any number of times
+ *   batch_flush(batch);                  // after each message, or each
+ *                                        // group from message_loopBatch
+ *   batch_delete(batch);
+ * Typical client sequence, in handleMessage:
+ *   if the message starts with "BATCH "
+ *     return batch_split(message, handleMessage, arg, from);
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _BATCH_H_
+#define _BATCH_H_
+
+#include <stdbool.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct batch batch_t;  // opaque to users of this module
+
+/****************** global functions *********************/
+
+/******************************************/
+/* batch_new: create an empty batch.
+ * Caller is responsible for calling batch_delete later.
+ */
+batch_t* batch_new(void);
+
+/******************************************/
+/* batch_add: (server) queue a message for a client.
+ * Caller provides:
+ *   the batch, recipient address and null-terminated message.
+ * We do:
+ *   copy the message after any others already queued for that address.
+ * Function returns:
+ *   false on bad arguments or if there was no memory for the copy;
+ *   the caller should then send the message itself.
+ */
+bool batch_add(batch_t* batch, const addr_t to, const char* message);
+
+/******************************************/
+/* batch_flush: (server) send everything queued, and empty the batch.
+ * We do:
+ *   send each address its one message, or a BATCH of its messages,
+ *   in the order they were added.
+ */
+void batch_flush(batch_t* batch);
+
+/******************************************/
+/* batch_split: (client) handle each message in a BATCH.
+ * Caller provides:
+ *   the BATCH as received, and the handler, arg and sender address
+ *   to call it with, as message_loop would.
+ * Function returns:
+ *   true as soon as the handler returns true (the rest are dropped),
+ *   false once every message is handled or if the BATCH was malformed.
+ */
+bool batch_split(const char* message,
+                 bool (*handleMessage)(void* arg, const addr_t from, const char* message),
+                 void* arg, const addr_t from);
+
+/******************************************/
+/* batch_delete: free a batch, dropping anything unsent; NULL is ignored. */
+void batch_delete(batch_t* batch);
+
+#endif // _BATCH_H_
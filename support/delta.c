@@ -0,0 +1,529 @@
+/*
+ * delta - frame history for delta-encoded DISPLAY messages
+ *
+ * see delta.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "delta.h"
+#include "rle.h"
+
+/**************** file-local constants ****************/
+// unchanged cells we will resend to save starting a new run;
+// a run header costs about this many chars on a typical map
+static const int RunGap = 6;
+// cells compared at once while looking for the next change, as wide
+// as a grid chunk, so untouched stretches of the map cost one memcmp
+static const int Span = 32;
+
+/**************** local types ****************/
+typedef struct delta {
+  int nrow;           // rows in the grid
+  int ncol;           // columns in the grid
+  int frameBytes;     // one frame: nrow lines of ncol chars and '\n', then '\0'
+  char* frames;       // delta_History frames
+  int* seqOf;         // slot -> sequence number held there, 0 if none
+  int lastSeq;        // newest frame sent (server) or decoded (client)
+  int acked;          // server: frame the next delta is built on, 0 if none
+  int sinceKeyframe;  // server: frames sent since the last keyframe
+  bool rle;           // server: run-length encode keyframes
+} delta_t;
+
+/**************** file-local functions ****************/
+static char* findFrame(delta_t* delta, const int seq);
+static char* slotFor(delta_t* delta, const int seq);
+static int writeKeyframe(delta_t* delta, const int seq, const char* frame,
+                         const int stride, char* message, const int size);
+static int writeDelta(delta_t* delta, const int seq, const char* base,
+                      const char* frame, const int stride,
+                      char* message, const int size);
+static bool readKeyframe(delta_t* delta, const char* body, char* into);
+static bool readRuns(delta_t* delta, const char* body, char* into);
+
+/**************** delta_new ****************/
+/* see delta.h for description */
+delta_t*
+delta_new(const int nrow, const int ncol)
+{
+  if (nrow <= 0 || ncol <= 0) {
+    return NULL;
+  }
+  delta_t* delta = calloc(1, sizeof(delta_t));
+  if (delta == NULL) {
+    return NULL;
+  }
+  delta->nrow = nrow;
+  delta->ncol = ncol;
+  delta->frameBytes = nrow * (ncol + 1) + 1;
+  delta->frames = malloc((size_t)delta_History * delta->frameBytes);
+  delta->seqOf = calloc(delta_History, sizeof(int));
+  if (delta->frames == NULL || delta->seqOf == NULL) {
+    delta_delete(delta);
+    return NULL;
+  }
+  return delta;
+}
+
+/**************** delta_encode ****************/
+/* see delta.h for description */
+int
+delta_encode(delta_t* delta, const char* frame, const int stride,
+             char* message, const int size)
+{
+  if (delta == NULL || frame == NULL || message == NULL || size <= 0) {
+    return 0;
+  }
+  int seq = delta->lastSeq + 1;
+
+  // the base must still be remembered, and in a different slot than seq
+  const char* base = NULL;
+  if (delta->acked > 0 && seq - delta->acked < delta_History
+      && delta->sinceKeyframe < delta_KeyframeInterval) {
+    base = findFrame(delta, delta->acked);
+  }
+
+  int len = -1;
+  if (base != NULL) {
+    len = writeDelta(delta, seq, base, frame, stride, message, size);
+  }
+  if (len >= 0) {
+    delta->sinceKeyframe++;
+  } else {
+    len = writeKeyframe(delta, seq, frame, stride, message, size);
+    if (len < 0) {
+      return 0;
+    }
+    delta->sinceKeyframe = 0;
+  }
+
+  // remember what the client will have once this message arrives
+  char* slot = slotFor(delta, seq);
+  for (int r = 0; r < delta->nrow; r++) {
+    memcpy(slot + r * (delta->ncol + 1), frame + r * stride, delta->ncol);
+    slot[r * (delta->ncol + 1) + delta->ncol] = '\n';
+  }
+  slot[delta->frameBytes - 1] = '\0';
+  delta->lastSeq = seq;
+  return seq;
+}
+
+/**************** delta_useRLE ****************/
+/* see delta.h for description */
+void
+delta_useRLE(delta_t* delta, const bool rle)
+{
+  if (delta != NULL) {
+    delta->rle = rle;
+  }
+}
+
+/**************** delta_ack ****************/
+/* see delta.h for description */
+void
+delta_ack(delta_t* delta, const int seq)
+{
+  if (delta == NULL) {
+    return;
+  }
+  if (seq == 0) {
+    delta->acked = 0;
+  } else if (seq > delta->acked && seq <= delta->lastSeq
+             && findFrame(delta, seq) != NULL) {
+    delta->acked = seq;
+  }
+}
+
+/**************** delta_decode ****************/
+/* see delta.h for description */
+int
+delta_decode(delta_t* delta, const char* message)
+{
+  if (delta == NULL || message == NULL) {
+    return 0;
+  }
+
+  int seq = 0, base = 0, used = 0;
+  bool ok = false;
+  char* into = NULL;
+  if (sscanf(message, "KEYFRAME %d%n", &seq, &used) == 1) {
+    if (seq <= delta->lastSeq) {
+      return 0;     // stale or duplicate
+    }
+    into = slotFor(delta, seq);
+    ok = readKeyframe(delta, message + used, into);
+  } else if (sscanf(message, "DELTA %d %d%n", &seq, &base, &used) == 2) {
+    const char* from = findFrame(delta, base);
+    if (seq <= delta->lastSeq || seq - base >= delta_History || from == NULL) {
+      return 0;     // stale, or built on a frame we do not have
+    }
+    into = slotFor(delta, seq);
+    memcpy(into, from, delta->frameBytes);
+    ok = readRuns(delta, message + used, into);
+  }
+  if (into == NULL) {
+    return 0;
+  }
+  if (!ok) {
+    delta->seqOf[seq % delta_History] = 0;
+    return 0;
+  }
+  delta->lastSeq = seq;
+  return seq;
+}
+
+/**************** delta_frame ****************/
+/* see delta.h for description */
+const char*
+delta_frame(delta_t* delta)
+{
+  return delta == NULL ? NULL : findFrame(delta, delta->lastSeq);
+}
+
+/**************** delta_delete ****************/
+/* see delta.h for description */
+void
+delta_delete(delta_t* delta)
+{
+  if (delta != NULL) {
+    free(delta->frames);
+    free(delta->seqOf);
+    free(delta);
+  }
+}
+
+/**************** findFrame ****************/
+/* Return the remembered frame seq, or NULL if it is gone. */
+static char*
+findFrame(delta_t* delta, const int seq)
+{
+  int slot = seq % delta_History;
+  if (seq <= 0 || delta->seqOf[slot] != seq) {
+    return NULL;
+  }
+  return delta->frames + (size_t)slot * delta->frameBytes;
+}
+
+/**************** slotFor ****************/
+/* Claim the slot frame seq will be kept in. */
+static char*
+slotFor(delta_t* delta, const int seq)
+{
+  int slot = seq % delta_History;
+  delta->seqOf[slot] = seq;
+  return delta->frames + (size_t)slot * delta->frameBytes;
+}
+
+/**************** writeKeyframe ****************/
+/* Write "KEYFRAME seq\n<grid>", or "KEYFRAME seq RLE\n<encoded grid>"
+ * if the client takes run-length encoding; return its length, or -1
+ * if too big.
+ */
+static int
+writeKeyframe(delta_t* delta, const int seq, const char* frame,
+              const int stride, char* message, const int size)
+{
+  int len;
+  if (delta->rle) {
+    len = snprintf(message, size, "KEYFRAME %d RLE\n", seq);
+    if (len > 0 && len < size) {
+      int n = rle_encode(frame, delta->nrow, delta->ncol, stride,
+                         message + len, size - len);
+      if (n >= 0) {
+        return len + n;
+      }
+    }
+  }
+
+  len = snprintf(message, size, "KEYFRAME %d\n", seq);
+  if (len < 0 || len + delta->frameBytes > size) {
+    return -1;
+  }
+  for (int r = 0; r < delta->nrow; r++) {
+    memcpy(message + len, frame + r * stride, delta->ncol);
+    len += delta->ncol;
+    message[len++] = '\n';
+  }
+  message[len] = '\0';
+  return len;
+}
+
+/**************** writeDelta ****************/
+/* Write "DELTA seq base\n<runs>"; return its length, or -1 if it would
+ * not fit or would be at least as long as a keyframe.
+ */
+static int
+writeDelta(delta_t* delta, const int seq, const char* base,
+           const char* frame, const int stride, char* message, const int size)
+{
+  int limit = delta->frameBytes + 20;   // about the size of a keyframe
+  if (limit > size) {
+    limit = size;
+  }
+  int len = snprintf(message, limit, "DELTA %d %d\n", seq, delta->acked);
+  if (len < 0 || len >= limit) {
+    return -1;
+  }
+
+  for (int r = 0; r < delta->nrow; r++) {
+    const char* now = frame + r * stride;
+    const char* was = base + r * (delta->ncol + 1);
+    if (memcmp(now, was, delta->ncol) == 0) {
+      continue;
+    }
+    int c = 0;
+    while (c < delta->ncol) {
+      if (c + Span <= delta->ncol && memcmp(now + c, was + c, Span) == 0) {
+        c += Span;
+        continue;
+      }
+      if (now[c] == was[c]) {
+        c++;
+        continue;
+      }
+      // extend the run over short stretches of unchanged cells
+      int end = c + 1;
+      for (int j = end; j < delta->ncol && j - end < RunGap; j++) {
+        if (now[j] != was[j]) {
+          end = j + 1;
+        }
+      }
+      int n = snprintf(message + len, limit - len, "%d %d %.*s\n",
+                       r, c, end - c, now + c);
+      if (n < 0 || n >= limit - len) {
+        return -1;
+      }
+      len += n;
+      c = end;
+    }
+  }
+  return len;
+}
+
+/**************** readKeyframe ****************/
+/* Copy the grid after "KEYFRAME seq" into a frame slot. */
+static bool
+readKeyframe(delta_t* delta, const char* body, char* into)
+{
+  if (strncmp(body, " RLE\n", strlen(" RLE\n")) == 0) {
+    if (!rle_decode(body + strlen(" RLE\n"), into, delta->nrow, delta->ncol)) {
+      return false;
+    }
+    into[delta->frameBytes - 1] = '\0';
+    return true;
+  }
+  if (*body++ != '\n') {
+    return false;
+  }
+  for (int r = 0; r < delta->nrow; r++) {
+    const char* eol = strchr(body, '\n');
+    if (eol == NULL || eol - body != delta->ncol) {
+      return false;
+    }
+    memcpy(into + r * (delta->ncol + 1), body, delta->ncol + 1);
+    body = eol + 1;
+  }
+  into[delta->frameBytes - 1] = '\0';
+  return true;
+}
+
+/**************** readRuns ****************/
+/* Apply the "row col text" lines after "DELTA seq base" to a frame. */
+static bool
+readRuns(delta_t* delta, const char* body, char* into)
+{
+  if (*body++ != '\n') {
+    return false;
+  }
+  while (*body != '\0') {
+    char* rest;
+    long r = strtol(body, &rest, 10);
+    if (rest == body || *rest != ' ') {
+      return false;
+    }
+    body = rest + 1;
+    long c = strtol(body, &rest, 10);
+    if (rest == body || *rest != ' ') {
+      return false;
+    }
+    body = rest + 1;
+    const char* eol = strchr(body, '\n');
+    if (eol == NULL) {
+      return false;
+    }
+    long n = eol - body;
+    if (r < 0 || r >= delta->nrow || c < 0 || c + n > delta->ncol) {
+      return false;
+    }
+    memcpy(into + r * (delta->ncol + 1) + c, body, n);
+    body = eol + 1;
+  }
+  return true;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test plays both ends of the protocol over a lossy "link":
+ * the server side changes a few cells of a grid each step (and now
+ * and then most of them), encodes a frame, and the client decodes it
+ * unless the message is dropped. ACKs are dropped too. After every
+ * frame the client decodes, its frame must equal what was sent. It
+ * runs once with plain keyframes and once with RLE keyframes.
+ *
+ *   ./deltatest [map.txt ...]
+ *
+ * prints the bytes sent against the bytes plain DISPLAY would have
+ * used, and exits nonzero if any frame came out wrong. For each map
+ * named on the command line it also checks a keyframe of the map
+ * decodes to the map, and compares the size and decode time of plain
+ * and RLE keyframes.
+ */
+
+#ifdef UNIT_TEST
+#include <time.h>
+#include "message.h"
+
+static int lossyLink(const bool rle);
+static int keyframeSizes(const char* mapFile);
+
+int
+main(const int argc, char* argv[])
+{
+  int mismatches = lossyLink(false) + lossyLink(true);
+  for (int i = 1; i < argc; i++) {
+    mismatches += keyframeSizes(argv[i]);
+  }
+  printf("%s: %d mismatches\n", mismatches == 0 ? "PASSED" : "FAILED", mismatches);
+  return mismatches == 0 ? 0 : 1;
+}
+
+/* Send 5000 frames over a link that loses a fifth of the messages
+ * and ACKs; return the number of frames that decoded wrong.
+ */
+static int
+lossyLink(const bool rle)
+{
+  const int nrow = 21, ncol = 79, steps = 5000;
+  const char cells[] = ".#*@ABC|-+ ";
+  srand(3);
+
+  char* grid = malloc(nrow * (ncol + 1));
+  char* message = malloc(message_MaxBytes);
+  delta_t* server = delta_new(nrow, ncol);
+  delta_t* client = delta_new(nrow, ncol);
+  if (grid == NULL || message == NULL || server == NULL || client == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  delta_useRLE(server, rle);
+  // runs of one character, like a map
+  for (int i = 0; i < nrow * (ncol + 1); ) {
+    char ch = cells[rand() % (sizeof(cells) - 1)];
+    for (int n = rand() % 12 + 1; n > 0 && i < nrow * (ncol + 1); n--) {
+      grid[i++] = ch;
+    }
+  }
+
+  long sent = 0, plain = 0;
+  int decoded = 0, mismatches = 0, keyframes = 0;
+  delta_ack(server, 0);
+  for (int step = 0; step < steps; step++) {
+    int changes = (step % 500 == 499) ? nrow * ncol : rand() % 8;
+    for (int i = 0; i < changes; i++) {
+      grid[(rand() % nrow) * (ncol + 1) + rand() % ncol] =
+        cells[rand() % (sizeof(cells) - 1)];
+    }
+    int seq = delta_encode(server, grid, ncol + 1, message, message_MaxBytes);
+    if (seq == 0) {
+      fprintf(stderr, "frame did not fit\n");
+      exit(1);
+    }
+    sent += strlen(message);
+    plain += strlen("DISPLAY\n") + nrow * (ncol + 1);
+    keyframes += strncmp(message, "KEYFRAME", strlen("KEYFRAME")) == 0;
+
+    if (rand() % 5 == 0) {
+      continue;   // message lost
+    }
+    int got = delta_decode(client, message);
+    if (got != seq) {
+      delta_ack(server, 0);
+      continue;
+    }
+    decoded++;
+    const char* frame = delta_frame(client);
+    for (int r = 0; r < nrow; r++) {
+      if (memcmp(frame + r * (ncol + 1), grid + r * (ncol + 1), ncol) != 0) {
+        mismatches++;
+        break;
+      }
+    }
+    if (rand() % 5 != 0) {
+      delta_ack(server, got);   // unless the ACK is lost
+    }
+  }
+
+  printf("%s keyframes: %d frames, %d decoded, %d keyframes\n",
+         rle ? "RLE" : "plain", steps, decoded, keyframes);
+  printf("%ld bytes sent, %ld with DISPLAY (%.1fx smaller)\n",
+         sent, plain, (double)plain / sent);
+
+  delta_delete(server);
+  delta_delete(client);
+  free(grid);
+  free(message);
+  return mismatches;
+}
+
+/* Encode a map as a plain and an RLE keyframe, decode both many times,
+ * and print sizes and times; return 1 if either decodes wrong.
+ */
+static int
+keyframeSizes(const char* mapFile)
+{
+  FILE* fp = fopen(mapFile, "r");
+  if (fp == NULL) {
+    fprintf(stderr, "cannot open %s\n", mapFile);
+    return 1;
+  }
+  char* map = malloc(message_MaxBytes);
+  size_t length = fread(map, 1, message_MaxBytes - 1, fp);
+  fclose(fp);
+  map[length] = '\0';
+  int ncol = strchr(map, '\n') - map;
+  int nrow = length / (ncol + 1);
+
+  char* message = malloc(message_MaxBytes);
+  int mismatches = 0;
+  for (int rle = 0; rle <= 1; rle++) {
+    delta_t* server = delta_new(nrow, ncol);
+    delta_useRLE(server, rle);
+    delta_encode(server, map, ncol + 1, message, message_MaxBytes);
+    const int rounds = 2000;
+    clock_t start = clock();
+    bool ok = true;
+    for (int i = 0; i < rounds && ok; i++) {
+      delta_t* client = delta_new(nrow, ncol);
+      ok = delta_decode(client, message) == 1
+           && memcmp(delta_frame(client), map, nrow * (ncol + 1)) == 0;
+      delta_delete(client);
+    }
+    double us = 1e6 * (clock() - start) / CLOCKS_PER_SEC / rounds;
+    printf("%s: %s keyframe %zu bytes, %.1f us to decode%s\n", mapFile,
+           rle ? "RLE" : "plain", strlen(message), us, ok ? "" : ", WRONG");
+    mismatches += !ok;
+    delta_delete(server);
+  }
+  free(message);
+  free(map);
+  return mismatches;
+}
+
+#endif // UNIT_TEST
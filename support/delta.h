@@ -0,0 +1,126 @@
+/*
+ * delta - frame history for delta-encoded DISPLAY messages
+ *
+ * Instead of resending the whole grid on every change, the server can
+ * send a client only the cells that differ from a frame the client has
+ * already acknowledged. Both ends keep the last few frames; the server
+ * side encodes, the client side decodes, and each uses its own delta_t.
+ *
+ * Messages from server to client:
+ *   KEYFRAME seq\n<grid>     the whole grid, one row per line, as in DISPLAY
+ *   KEYFRAME seq RLE\n<text> the same, run-length encoded (see rle.h)
+ *   DELTA seq base\n<runs>   frame seq is frame base with some runs changed;
+ *                            each run is a line "row col text", meaning the
+ *                            chars of text start at (row, col)
+ * Message from client to server:
+ *   ACK seq                  client now holds frame seq; "ACK 0" asks for
+ *                            a keyframe and is how a client signs up for
+ *                            deltas (clients that never ACK get DISPLAY)
+ *   ACK 0 RLE                the same, and the client also decodes
+ *                            run-length encoded keyframes
+ *
+ * The server falls back to a keyframe when the acknowledged frame has
+ * dropped out of the history, every delta_KeyframeInterval frames, and
+ * whenever a delta would be no smaller than the whole grid. Lost or
+ * reordered messages are therefore harmless: a delta always names the
+ * frame it was built from, and a client that lacks it sends "ACK 0".
+ *
+ * Typical server sequence, per client:
+ *   delta = delta_new(nrow, ncol);             // when "ACK 0" arrives
+ *   delta_encode(delta, gridArray, ncol + 1, message, size);
+ *   message_send(client, message);
+ *   delta_ack(delta, seq);                     // when "ACK seq" arrives
+ * Typical client sequence:
+ *   delta = delta_new(nrow, ncol);             // on GRID
+ *   if ((seq = delta_decode(delta, message)) > 0)
+ *     display delta_frame(delta) and send "ACK seq"
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _DELTA_H_
+#define _DELTA_H_
+
+#include <stdbool.h>
+
+/****************** types *********************/
+typedef struct delta delta_t;  // opaque to users of this module
+
+/****************** constants *********************/
+// number of frames each side remembers
+static const int delta_History = 8;
+// the server sends a keyframe at least this often
+static const int delta_KeyframeInterval = 64;
+
+/****************** global functions *********************/
+
+/******************************************/
+/* delta_new: create an empty frame history.
+ * Caller provides:
+ *   dimensions of the grid, as in the GRID message.
+ * Function returns:
+ *   new history, or NULL on error.
+ * Caller is responsible for calling delta_delete later.
+ */
+delta_t* delta_new(const int nrow, const int ncol);
+
+/******************************************/
+/* delta_encode: (server) turn a frame into a KEYFRAME or DELTA message.
+ * Caller provides:
+ *   the history for the client the message is for;
+ *   frame, whose row r is the ncol chars starting at frame + r * stride;
+ *   a buffer of size bytes for the message.
+ * We do:
+ *   give the frame the next sequence number, write the smaller of a
+ *   delta against the client's acknowledged frame and a keyframe into
+ *   message, and remember the frame.
+ * Function returns:
+ *   the sequence number of the frame, or 0 if the message did not fit.
+ */
+int delta_encode(delta_t* delta, const char* frame, const int stride,
+                 char* message, const int size);
+
+/******************************************/
+/* delta_useRLE: (server) run-length encode this client's keyframes.
+ * Caller provides:
+ *   the client's history, and true if it asked for RLE.
+ * Keyframes that cannot be encoded are sent as plain text.
+ */
+void delta_useRLE(delta_t* delta, const bool rle);
+
+/******************************************/
+/* delta_ack: (server) note that the client holds frame seq.
+ * Caller provides:
+ *   the client's history and the number from its ACK message.
+ * We do:
+ *   use seq as the base of the next delta if it is newer than the
+ *   current base and still remembered; seq 0 forces a keyframe.
+ */
+void delta_ack(delta_t* delta, const int seq);
+
+/******************************************/
+/* delta_decode: (client) apply a KEYFRAME or DELTA message.
+ * Caller provides:
+ *   the client's history and the message as received.
+ * Function returns:
+ *   sequence number of the frame the message carried, or 0 if the
+ *   message was malformed or built on a frame we no longer have,
+ *   in which case the client should send "ACK 0".
+ */
+int delta_decode(delta_t* delta, const char* message);
+
+/******************************************/
+/* delta_frame: (client) provide the newest frame decoded so far.
+ * Function returns:
+ *   the grid as rows ending in newlines, like the body of a DISPLAY
+ *   message, or NULL if no frame has been decoded yet. The string
+ *   belongs to the module and changes on the next delta_decode.
+ */
+const char* delta_frame(delta_t* delta);
+
+/******************************************/
+/* delta_delete: free a frame history; NULL is ignored. */
+void delta_delete(delta_t* delta);
+
+#endif // _DELTA_H_
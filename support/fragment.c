@@ -0,0 +1,235 @@
+/*
+ * fragment - send messages longer than one datagram
+ *
+ * see fragment.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include "message.h"
+#include "fragment.h"
+
+/**************** file-local global variables ****************/
+static _Thread_local int nextId = 1;   // id of the next message fragment_send splits
+
+/**************** local types ****************/
+typedef struct fragment {
+  int id;             // message being reassembled, 0 if none
+  int count;          // pieces in that message
+  int received;       // distinct pieces seen so far
+  int capacity;       // pieces text and have have room for
+  bool* have;         // index -> piece arrived
+  char* text;         // the message, piece i at i * fragment_Payload
+} fragment_t;
+
+/**************** file-local functions ****************/
+static int writePiece(char* piece, const char* message, const size_t length,
+                      const int id, const int index, const int count);
+
+/**************** fragment_send ****************/
+/* see fragment.h for description */
+bool
+fragment_send(const addr_t to, const char* message)
+{
+  if (message == NULL) {
+    return false;
+  }
+  size_t length = strlen(message);
+  if (length < message_MaxBytes) {
+    message_send(to, message);
+    return true;
+  }
+
+  // only long messages pay for a piece buffer
+  char* piece = malloc(message_MaxBytes);
+  if (piece == NULL) {
+    return false;
+  }
+  int count = (length + fragment_Payload - 1) / fragment_Payload;
+  int id = nextId++;
+  for (int i = 0; i < count; i++) {
+    writePiece(piece, message, length, id, i, count);
+    message_send(to, piece);
+  }
+  free(piece);
+  return true;
+}
+
+/**************** fragment_new ****************/
+/* see fragment.h for description */
+fragment_t*
+fragment_new(void)
+{
+  return calloc(1, sizeof(fragment_t));
+}
+
+/**************** fragment_add ****************/
+/* see fragment.h for description */
+const char*
+fragment_add(fragment_t* fragments, const char* message)
+{
+  if (fragments == NULL || message == NULL) {
+    return NULL;
+  }
+  int id, index, count, used;
+  if (sscanf(message, "FRAGMENT %d %d %d%n", &id, &index, &count, &used) != 3
+      || message[used] != '\n' || id <= 0 || count <= 0
+      || index < 0 || index >= count) {
+    return NULL;
+  }
+  const char* body = message + used + 1;
+  size_t length = strlen(body);
+  if (length > fragment_Payload || (index < count - 1 && length != fragment_Payload)) {
+    return NULL;
+  }
+
+  // a piece of a different message starts over
+  if (id != fragments->id || count != fragments->count) {
+    if (count > fragments->capacity) {
+      bool* have = realloc(fragments->have, count * sizeof(bool));
+      if (have != NULL) {
+        fragments->have = have;
+      }
+      char* text = realloc(fragments->text, (size_t)count * fragment_Payload + 1);
+      if (text != NULL) {
+        fragments->text = text;
+      }
+      if (have == NULL || text == NULL) {
+        fragments->id = 0;
+        return NULL;
+      }
+      fragments->capacity = count;
+    }
+    fragments->id = id;
+    fragments->count = count;
+    fragments->received = 0;
+    memset(fragments->have, 0, count * sizeof(bool));
+  }
+
+  if (!fragments->have[index]) {
+    fragments->have[index] = true;
+    fragments->received++;
+    memcpy(fragments->text + (size_t)index * fragment_Payload, body, length);
+    if (index == count - 1) {
+      fragments->text[(size_t)index * fragment_Payload + length] = '\0';
+    }
+  }
+  if (fragments->received < count) {
+    return NULL;
+  }
+  fragments->id = 0;    // done; a repeat of any piece starts afresh
+  return fragments->text;
+}
+
+/**************** fragment_delete ****************/
+/* see fragment.h for description */
+void
+fragment_delete(fragment_t* fragments)
+{
+  if (fragments != NULL) {
+    free(fragments->have);
+    free(fragments->text);
+    free(fragments);
+  }
+}
+
+/**************** writePiece ****************/
+/* Write piece index of message into piece (message_MaxBytes bytes);
+ * return its length.
+ */
+static int
+writePiece(char* piece, const char* message, const size_t length,
+           const int id, const int index, const int count)
+{
+  size_t offset = (size_t)index * fragment_Payload;
+  int chunk = length - offset < fragment_Payload ? length - offset : fragment_Payload;
+  int len = sprintf(piece, "FRAGMENT %d %d %d\n", id, index, count);
+  memcpy(piece + len, message + offset, chunk);
+  len += chunk;
+  piece[len] = '\0';
+  return len;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test splits a few long messages into pieces the way
+ * fragment_send does, feeds them to fragment_add in a shuffled order
+ * with some pieces repeated and a stray piece of another message
+ * mixed in, and checks the reassembled message is the original.
+ *
+ *   ./fragmenttest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+int
+main(const int argc, char* argv[])
+{
+  const int lengths[] = { message_MaxBytes, 3 * fragment_Payload, 200000 };
+  int failures = 0;
+  srand(5);
+
+  fragment_t* fragments = fragment_new();
+  char* piece = malloc(message_MaxBytes);
+  if (fragments == NULL || piece == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+
+  for (int t = 0; t < sizeof(lengths) / sizeof(lengths[0]); t++) {
+    size_t length = lengths[t];
+    char* message = malloc(length + 1);
+    for (size_t i = 0; i < length; i++) {
+      message[i] = (i % 80 == 79) ? '\n' : ".#*|-+ABC"[rand() % 9];
+    }
+    message[length] = '\0';
+
+    int count = (length + fragment_Payload - 1) / fragment_Payload;
+    int id = t + 1;
+    int order[count];
+    for (int i = 0; i < count; i++) {
+      order[i] = i;
+    }
+    for (int i = count - 1; i > 0; i--) {
+      int j = rand() % (i + 1);
+      int swap = order[i]; order[i] = order[j]; order[j] = swap;
+    }
+
+    // a piece of an abandoned message first
+    writePiece(piece, message, length, id + 100, 0, count + 1);
+    fragment_add(fragments, piece);
+
+    // each piece once in shuffled order, repeating an earlier one now and then
+    const char* whole = NULL;
+    int fed = 0;
+    for (int i = 0; i < count && whole == NULL; i++) {
+      if (i > 0) {
+        writePiece(piece, message, length, id, order[rand() % i], count);
+        if (fragment_add(fragments, piece) != NULL) {
+          break;    // a repeat must never complete the message
+        }
+      }
+      writePiece(piece, message, length, id, order[i], count);
+      whole = fragment_add(fragments, piece);
+      fed++;
+    }
+    bool ok = whole != NULL && fed == count && strcmp(whole, message) == 0;
+    printf("%zu bytes in %d pieces: %s\n", length, count, ok ? "ok" : "WRONG");
+    failures += !ok;
+    free(message);
+  }
+
+  fragment_delete(fragments);
+  free(piece);
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
@@ -0,0 +1,67 @@
+/*
+ * fragment - send messages longer than one datagram
+ *
+ * A UDP datagram carries at most message_MaxBytes, so a DISPLAY (or
+ * KEYFRAME) for a big map may not fit. fragment_send sends short
+ * messages unchanged and splits long ones into numbered pieces:
+ *
+ *   FRAGMENT id index count\n<up to fragment_Payload chars>
+ *
+ * where piece index (0 .. count-1) holds the chars starting at
+ * index * fragment_Payload of message number id. The receiver hands
+ * each FRAGMENT to fragment_add, which returns the whole message once
+ * every piece has arrived, in any order. A piece of a newer message
+ * abandons an older one that never completed; since frames are resent
+ * on the next change anyway, losing one is not a problem.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _FRAGMENT_H_
+#define _FRAGMENT_H_
+
+#include <stdbool.h>
+#include "message.h"
+
+/****************** types *********************/
+typedef struct fragment fragment_t;  // opaque to users of this module
+
+/****************** constants *********************/
+// chars of the original message in each piece; leaves room for the header
+static const int fragment_Payload = message_MaxBytes - 64;
+
+/****************** global functions *********************/
+
+/******************************************/
+/* fragment_send: send a message of any length.
+ * Caller provides:
+ *   recipient address and null-terminated message.
+ * We do:
+ *   message_send it as is if it fits in one datagram,
+ *   otherwise send it as FRAGMENT pieces.
+ * Function returns:
+ *   false on bad arguments or if a piece could not be allocated.
+ */
+bool fragment_send(const addr_t to, const char* message);
+
+/******************************************/
+/* fragment_new: create an empty reassembly buffer.
+ * Caller is responsible for calling fragment_delete later.
+ */
+fragment_t* fragment_new(void);
+
+/******************************************/
+/* fragment_add: add one received FRAGMENT message.
+ * Function returns:
+ *   the reassembled message once its last piece arrives, else NULL
+ *   (also for malformed pieces). The string belongs to the module
+ *   and is valid until the next call to fragment_add.
+ */
+const char* fragment_add(fragment_t* fragments, const char* message);
+
+/******************************************/
+/* fragment_delete: free a reassembly buffer; NULL is ignored. */
+void fragment_delete(fragment_t* fragments);
+
+#endif // _FRAGMENT_H_
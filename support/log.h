@@ -14,7 +14,9 @@
  * See the note below about file-local global variables; if log.h is included
  * by multiple source files within a single program, *each* such file has
  * its own logging fp and thus can independently control whether to log and
- * where to log.
+ * where to log. The fp is also per thread, so a program whose threads each
+ * run their own message loop calls log_init (or message_init) in each
+ * thread, and each may log somewhere different.
  * 
  * David Kotz, May 2019
  */
@@ -34,8 +36,9 @@
  * Each file that includes log.h will be able to log to its own file,
  * and thus *must* call log_init to provide that file descriptor.
  * Default is NULL, which means "do not log". 
+ * It is also local to each thread, which starts with NULL.
  */
-static FILE* logFP = NULL;
+static _Thread_local FILE* logFP = NULL;
 
 /*********** logging-related functions ****************/
 /* Module users should call the inline log_x functions; these simply provide
@@ -13,6 +13,7 @@
  * David Kotz - May 2019
  */
 
+#define _GNU_SOURCE     // for recvmmsg and sendmmsg
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
@@ -23,8 +24,15 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <poll.h>
+#include <time.h>
 #include <math.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
 #include "message.h"
+#include "wheel.h"
 #include "log.h"
 
 /**************** file-local constants ****************/
@@ -45,8 +53,37 @@ static const int MaxPort = 65535;
  * One disadvantage to this approach is that all users of this module
  * must work with the same socket, and thus the same port number,
  * but a more flexible approach would require a much more complex interface.
+ * Each thread has its own copy, so threads that each call message_init
+ * (or message_initShared) and run their own message loop never touch
+ * each other's socket or timers.
  */
-static int ourSocket = 0;     // socket on which to receive messages
+static _Thread_local int ourSocket = 0;     // socket on which to receive messages
+static _Thread_local wheel_t* timers = NULL; // timers for message_loopEvents, made on first use
+
+/**************** file-local functions ****************/
+static bool checkLoop(const char* caller, const float timeout,
+                      bool (*handleTimeout)(void* arg),
+                      bool (*handleInput)  (void* arg),
+                      bool (*handleMessage)(void* arg,
+                                            const addr_t from, const char* buf));
+static bool loop(void* arg, const float timeout,
+                 bool (*handleTimeout)(void* arg),
+                 bool (*handleInput)  (void* arg),
+                 bool (*handleMessage)(void* arg,
+                                       const addr_t from, const char* buf),
+                 bool (*handleBatch)  (void* arg));
+static bool receiveBatch(void* arg,
+                         bool (*handleMessage)(void* arg,
+                                               const addr_t from, const char* buf),
+                         char* buffers);
+static bool deliver(void* arg,
+                    bool (*handleMessage)(void* arg,
+                                          const addr_t from, const char* buf),
+                    const struct sockaddr_in sender, const char* buf);
+static int waitForEvents(const int epfd, const bool watchStdin, const int wait,
+                         bool* stdinReady, bool* socketReady);
+static long long nowMillis(void);
+static int openSocket(FILE* logFP, const int port, const bool shared);
 
 /***********************************************************************/
 /**************** message_init ****************/
@@ -58,6 +95,30 @@ static int ourSocket = 0;     // socket on which to receive messages
  */
 int
 message_init(FILE* logFP)
+{
+  return openSocket(logFP, 0, false);
+}
+
+/**************** message_initShared ****************/
+/* 
+ * message_init, on a port other sockets may share.
+ * See message.h for detailed description.
+ */
+int
+message_initShared(FILE* logFP, const int port)
+{
+  return openSocket(logFP, port, true);
+}
+
+/**************** openSocket ****************/
+/* 
+ * The work of message_init and message_initShared: bind this thread's
+ * socket to port (0 for any), with SO_REUSEPORT if shared.
+ * Invariant: ourSocket = 0 if we return with error, else ourSocket > 0.
+ * Log error and return zero if any error.
+ */
+static int
+openSocket(FILE* logFP, const int port, const bool shared)
 {
   log_init(logFP);
 
@@ -75,11 +136,28 @@ message_init(FILE* logFP)
     return 0;
   }
 
+  if (shared) {
+#ifdef SO_REUSEPORT
+    int on = 1;
+    if (setsockopt(ourSocket, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+      log_e("message_initShared: setting SO_REUSEPORT");
+      close(ourSocket);
+      ourSocket = 0;
+      return 0;
+    }
+#else
+    log_v("message_initShared: SO_REUSEPORT is not supported here");
+    close(ourSocket);
+    ourSocket = 0;
+    return 0;
+#endif
+  }
+
   // Name socket using wildcards
   struct sockaddr_in self;  // our address
   self.sin_family = AF_INET;
   self.sin_addr.s_addr = INADDR_ANY;
-  self.sin_port = 0;
+  self.sin_port = htons(port);
   if (bind(ourSocket, (struct sockaddr *) &self, sizeof(self))) {
     log_e("message_init: binding socket name");
     close(ourSocket);
@@ -96,10 +174,10 @@ message_init(FILE* logFP)
     return 0;
   }
   // extract our port number
-  int port = ntohs(self.sin_port);
-  log_d("message_init: ready at port '%d'", port);
+  int boundPort = ntohs(self.sin_port);
+  log_d("message_init: ready at port '%d'", boundPort);
 
-  return port;
+  return boundPort;
 }
 
 /**************** message_noAddr ****************/
@@ -199,7 +277,7 @@ message_stringAddr(const addr_t addr)
 {
   // Maximum string length to hold an IP address and port, plus null.
   // e.g., 255.255.255.255:65507
-  static char addrString[22]; // constant appears in snprintf below
+  static _Thread_local char addrString[22]; // constant appears in snprintf below
 
   snprintf(addrString, 22, "%s:%05d",
 	   inet_ntoa(addr.sin_addr), ntohs(addr.sin_port));
@@ -263,6 +341,71 @@ message_send(const addr_t to, const char* message)
   }
 }
 
+/**************** message_sendBatch ****************/
+/* 
+ * Send each string message to its correspondent address,
+ * up to message_BatchSize of them per sendmmsg.
+ * See message.h for detailed description.
+ */
+void
+message_sendBatch(const addr_t to[], const char* messages[], const int count)
+{
+  if (ourSocket == 0) {
+    log_v("message_sendBatch: called before message_init");
+    return; // error in usage of this function.
+  }
+  if (to == NULL || messages == NULL) {
+    log_v("message_sendBatch: called with null arrays");
+    return; // error in usage of this function.
+  }
+
+#ifdef __linux__
+  for (int first = 0; first < count; first += message_BatchSize) {
+    int n = count - first < message_BatchSize ? count - first : message_BatchSize;
+    struct mmsghdr msgs[message_BatchSize];
+    struct iovec iovecs[message_BatchSize];
+    memset(msgs, 0, sizeof(msgs));
+    int used = 0;             // messages put in msgs; NULL ones are skipped
+    for (int i = first; i < first + n; i++) {
+      if (messages[i] == NULL) {
+        log_v("message_sendBatch: called with null message");
+        continue;
+      }
+      iovecs[used].iov_base = (void*) messages[i];
+      iovecs[used].iov_len = strlen(messages[i]);
+      msgs[used].msg_hdr.msg_name = (void*) &to[i];
+      msgs[used].msg_hdr.msg_namelen = sizeof(to[i]);
+      msgs[used].msg_hdr.msg_iov = &iovecs[used];
+      msgs[used].msg_hdr.msg_iovlen = 1;
+      used++;
+    }
+
+    // sendmmsg stops at the first message it cannot send; skip that one
+    int sent = 0;
+    while (sent < used) {
+      int nsent = sendmmsg(ourSocket, msgs + sent, used - sent, 0);
+      if (nsent < 0) {
+        log_e("message_sendBatch: error sending to datagram socket");
+        sent++;
+      } else {
+        for (int i = sent; i < sent + nsent; i++) {
+          const char* message = msgs[i].msg_hdr.msg_iov->iov_base;
+          log_s("message_sendBatch: TO %s",
+                message_stringAddr(*(addr_t*) msgs[i].msg_hdr.msg_name));
+          log_d("message_sendBatch: %d lines:", numLines(message));
+          log_s("%s", message);
+        }
+        sent += nsent;
+      }
+    }
+  }
+#else
+  for (int i = 0; i < count; i++) {
+    message_send(to[i], messages[i]);
+  }
+#endif
+}
+
 /**************** message_loop ****************/
 /* 
  * Loop forever, calling handler functions for stdin or socket,
@@ -277,23 +420,44 @@ message_loop(void* arg, const float timeout,
              bool (*handleMessage)(void* arg,
                                    const addr_t from, const char* buf))
 {
-  // check if we're ready for messaging
-  if (ourSocket == 0) {
-    log_v("message_loop called before message_init");
-    return false; // error in usage of this function.
-  }
+  return loop(arg, timeout, handleTimeout, handleInput, handleMessage, NULL);
+}
 
-  // check parameters
-  if (handleTimeout == NULL && handleInput == NULL && handleMessage == NULL) {
-    log_v("message_loop called with all handlers null");
-    return false; // error in usage of this function.
-  }
-  if (handleTimeout == NULL && timeout > 0.0) {
-    log_v("message_loop called with null handleTimeout but timeout > 0");
+/**************** message_loopBatch ****************/
+/* 
+ * Like message_loop, but read every message waiting on the socket
+ * (up to message_BatchSize) per wakeup, then call handleBatch.
+ * See message.h for detailed description.
+ */
+bool
+message_loopBatch(void* arg, const float timeout,
+                  bool (*handleTimeout)(void* arg),
+                  bool (*handleInput)  (void* arg),
+                  bool (*handleMessage)(void* arg,
+                                        const addr_t from, const char* buf),
+                  bool (*handleBatch)  (void* arg))
+{
+  if (handleBatch != NULL && handleMessage == NULL) {
+    log_v("message_loopBatch called with handleBatch but null handleMessage");
     return false; // error in usage of this function.
   }
-  if (handleTimeout != NULL && timeout <= 0.0) {
-    log_v("message_loop called with Timeout handler but timeout <= 0");
+  return loop(arg, timeout, handleTimeout, handleInput, handleMessage, handleBatch);
+}
+
+/**************** loop ****************/
+/* 
+ * The loop behind message_loop and message_loopBatch; reads one
+ * message per wakeup if handleBatch is NULL, a batch otherwise.
+ */
+static bool
+loop(void* arg, const float timeout,
+     bool (*handleTimeout)(void* arg),
+     bool (*handleInput)  (void* arg),
+     bool (*handleMessage)(void* arg,
+                           const addr_t from, const char* buf),
+     bool (*handleBatch)  (void* arg))
+{
+  if (!checkLoop("message_loop", timeout, handleTimeout, handleInput, handleMessage)) {
     return false; // error in usage of this function.
   }
 
@@ -303,10 +467,21 @@ message_loop(void* arg, const float timeout,
   struct timeval  timeoutval;     // timeval equivalent of parameter 'timeout'
   if (timeout > 0.0) {
     timeoutval.tv_sec  = (int)timeout;
-    timeoutval.tv_usec = timeout - (int)timeout;
+    timeoutval.tv_usec = (timeout - (int)timeout) * 1000000;
+  }
+
+  // room for a whole batch of messages, if we read them in batches
+  char* buffers = NULL;
+  if (handleBatch != NULL) {
+    buffers = malloc((size_t)message_BatchSize * message_MaxBytes);
+    if (buffers == NULL) {
+      log_v("message_loop: no memory for message buffers");
+      return false;
+    }
   }
 
   // loop until error or some handler indicates time to quit looping
+  bool ok = true;
   while (true) {
     // for use with select()
     fd_set rfds;        // set of file descriptors we want to read
@@ -341,7 +516,8 @@ message_loop(void* arg, const float timeout,
       } else {
 	// some error occurred; this should not happen
 	log_e("message_loop: select()");
-	return false; // error
+	ok = false; // error
+	break;
       }
     } else if (select_response == 0) {
       // timeout occurred
@@ -359,7 +535,14 @@ message_loop(void* arg, const float timeout,
           break; // handler says to exit loop 
         }
       }
-      if (FD_ISSET(ourSocket, &rfds)) {
+      if (FD_ISSET(ourSocket, &rfds) && handleBatch != NULL) {
+        // socket has input ready; take all of it
+        log_v("message_loop: messages ready on socket");
+        bool stop = receiveBatch(arg, handleMessage, buffers);
+        if ((*handleBatch)(arg) || stop) {
+          break; // handler says to exit loop 
+        }
+      } else if (FD_ISSET(ourSocket, &rfds)) {
         // socket has input ready
         log_v("message_loop: message ready on socket");
         struct sockaddr_in sender;     // sender of this message
@@ -373,28 +556,337 @@ message_loop(void* arg, const float timeout,
           log_e("message_loop: receiving from socket");
         } else {
           buf[nbytes] = '\0';     // null terminate message string
-          // where was it from?
-          if (sender.sin_family != AF_INET) {
-            // ignore it
-            log_d("message_loop: non-Internet family %d\n", sender.sin_family);
-          } else {
-	    // record it
-	    log_s("message_loop: FROM %s", message_stringAddr(sender));
-	    log_d("message_loop: %d lines:", numLines(buf));
-	    log_s("%s", buf);
-
-            // handle it
-            if (handleMessage != NULL && (*handleMessage)(arg, sender, buf)) {
-              break; // handler says to exit loop 
-            }
+          if (deliver(arg, handleMessage, sender, buf)) {
+            break; // handler says to exit loop 
           }
         }
       }
     }
   }
+  free(buffers);
+  return ok;
+}
+
+/**************** message_loopEvents ****************/
+/* 
+ * Like message_loopBatch, but waiting with epoll for the next message,
+ * input, timer or idle timeout, whichever comes first.
+ * See message.h for detailed description.
+ */
+bool
+message_loopEvents(void* arg, const float timeout,
+                   bool (*handleTimeout)(void* arg),
+                   bool (*handleInput)  (void* arg),
+                   bool (*handleMessage)(void* arg,
+                                         const addr_t from, const char* buf),
+                   bool (*handleBatch)  (void* arg))
+{
+  if (!checkLoop("message_loopEvents", timeout, handleTimeout, handleInput, handleMessage)) {
+    return false; // error in usage of this function.
+  }
+
+  char* buffers = NULL;
+  if (handleMessage != NULL) {
+    buffers = malloc((size_t)message_BatchSize * message_MaxBytes);
+    if (buffers == NULL) {
+      log_v("message_loopEvents: no memory for message buffers");
+      return false;
+    }
+  }
+
+  // register the socket and stdin; epoll refuses regular files, and
+  // those always have input ready anyway
+  int epfd = -1;
+  bool stdinAlwaysReady = false;
+#ifdef __linux__
+  epfd = epoll_create1(0);
+  if (epfd < 0) {
+    log_e("message_loopEvents: epoll_create1()");
+    free(buffers);
+    return false;
+  }
+  struct epoll_event event = { .events = EPOLLIN };
+  if (handleMessage != NULL) {
+    event.data.fd = ourSocket;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, ourSocket, &event) < 0) {
+      log_e("message_loopEvents: epoll_ctl()");
+      close(epfd);
+      free(buffers);
+      return false;
+    }
+  }
+  if (handleInput != NULL) {
+    event.data.fd = 0;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, 0, &event) < 0) {
+      stdinAlwaysReady = (errno == EPERM);
+    }
+  }
+#endif
+
+  int idleMillis = timeout * 1000;        // 0 if no timeout is desired
+  long long idleSince = nowMillis();
+  bool ok = true;
+  while (true) {
+    // sleep until the next timer, or the idle timeout, whichever is sooner
+    int wait = timers != NULL ? wheel_nextDue(timers) : -1;
+    if (idleMillis > 0) {
+      long long left = idleSince + idleMillis - nowMillis();
+      left = left < 0 ? 0 : left;
+      wait = (wait < 0 || left < wait) ? left : wait;
+    }
+    if (stdinAlwaysReady) {
+      wait = 0;
+    }
+
+    bool stdinReady = false, socketReady = false;
+    int response = waitForEvents(epfd, handleInput != NULL && !stdinAlwaysReady, wait,
+                                 &stdinReady, &socketReady);
+    if (response < 0) {
+      if (errno == EINTR) {
+        // interrupted by a signal - most likely SIGWINCH; just wait again
+        log_e("message_loopEvents: EINTR: interrupted by signal");
+        continue;
+      }
+      log_e("message_loopEvents: waiting for events");
+      ok = false;
+      break;
+    }
+    stdinReady = stdinReady || stdinAlwaysReady;
+
+    // timers first, since they were due before anything else we saw
+    long long now = nowMillis();
+    if (timers != NULL && wheel_expire(timers, now, arg)) {
+      break; // handler says to exit loop 
+    }
+    if (stdinReady || socketReady) {
+      idleSince = now;
+    } else if (idleMillis > 0 && now - idleSince >= idleMillis) {
+      log_v("message_loopEvents: timed out");
+      idleSince = now;
+      if ((*handleTimeout)(arg)) {
+        break; // handler says to exit loop 
+      }
+    }
+
+    if (stdinReady) {
+      log_v("message_loopEvents: input ready on stdin");
+      if ((*handleInput)(arg)) {
+        break; // handler says to exit loop 
+      }
+    }
+    if (socketReady) {
+      log_v("message_loopEvents: messages ready on socket");
+      bool stop = receiveBatch(arg, handleMessage, buffers);
+      if ((handleBatch != NULL && (*handleBatch)(arg)) || stop) {
+        break; // handler says to exit loop 
+      }
+    }
+  }
+
+  if (epfd >= 0) {
+    close(epfd);
+  }
+  free(buffers);
+  return ok;
+}
+
+/**************** message_setTimer ****************/
+/* 
+ * Add a timer to the wheel message_loopEvents runs.
+ * See message.h for detailed description.
+ */
+int
+message_setTimer(const float seconds, const bool repeat,
+                 bool (*handleTimer)(void* arg))
+{
+  if (handleTimer == NULL || seconds < 0) {
+    log_v("message_setTimer: called with null handler or negative delay");
+    return 0; // error in usage of this function.
+  }
+  if (timers == NULL && (timers = wheel_new(nowMillis())) == NULL) {
+    log_v("message_setTimer: no memory for timers");
+    return 0;
+  }
+  int millis = seconds * 1000 + 0.5;
+  return wheel_add(timers, nowMillis(), millis, repeat ? (millis > 0 ? millis : 1) : 0,
+                   handleTimer);
+}
+
+/**************** message_cancelTimer ****************/
+/* 
+ * Remove a timer from the wheel.
+ * See message.h for detailed description.
+ */
+bool
+message_cancelTimer(const int id)
+{
+  return wheel_cancel(timers, id);
+}
+
+/**************** checkLoop ****************/
+/* 
+ * Check the module is ready and the handlers make sense for a loop;
+ * log why not and return false if they do not.
+ */
+static bool
+checkLoop(const char* caller, const float timeout,
+          bool (*handleTimeout)(void* arg),
+          bool (*handleInput)  (void* arg),
+          bool (*handleMessage)(void* arg,
+                                const addr_t from, const char* buf))
+{
+  // check if we're ready for messaging
+  if (ourSocket == 0) {
+    log_s("%s called before message_init", caller);
+    return false;
+  }
+
+  // check parameters
+  if (handleTimeout == NULL && handleInput == NULL && handleMessage == NULL) {
+    log_s("%s called with all handlers null", caller);
+    return false;
+  }
+  if (handleTimeout == NULL && timeout > 0.0) {
+    log_s("%s called with null handleTimeout but timeout > 0", caller);
+    return false;
+  }
+  if (handleTimeout != NULL && timeout <= 0.0) {
+    log_s("%s called with Timeout handler but timeout <= 0", caller);
+    return false;
+  }
   return true;
 }
 
+/**************** waitForEvents ****************/
+/* 
+ * Wait up to 'wait' ms (forever if negative) for input on the socket
+ * or, if watchStdin, on stdin; say which are ready. Returns the number
+ * ready, 0 on timeout, or -1 with errno set on error.
+ */
+static int
+waitForEvents(const int epfd, const bool watchStdin, const int wait,
+              bool* stdinReady, bool* socketReady)
+{
+#ifdef __linux__
+  struct epoll_event events[2];
+  int count = epoll_wait(epfd, events, 2, wait);
+  for (int i = 0; i < count; i++) {
+    if (events[i].data.fd == 0) {
+      *stdinReady = true;
+    } else {
+      *socketReady = true;
+    }
+  }
+  return count;
+#else
+  struct pollfd fds[2] = { { .fd = ourSocket, .events = POLLIN },
+                           { .fd = 0, .events = POLLIN } };
+  int count = poll(fds, watchStdin ? 2 : 1, wait);
+  if (count > 0) {
+    *socketReady = (fds[0].revents & POLLIN) != 0;
+    *stdinReady = watchStdin && (fds[1].revents & (POLLIN | POLLHUP)) != 0;
+  }
+  return count;
+#endif
+}
+
+/**************** nowMillis ****************/
+/* 
+ * Milliseconds on a monotonic clock, which never jumps with the time of day.
+ */
+static long long
+nowMillis(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+/**************** receiveBatch ****************/
+/* 
+ * Read the messages waiting on the socket, up to message_BatchSize,
+ * into buffers (message_BatchSize * message_MaxBytes chars) and pass
+ * each to handleMessage. Return true if the handler says to stop;
+ * the rest of the batch is then dropped.
+ */
+static bool
+receiveBatch(void* arg,
+             bool (*handleMessage)(void* arg,
+                                   const addr_t from, const char* buf),
+             char* buffers)
+{
+  struct sockaddr_in senders[message_BatchSize];
+#ifdef __linux__
+  struct mmsghdr msgs[message_BatchSize];
+  struct iovec iovecs[message_BatchSize];
+  memset(msgs, 0, sizeof(msgs));
+  for (int i = 0; i < message_BatchSize; i++) {
+    iovecs[i].iov_base = buffers + (size_t)i * message_MaxBytes;
+    iovecs[i].iov_len = message_MaxBytes - 1;
+    msgs[i].msg_hdr.msg_name = &senders[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof(senders[i]);
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+  int count = recvmmsg(ourSocket, msgs, message_BatchSize, MSG_DONTWAIT, NULL);
+  if (count < 0) {
+    // error, ignore it
+    log_e("message_loop: receiving from socket");
+    return false;
+  }
+  for (int i = 0; i < count; i++) {
+    char* buf = iovecs[i].iov_base;
+    buf[msgs[i].msg_len] = '\0';  // null terminate message string
+    if (deliver(arg, handleMessage, senders[i], buf)) {
+      return true;
+    }
+  }
+#else
+  for (int i = 0; i < message_BatchSize; i++) {
+    char* buf = buffers + (size_t)i * message_MaxBytes;
+    socklen_t senderlen = sizeof(senders[i]);
+    int nbytes = recvfrom(ourSocket, buf, message_MaxBytes-1, MSG_DONTWAIT,
+                          (struct sockaddr *) &senders[i], &senderlen);
+    if (nbytes < 0) {
+      break;    // nothing more waiting
+    }
+    buf[nbytes] = '\0';     // null terminate message string
+    if (deliver(arg, handleMessage, senders[i], buf)) {
+      return true;
+    }
+  }
+#endif
+  return false;
+}
+
+/**************** deliver ****************/
+/* 
+ * Log a message just read from the socket and pass it to handleMessage,
+ * ignoring it if it is not from an Internet address.
+ * Return true if the handler says to stop.
+ */
+static bool
+deliver(void* arg,
+        bool (*handleMessage)(void* arg,
+                              const addr_t from, const char* buf),
+        const struct sockaddr_in sender, const char* buf)
+{
+  // where was it from?
+  if (sender.sin_family != AF_INET) {
+    // ignore it
+    log_d("message_loop: non-Internet family %d\n", sender.sin_family);
+    return false;
+  }
+
+  // record it
+  log_s("message_loop: FROM %s", message_stringAddr(sender));
+  log_d("message_loop: %d lines:", numLines(buf));
+  log_s("%s", buf);
+
+  // handle it
+  return handleMessage != NULL && (*handleMessage)(arg, sender, buf);
+}
+
 /**************** message_done ****************/
 /* 
  * Clean up the message module, prior to exit.
@@ -407,6 +899,8 @@ message_done(void)
     close(ourSocket);
     ourSocket = 0;
   }
+  wheel_delete(timers);
+  timers = NULL;
   log_v("message_done: message module closing down.");
 }
 
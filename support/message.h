@@ -9,6 +9,13 @@
  *   message_init(stderr);
  *   message_loop(arg, timeout, handleTimeout, handleStdin, handleMessage);
  *   message_done();
+ * or, to read many messages per wakeup and run timers, the same with
+ *   message_setTimer(seconds, repeat, handleTimer);   // any number
+ *   message_loopEvents(arg, timeout, handleTimeout, handleStdin,
+ *                      handleMessage, handleBatch);
+ * A server may run one such loop per thread, each thread calling
+ * message_initShared with the same port; everything in this module is
+ * then per thread.
  * Typical client sequence looks like this:
  *   message_init(stderr);
  *   message_setAddr(serverHost, serverPort, &serverAddress);
@@ -49,6 +56,9 @@ typedef struct sockaddr_in addr_t;
 // Maximum payload size for UDP messages, according to
 // https://en.wikipedia.org/wiki/User_Datagram_Protocol
 static const int message_MaxBytes = 65507;
+// Most messages message_loopBatch reads per wakeup, and message_sendBatch
+// hands the kernel per system call
+static const int message_BatchSize = 32;
 
 /****************** global functions *********************/
 
@@ -64,6 +74,24 @@ static const int message_MaxBytes = 65507;
  */
 int message_init(FILE* logFP);
 
+/******************************************/
+/* message_initShared: message_init, on a port other sockets may share.
+ * Caller provides:
+ *   file pointer(fp), as for message_init, and
+ *   the port to bind, or 0 for any; the first caller usually passes 0
+ *   and hands the port it gets to the others.
+ * Function returns:
+ *   port number where messages can be sent; zero on error, or where
+ *   SO_REUSEPORT is not supported.
+ * Notes:
+ *   The socket is opened with SO_REUSEPORT, so several threads (each
+ *   of which has its own socket in this module) or processes can bind
+ *   the same port. The kernel then spreads datagrams across them by
+ *   sender address, so every datagram from one client reaches the same
+ *   socket as long as the set of sockets does not change.
+ */
+int message_initShared(FILE* logFP, const int port);
+
 /******************************************/
 /* message_noAddr: return an addr_t representing "no address".
  * Logs: nothing.
@@ -133,6 +161,22 @@ const char* message_stringAddr(const addr_t addr);
  */
 void message_send(const addr_t to, const char* message);
 
+/******************************************/
+/* message_sendBatch: send several messages at once.
+ * Caller provides:
+ *   arrays of count addresses and the string to send to each.
+ * Function returns: none
+ * We do:
+ *   the same as message_send on each pair, in order, but with one
+ *   system call per message_BatchSize messages where the system
+ *   supports it (sendmmsg on Linux).
+ * Assumptions: message_init() has already been called.
+ * Logs:
+ *   errors in arguments,
+ *   errors in sending the messages.
+ */
+void message_sendBatch(const addr_t to[], const char* messages[], const int count);
+
 /******************************************/
 /* message_loop: loop, handling input and incoming messages.
  * Caller provides:
@@ -166,6 +210,76 @@ bool message_loop(void* arg, const float timeout,
                                         const addr_t from, 
                                         const char* message));
 
+/******************************************/
+/* message_loopBatch: message_loop, reading several messages per wakeup.
+ * Caller provides:
+ *   the same as for message_loop, plus
+ *   a function to call after each group of messages (may be NULL).
+ * Function returns:
+ *   as for message_loop.
+ * Handlers:
+ *   as for message_loop; in addition
+ *   handleBatch: called after handleMessage has seen every message that
+ *     arrived together (up to message_BatchSize, read with one recvmmsg
+ *     on Linux), including when handleMessage asked to stop, so it can
+ *     flush anything handleMessage queued up.
+ * Logs:
+ *   as for message_loop.
+ */
+bool message_loopBatch(void* arg, const float timeout,
+                       bool (*handleTimeout)(void* arg),
+                       bool (*handleInput)  (void* arg),
+                       bool (*handleMessage)(void* arg,
+                                             const addr_t from,
+                                             const char* message),
+                       bool (*handleBatch)  (void* arg));
+
+/******************************************/
+/* message_loopEvents: message_loopBatch, with timers and no busy polling.
+ * Caller provides:
+ *   the same as for message_loopBatch; timeout may be fractional.
+ * Function returns:
+ *   as for message_loop.
+ * Handlers:
+ *   as for message_loopBatch (handleBatch may be NULL); in addition
+ *   every timer set with message_setTimer is called with 'arg' when due.
+ * Notes:
+ *   Waits with epoll on Linux (poll elsewhere) for exactly as long as
+ *   the next timer or the idle timeout allows, on a monotonic clock.
+ *   Unlike message_loop, stdin may also be a regular file.
+ * Logs:
+ *   as for message_loop.
+ */
+bool message_loopEvents(void* arg, const float timeout,
+                        bool (*handleTimeout)(void* arg),
+                        bool (*handleInput)  (void* arg),
+                        bool (*handleMessage)(void* arg,
+                                              const addr_t from,
+                                              const char* message),
+                        bool (*handleBatch)  (void* arg));
+
+/******************************************/
+/* message_setTimer: ask message_loopEvents to call a handler later.
+ * Caller provides:
+ *   delay in seconds (to the millisecond), whether to repeat at that
+ *   interval, and the handler, which gets the loop's 'arg' and returns
+ *   true to end the loop, as the other handlers do.
+ * Function returns:
+ *   an id for message_cancelTimer, or 0 on error.
+ * Notes:
+ *   May be called before the loop starts or from any handler.
+ *   Repeating timers keep a fixed rate; see wheel.h.
+ */
+int message_setTimer(const float seconds, const bool repeat,
+                     bool (*handleTimer)(void* arg));
+
+/******************************************/
+/* message_cancelTimer: cancel a timer from message_setTimer.
+ * Function returns:
+ *   true if it was still pending.
+ */
+bool message_cancelTimer(const int id);
+
 /******************************************/
 /* message_done: shut down the module.
  * Caller provides: nothing.
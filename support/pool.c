@@ -0,0 +1,242 @@
+/*
+ * pool - a fixed set of threads that share out indexed jobs
+ *
+ * see pool.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#define _POSIX_C_SOURCE 200809L     // for pthreads
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include "pool.h"
+
+/**************** local types ****************/
+typedef struct pool {
+  pthread_t* threads;
+  int numThreads;
+  pthread_mutex_t lock;               // guards everything below
+  pthread_cond_t start;               // a run began, or the pool is stopping
+  pthread_cond_t done;                // the last thread finished its share
+  long long run;                      // runs started so far
+  void (*work)(void* arg, const int index);
+  void* arg;
+  int count;                          // indexes in this run
+  int next;                           // next index to hand out
+  int busy;                           // threads not yet done with this run
+  bool stopping;
+} pool_t;
+
+/**************** file-local functions ****************/
+static void* serve(void* arg);
+static void workShare(pool_t* pool);
+
+/**************** pool_new ****************/
+/* see pool.h for description */
+pool_t*
+pool_new(const int numThreads)
+{
+  if (numThreads < 0) {
+    return NULL;
+  }
+  pool_t* pool = calloc(1, sizeof(pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->threads = calloc(numThreads > 0 ? numThreads : 1, sizeof(pthread_t));
+  if (pool->threads == NULL) {
+    free(pool);
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+
+  for (int t = 0; t < numThreads; t++) {
+    if (pthread_create(&pool->threads[t], NULL, serve, pool) != 0) {
+      pool_delete(pool);          // stops the ones already started
+      return NULL;
+    }
+    pool->numThreads++;
+  }
+  return pool;
+}
+
+/**************** pool_run ****************/
+/* see pool.h for description */
+void
+pool_run(pool_t* pool, const int count,
+         void (*work)(void* arg, const int index), void* arg)
+{
+  if (work == NULL || count <= 0) {
+    return;
+  }
+  if (pool == NULL || pool->numThreads == 0) {
+    for (int i = 0; i < count; i++) {
+      (*work)(arg, i);
+    }
+    return;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  pool->work = work;
+  pool->arg = arg;
+  pool->count = count;
+  pool->next = 0;
+  pool->busy = pool->numThreads;
+  pool->run++;
+  pthread_cond_broadcast(&pool->start);
+
+  // the caller takes a share too, rather than sleeping through the run
+  workShare(pool);
+  while (pool->busy > 0) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+/**************** pool_size ****************/
+/* see pool.h for description */
+int
+pool_size(pool_t* pool)
+{
+  return pool == NULL ? 0 : pool->numThreads;
+}
+
+/**************** pool_delete ****************/
+/* see pool.h for description */
+void
+pool_delete(pool_t* pool)
+{
+  if (pool != NULL) {
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for (int t = 0; t < pool->numThreads; t++) {
+      pthread_join(pool->threads[t], NULL);
+    }
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->threads);
+    free(pool);
+  }
+}
+
+/**************** serve ****************/
+/* Thread body: take a share of each run until the pool stops. */
+static void*
+serve(void* arg)
+{
+  pool_t* pool = arg;
+  long long seen = 0;              // no run starts before pool_new returns
+  pthread_mutex_lock(&pool->lock);
+  while (true) {
+    while (!pool->stopping && pool->run == seen) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->stopping) {
+      break;
+    }
+    seen = pool->run;
+    workShare(pool);
+    if (--pool->busy == 0) {
+      pthread_cond_signal(&pool->done);
+    }
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return NULL;
+}
+
+/**************** workShare ****************/
+/* Run indexes until none are left; called and returns holding the lock,
+ * which is dropped around each call to work.
+ */
+static void
+workShare(pool_t* pool)
+{
+  while (pool->next < pool->count) {
+    int index = pool->next++;
+    pthread_mutex_unlock(&pool->lock);
+    (*pool->work)(pool->arg, index);
+    pthread_mutex_lock(&pool->lock);
+  }
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test runs many small jobs through pools of several sizes:
+ * each index must run exactly once per run, runs must not overlap, a
+ * run must be finished when pool_run returns, and a pool with no
+ * threads (or no pool at all) must run everything on the caller.
+ *
+ *   ./pooltest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+#define Slots 1000
+
+typedef struct tally {
+  int hits[Slots];                    // index -> times run
+  long long sums[Slots];              // something to compute, per index
+} tally_t;
+
+static void
+count(void* arg, const int index)
+{
+  tally_t* tally = arg;
+  tally->hits[index]++;
+  long long sum = 0;
+  for (int i = 0; i <= index * 50; i++) {   // uneven work per index
+    sum += i % 7;
+  }
+  tally->sums[index] = sum;
+}
+
+int
+main(const int argc, char* argv[])
+{
+  int failures = 0;
+  static tally_t expected, tally;
+  pool_run(NULL, Slots, count, &expected);
+
+  int sizes[] = { 0, 1, 3, 8 };
+  for (int s = 0; s < 4; s++) {
+    pool_t* pool = pool_new(sizes[s]);
+    CHECK(pool != NULL);
+    CHECK(pool_size(pool) == sizes[s]);
+    for (int run = 1; run <= 50; run++) {
+      int n = run % 5 == 0 ? 1 : Slots;     // some runs smaller than the pool
+      pool_run(pool, n, count, &tally);
+      int wrong = 0;
+      for (int i = 0; i < n; i++) {
+        if (tally.sums[i] != expected.sums[i]) {
+          wrong++;
+        }
+      }
+      CHECK(wrong == 0);
+    }
+    // every index ran once per run that reached it
+    CHECK(tally.hits[0] == 50);
+    CHECK(tally.hits[Slots - 1] == 40);
+    for (int i = 0; i < Slots; i++) {
+      tally.hits[i] = 0;
+    }
+    pool_run(pool, 0, count, &tally);       // nothing to do
+    pool_delete(pool);
+  }
+  pool_delete(NULL);
+  CHECK(pool_new(-1) == NULL);
+
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
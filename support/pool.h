@@ -0,0 +1,62 @@
+/*
+ * pool - a fixed set of threads that share out indexed jobs
+ *
+ * Runs a function once for each index 0..count-1, spread across the
+ * pool's threads and the caller's own, and returns when every index is
+ * done. The indexes are handed out one at a time from a shared counter,
+ * so a slow index does not hold up the rest. Nothing is returned but
+ * what the function writes; if each index writes only its own output,
+ * the result is the same however the indexes were shared out.
+ *
+ * The threads sleep between runs, so a pool costs nothing while idle.
+ * One thread at a time may call pool_run on a pool.
+ *
+ * Typical use:
+ *   pool = pool_new(3);                        // 3 threads + the caller
+ *   pool_run(pool, numPlayers, work, arg);     // work(arg, 0..numPlayers-1)
+ *   ... use what work wrote, in index order ...
+ *   pool_delete(pool);
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _POOL_H_
+#define _POOL_H_
+
+/****************** types *********************/
+typedef struct pool pool_t;  // opaque to users of this module
+
+/****************** global functions *********************/
+
+/******************************************/
+/* pool_new: start a pool of threads.
+ * Caller provides:
+ *   the number of threads to start (>= 0); pool_run also works on the
+ *   calling thread, so 0 runs everything there.
+ * Function returns:
+ *   new pool, or NULL on error.
+ * Caller is responsible for calling pool_delete later.
+ */
+pool_t* pool_new(const int numThreads);
+
+/******************************************/
+/* pool_run: call work(arg, i) for every i from 0 to count-1.
+ * We do:
+ *   share the indexes among the pool's threads and the caller,
+ *   and return once every call has returned.
+ * A NULL pool runs them all on the calling thread, in order.
+ * work must be safe to run for different indexes at the same time.
+ */
+void pool_run(pool_t* pool, const int count,
+              void (*work)(void* arg, const int index), void* arg);
+
+/******************************************/
+/* pool_size: threads in the pool, not counting the caller; 0 for NULL. */
+int pool_size(pool_t* pool);
+
+/******************************************/
+/* pool_delete: stop and free a pool; NULL is ignored. */
+void pool_delete(pool_t* pool);
+
+#endif // _POOL_H_
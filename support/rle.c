@@ -0,0 +1,111 @@
+/*
+ * rle - run-length encoding for grid frames
+ *
+ * see rle.h for more information.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include "rle.h"
+
+/**************** file-local constants ****************/
+// shortest run worth a count; "3." is already shorter than "..."
+static const int MinRun = 3;
+
+/**************** rle_encode ****************/
+/* see rle.h for description */
+int
+rle_encode(const char* frame, const int nrow, const int ncol,
+           const int stride, char* out, const int size)
+{
+  if (frame == NULL || out == NULL || size <= 0) {
+    return -1;
+  }
+  int len = 0;
+  for (int r = 0; r < nrow; r++) {
+    const char* row = frame + r * stride;
+    int c = 0;
+    while (c < ncol) {
+      char ch = row[c];
+      if (isdigit((unsigned char)ch)) {
+        return -1;
+      }
+      int run = 1;
+      while (c + run < ncol && row[c + run] == ch) {
+        run++;
+      }
+      if (run >= MinRun) {
+        int n = snprintf(out + len, size - len, "%d%c", run, ch);
+        if (n < 0 || n >= size - len) {
+          return -1;
+        }
+        len += n;
+        c += run;
+      } else {
+        if (len + 1 >= size) {
+          return -1;
+        }
+        out[len++] = ch;
+        c++;
+      }
+    }
+    if (len + 1 >= size) {
+      return -1;
+    }
+    out[len++] = '\n';
+  }
+  out[len] = '\0';
+  return len;
+}
+
+/**************** rle_decode ****************/
+/* see rle.h for description */
+bool
+rle_decode(const char* in, char* rows, const int nrow, const int ncol)
+{
+  if (in == NULL || rows == NULL) {
+    return false;
+  }
+  for (int r = 0; r < nrow; r++) {
+    char* row = rows + r * (ncol + 1);
+    int c = 0;
+    if (*in == '\0') {
+      return false;
+    }
+    while (*in != '\n') {
+      // copy a stretch of single characters in one go
+      size_t literal = strcspn(in, "0123456789\n");
+      if (literal > 0) {
+        if (in[literal] == '\0' || c + (int)literal > ncol) {
+          return false;
+        }
+        memcpy(row + c, in, literal);
+        c += literal;
+        in += literal;
+        continue;
+      }
+      // otherwise a count and the character it repeats
+      char* rest;
+      long run = strtol(in, &rest, 10);
+      if (run < MinRun || c + run > ncol || *rest == '\0' || *rest == '\n'
+          || isdigit((unsigned char)*rest)) {
+        return false;
+      }
+      memset(row + c, *rest, run);
+      c += run;
+      in = rest + 1;
+    }
+    if (c != ncol) {
+      return false;
+    }
+    row[ncol] = '\n';
+    in++;
+  }
+  return *in == '\0';
+}
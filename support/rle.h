@@ -0,0 +1,50 @@
+/*
+ * rle - run-length encoding for grid frames
+ *
+ * Most of a map is long runs of the same character: blank space
+ * outside the rooms, floor inside them, walls along their edges. A
+ * frame body (rows of ncol chars, each followed by a newline, as in
+ * DISPLAY) is encoded row by row, and each row is a mix of
+ *
+ *   c      a single character, copied as is
+ *   <n>c   n copies of character c, written when n >= 3
+ *
+ * followed by a newline. Grid characters are never digits, so a
+ * digit always starts a run count; frames that hold a digit cannot
+ * be encoded. On maps/big.txt this shrinks a frame almost 4 times.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _RLE_H_
+#define _RLE_H_
+
+#include <stdbool.h>
+
+/****************** global functions *********************/
+
+/******************************************/
+/* rle_encode: encode a frame.
+ * Caller provides:
+ *   frame, whose row r is the ncol chars starting at frame + r * stride;
+ *   a buffer of size bytes for the encoded text.
+ * Function returns:
+ *   length of the encoded text (null-terminated in out), or -1 if it
+ *   did not fit or the frame holds a digit.
+ */
+int rle_encode(const char* frame, const int nrow, const int ncol,
+               const int stride, char* out, const int size);
+
+/******************************************/
+/* rle_decode: decode a frame.
+ * Caller provides:
+ *   encoded text, and room for nrow * (ncol + 1) chars in rows.
+ * We do:
+ *   write each row of ncol chars followed by a newline into rows.
+ * Function returns:
+ *   true if the text held exactly nrow rows of ncol chars.
+ */
+bool rle_decode(const char* in, char* rows, const int nrow, const int ncol);
+
+#endif // _RLE_H_
@@ -0,0 +1,41 @@
+/*
+ * unittest - helpers shared by the modules' UNIT_TEST drivers
+ *
+ * Each driver keeps an int failures in main, CHECKs its expectations,
+ * and ends with the one-line summary the test targets look for:
+ *
+ *   int failures = 0;
+ *   CHECK(wheel_nextDue(wheel) == -1);
+ *   ...
+ *   return unittest_report(failures);
+ *
+ * Include this only under #ifdef UNIT_TEST, or in a test driver of its
+ * own such as grid's gridtest.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _UNITTEST_H_
+#define _UNITTEST_H_
+
+#include <stdio.h>
+
+/**************** CHECK ****************/
+/* Print the line and text of cond and count a failure if it is false;
+ * needs an int failures in scope.
+ */
+#define CHECK(cond) do { if (!(cond)) { printf("line %d: %s\n", __LINE__, #cond); failures++; } } while (0)
+
+/**************** unittest_report ****************/
+/* Print "PASSED: 0 failures" or "FAILED: n failures" and return the
+ * driver's exit status, 0 only if there were no failures.
+ */
+static inline int
+unittest_report(const int failures)
+{
+  printf("%s: %d failures\n", failures == 0 ? "PASSED" : "FAILED", failures);
+  return failures == 0 ? 0 : 1;
+}
+
+#endif // _UNITTEST_H_
@@ -0,0 +1,313 @@
+/*
+ * wheel - a timer wheel
+ *
+ * see wheel.h for more information.
+ *
+ * Compile with -DUNIT_TEST for a standalone unit test; see below.
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "wheel.h"
+
+/**************** local types ****************/
+typedef struct wheelTimer {
+  int id;
+  long long due;                  // ms when it next fires
+  int interval;                   // ms between firings, 0 for once
+  bool (*handler)(void* arg);
+  struct wheelTimer* next;        // next in the same slot
+} wheelTimer_t;
+
+typedef struct wheel {
+  wheelTimer_t** slots;               // wheel_Slots lists; slot due % wheel_Slots, unsorted
+  long long tick;                     // every timer due by tick has fired
+  int count;                          // timers in the wheel
+  int nextId;                         // id for the next wheel_add
+} wheel_t;
+
+/**************** file-local functions ****************/
+static void insert(wheel_t* wheel, wheelTimer_t* timer);
+static wheelTimer_t* takeDue(wheel_t* wheel, const long long t);
+
+/**************** wheel_new ****************/
+/* see wheel.h for description */
+wheel_t*
+wheel_new(const long long now)
+{
+  wheel_t* wheel = calloc(1, sizeof(wheel_t));
+  if (wheel == NULL) {
+    return NULL;
+  }
+  wheel->slots = calloc(wheel_Slots, sizeof(wheelTimer_t*));
+  if (wheel->slots == NULL) {
+    free(wheel);
+    return NULL;
+  }
+  wheel->tick = now;
+  wheel->nextId = 1;
+  return wheel;
+}
+
+/**************** wheel_add ****************/
+/* see wheel.h for description */
+int
+wheel_add(wheel_t* wheel, const long long now, const int delay,
+          const int interval, bool (*handler)(void* arg))
+{
+  if (wheel == NULL || handler == NULL || delay < 0 || interval < 0) {
+    return 0;
+  }
+  wheelTimer_t* timer = malloc(sizeof(wheelTimer_t));
+  if (timer == NULL) {
+    return 0;
+  }
+  timer->id = wheel->nextId++;
+  // the slot for the current tick has already been visited
+  timer->due = now + delay > wheel->tick ? now + delay : wheel->tick + 1;
+  timer->interval = interval;
+  timer->handler = handler;
+  insert(wheel, timer);
+  return timer->id;
+}
+
+/**************** wheel_cancel ****************/
+/* see wheel.h for description */
+bool
+wheel_cancel(wheel_t* wheel, const int id)
+{
+  if (wheel == NULL) {
+    return false;
+  }
+  for (int s = 0; s < wheel_Slots; s++) {
+    for (wheelTimer_t** p = &wheel->slots[s]; *p != NULL; p = &(*p)->next) {
+      if ((*p)->id == id) {
+        wheelTimer_t* timer = *p;
+        *p = timer->next;
+        free(timer);
+        wheel->count--;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**************** wheel_nextDue ****************/
+/* see wheel.h for description */
+int
+wheel_nextDue(wheel_t* wheel)
+{
+  if (wheel == NULL || wheel->count == 0) {
+    return -1;
+  }
+  for (int ms = 1; ms <= wheel_Slots; ms++) {
+    long long t = wheel->tick + ms;
+    for (wheelTimer_t* timer = wheel->slots[t % wheel_Slots]; timer != NULL; timer = timer->next) {
+      if (timer->due <= t) {
+        return ms;
+      }
+    }
+  }
+  return wheel_Slots;
+}
+
+/**************** wheel_expire ****************/
+/* see wheel.h for description */
+bool
+wheel_expire(wheel_t* wheel, const long long now, void* arg)
+{
+  if (wheel == NULL || now <= wheel->tick) {
+    return false;
+  }
+  // after a long gap, one rotation still visits every slot
+  long long first = wheel->tick + 1;
+  if (now - first >= wheel_Slots) {
+    first = now - wheel_Slots + 1;
+  }
+
+  for (long long t = first; t <= now; t++) {
+    wheel->tick = t;
+    wheelTimer_t* timer;
+    while ((timer = takeDue(wheel, t)) != NULL) {
+      bool (*handler)(void* arg) = timer->handler;
+      if (timer->interval > 0) {
+        // next firing on the timer's own schedule, skipping any we missed
+        timer->due += timer->interval;
+        if (timer->due <= now) {
+          timer->due += ((now - timer->due) / timer->interval + 1) * timer->interval;
+        }
+        insert(wheel, timer);
+      } else {
+        free(timer);
+      }
+      if ((*handler)(arg)) {
+        wheel->tick = t - 1;    // anything else due at t runs next time
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**************** wheel_delete ****************/
+/* see wheel.h for description */
+void
+wheel_delete(wheel_t* wheel)
+{
+  if (wheel != NULL) {
+    for (int s = 0; s < wheel_Slots; s++) {
+      while (wheel->slots[s] != NULL) {
+        wheelTimer_t* next = wheel->slots[s]->next;
+        free(wheel->slots[s]);
+        wheel->slots[s] = next;
+      }
+    }
+    free(wheel->slots);
+    free(wheel);
+  }
+}
+
+/**************** insert ****************/
+/* Put a timer into the slot for its due time. */
+static void
+insert(wheel_t* wheel, wheelTimer_t* timer)
+{
+  int s = timer->due % wheel_Slots;
+  timer->next = wheel->slots[s];
+  wheel->slots[s] = timer;
+  wheel->count++;
+}
+
+/**************** takeDue ****************/
+/* Unlink and return a timer from t's slot that is due by t, or NULL.
+ * Timers due a rotation or more later share the slot and stay put.
+ */
+static wheelTimer_t*
+takeDue(wheel_t* wheel, const long long t)
+{
+  for (wheelTimer_t** p = &wheel->slots[t % wheel_Slots]; *p != NULL; p = &(*p)->next) {
+    if ((*p)->due <= t) {
+      wheelTimer_t* timer = *p;
+      *p = timer->next;
+      wheel->count--;
+      return timer;
+    }
+  }
+  return NULL;
+}
+
+/* ************************* UNIT_TEST ****************************** */
+/*
+ * This unit test drives a wheel with a made-up clock: a 50ms ticker,
+ * one-shot timers near and well beyond one rotation, a cancelled
+ * timer, a handler that adds and cancels timers, a handler that asks
+ * to stop, and a long stall the ticker must skip rather than replay.
+ * It checks each timer fires when it should, and that wheel_nextDue
+ * agrees with when the next one actually fires.
+ *
+ *   ./wheeltest
+ */
+
+#ifdef UNIT_TEST
+#include "unittest.h"
+
+static long long fakeClock;                 // the made-up time, ms
+static wheel_t* testWheel;
+static int ticks, onceFired, farFired, chainFired, stops;
+static long long onceAt, farAt, chainAt;
+static long long tickTimes[100];
+static int doomedId;
+
+static bool tick(void* arg) { tickTimes[ticks++] = fakeClock; return false; }
+static bool once(void* arg) { onceFired++; onceAt = fakeClock; return false; }
+static bool far(void* arg) { farFired++; farAt = fakeClock; return false; }
+static bool chained(void* arg) { chainFired++; chainAt = fakeClock; return false; }
+static bool doomed(void* arg) { return false; }
+static bool stopper(void* arg) { stops++; return true; }
+
+// adds a timer 7ms out and cancels doomed, from inside a handler
+static bool spawner(void* arg)
+{
+  wheel_add(testWheel, fakeClock, 7, 0, chained);
+  wheel_cancel(testWheel, doomedId);
+  return false;
+}
+
+int
+main(const int argc, char* argv[])
+{
+  int failures = 0;
+  fakeClock = 1000;
+  testWheel = wheel_new(fakeClock);
+  CHECK(wheel_nextDue(testWheel) == -1);
+
+  int tickId = wheel_add(testWheel, fakeClock, 50, 50, tick);
+  wheel_add(testWheel, fakeClock, 130, 0, once);
+  wheel_add(testWheel, fakeClock, 700, 0, far);           // beyond one rotation
+  int cancelled = wheel_add(testWheel, fakeClock, 20, 0, once);
+  doomedId = wheel_add(testWheel, fakeClock, 100, 0, doomed);
+  wheel_add(testWheel, fakeClock, 90, 0, spawner);
+  CHECK(wheel_cancel(testWheel, cancelled));
+  CHECK(!wheel_cancel(testWheel, cancelled));
+  CHECK(wheel_nextDue(testWheel) == 50);
+
+  // step one ms at a time, checking nextDue predicts each firing
+  int predicted = wheel_nextDue(testWheel);
+  long long predictedAt = fakeClock + predicted;
+  while (fakeClock < 1300) {
+    fakeClock++;
+    int before = ticks + onceFired + chainFired;
+    wheel_expire(testWheel, fakeClock, NULL);
+    if (ticks + onceFired + chainFired != before) {
+      CHECK(fakeClock == predictedAt);
+    }
+    predicted = wheel_nextDue(testWheel);
+    predictedAt = fakeClock + predicted;
+  }
+  CHECK(ticks == 6 && tickTimes[0] == 1050 && tickTimes[5] == 1300);
+  CHECK(onceFired == 1 && onceAt == 1130);
+  CHECK(chainFired == 1 && chainAt == 1097);
+  CHECK(farFired == 0);
+
+  // big uneven steps fire everything that came due, late, and only once
+  fakeClock = 1490;
+  wheel_expire(testWheel, fakeClock, NULL);
+  CHECK(ticks == 7 && tickTimes[6] == 1490);
+  CHECK(wheel_nextDue(testWheel) == 10);
+  fakeClock = 1720;
+  wheel_expire(testWheel, fakeClock, NULL);
+  CHECK(farFired == 1 && farAt == 1720);
+
+  // a 2s stall: the ticker fires once, then resumes on its 50ms grid
+  int ticksBefore = ticks;
+  fakeClock = 3733;
+  wheel_expire(testWheel, fakeClock, NULL);
+  CHECK(ticks == ticksBefore + 1);
+  CHECK(wheel_nextDue(testWheel) == 17);
+  fakeClock = 3750;
+  wheel_expire(testWheel, fakeClock, NULL);
+  CHECK(ticks == ticksBefore + 2);
+
+  // a handler asking to stop leaves the rest for the next call
+  wheel_add(testWheel, fakeClock, 5, 0, stopper);
+  wheel_add(testWheel, fakeClock, 5, 0, stopper);
+  fakeClock += 5;
+  CHECK(wheel_expire(testWheel, fakeClock, NULL));
+  CHECK(stops == 1);
+  CHECK(wheel_expire(testWheel, fakeClock + 1, NULL));
+  CHECK(stops == 2);
+  CHECK(!wheel_expire(testWheel, fakeClock + 2, NULL));
+
+  CHECK(wheel_cancel(testWheel, tickId));
+  CHECK(wheel_nextDue(testWheel) == -1);
+  wheel_delete(testWheel);
+
+  return unittest_report(failures);
+}
+
+#endif // UNIT_TEST
@@ -0,0 +1,95 @@
+/*
+ * wheel - a timer wheel
+ *
+ * Keeps any number of one-shot and repeating timers and tells the
+ * caller when the next one is due, so an event loop can sleep exactly
+ * that long instead of polling. Time is whatever millisecond clock
+ * the caller passes in (message.c uses CLOCK_MONOTONIC), which keeps
+ * the wheel itself free of system calls and easy to test.
+ *
+ * Timers hash into wheel_Slots slots by the millisecond they are due,
+ * so adding one is O(1), and each millisecond that passes costs one
+ * slot visit. Repeating timers run at a fixed rate: each firing is
+ * scheduled from when the last one was due, not from when it ran, and
+ * firings missed while the caller was busy are skipped, not bunched.
+ *
+ * Typical use:
+ *   wheel = wheel_new(now);
+ *   id = wheel_add(wheel, now, 50, 50, tick);      // every 50ms
+ *   loop:
+ *     wait at most wheel_nextDue(wheel) ms for something else to happen
+ *     wheel_expire(wheel, now, arg);               // runs what is due
+ *   wheel_delete(wheel);
+ *
+ * Team Big D Nuggies
+ * Jacob Fleming, Fall 2024
+ */
+
+#ifndef _WHEEL_H_
+#define _WHEEL_H_
+
+#include <stdbool.h>
+
+/****************** types *********************/
+typedef struct wheel wheel_t;  // opaque to users of this module
+
+/****************** constants *********************/
+// slots in the wheel, one per millisecond of a rotation
+static const int wheel_Slots = 256;
+
+/****************** global functions *********************/
+
+/******************************************/
+/* wheel_new: create a wheel with no timers.
+ * Caller provides:
+ *   the current time in milliseconds.
+ * Function returns:
+ *   new wheel, or NULL on error.
+ * Caller is responsible for calling wheel_delete later.
+ */
+wheel_t* wheel_new(const long long now);
+
+/******************************************/
+/* wheel_add: add a timer.
+ * Caller provides:
+ *   the current time, the delay in ms before it first fires, the ms
+ *   between later firings (0 to fire once), and the handler to call.
+ * Function returns:
+ *   an id (> 0) for wheel_cancel, or 0 on error.
+ * Handlers are called by wheel_expire with its 'arg' and return true
+ * to ask the caller to stop; they may add and cancel timers.
+ */
+int wheel_add(wheel_t* wheel, const long long now, const int delay,
+              const int interval, bool (*handler)(void* arg));
+
+/******************************************/
+/* wheel_cancel: remove a timer.
+ * Function returns:
+ *   true if the timer was there; false if it had already fired
+ *   (for a one-shot timer) or been cancelled.
+ */
+bool wheel_cancel(wheel_t* wheel, const int id);
+
+/******************************************/
+/* wheel_nextDue: how long until a timer is due.
+ * Function returns:
+ *   ms until the next timer is due as of the last wheel_expire,
+ *   at most wheel_Slots for timers further out; -1 if there are none.
+ */
+int wheel_nextDue(wheel_t* wheel);
+
+/******************************************/
+/* wheel_expire: run every timer that is due.
+ * Caller provides:
+ *   the current time, and the arg to pass to the handlers.
+ * Function returns:
+ *   true as soon as a handler returns true (the timers still due
+ *   then run on the next call), otherwise false.
+ */
+bool wheel_expire(wheel_t* wheel, const long long now, void* arg);
+
+/******************************************/
+/* wheel_delete: free a wheel and its timers; NULL is ignored. */
+void wheel_delete(wheel_t* wheel);
+
+#endif // _WHEEL_H_